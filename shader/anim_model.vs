@@ -7,36 +7,25 @@ layout(location = 3) in vec3 tangent;
 layout(location = 4) in vec3 bitangent;
 layout(location = 5) in ivec4 boneIds; 
 layout(location = 6) in vec4 weights;
+layout(location = 7) in mat4 instanceModel; // Model::DrawInstanced
 
-uniform mat4 projection;
-uniform mat4 view;
+uniform mat4 viewProjection;
 uniform mat4 model;
+uniform bool instanced;
 
-const int MAX_BONES = 100;
-const int MAX_BONE_INFLUENCE = 4;
-// 이 행렬들을 사용해 애니메이션된 뼈대 변환을 처리
-uniform mat4 finalBonesMatrices[MAX_BONES];
+#include "skinning.glsl"
 
 out vec2 TexCoords;
 
+// same position expression as simpleDepthShader.vs (depth prepass)
+invariant gl_Position;
+
 void main()
 {
-    vec4 totalPosition = vec4(0.0f);
-    for(int i = 0 ; i < MAX_BONE_INFLUENCE ; i++)
-    {
-        if(boneIds[i] == -1) 
-            continue;
-        if(boneIds[i] >=MAX_BONES) 
-        {
-            totalPosition = vec4(pos,1.0f);
-            break;
-        }
-        vec4 localPosition = finalBonesMatrices[boneIds[i]] * vec4(pos,1.0f);
-        totalPosition += localPosition * weights[i];
-        vec3 localNormal = mat3(finalBonesMatrices[boneIds[i]]) * norm;
-   }
-	
-    mat4 viewModel = view * model;
-    gl_Position =  projection * viewModel * totalPosition;
+    mat4 world = skinningWorld(instanced ? instanceModel : model);
+    vec4 totalPosition = skinMatrix(boneIds, weights) * vec4(pos, 1.0);
+
+    vec4 worldPosition = world * totalPosition;
+    gl_Position = viewProjection * worldPosition;
 	TexCoords = tex;
 }
\ No newline at end of file
@@ -0,0 +1,103 @@
+#version 330 core
+// deferred shading: point light volume, added on top of deferred_directional.fs
+out vec4 FragColor;
+
+struct PointLight {
+    vec3 position;
+    float radius;
+    
+    float constant;
+    float linear;
+    float quadratic;
+	
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+struct Material {
+    float shininess;
+};
+
+flat in int lightIndex;
+
+uniform sampler2D gAlbedoSpecular;
+uniform sampler2D gNormal;
+uniform sampler2D gDepth;
+uniform samplerBuffer lightData;
+uniform mat4 inverseViewProjection;
+uniform vec2 screenSize;
+
+uniform vec3 viewPos;
+uniform Material material;
+
+vec3 diffuseColor;
+vec3 specularColor;
+
+vec3 DecodeNormal(vec2 f)
+{
+    f = f * 2.0 - 1.0;
+    vec3 n = vec3(f.x, f.y, 1.0 - abs(f.x) - abs(f.y));
+    float t = clamp(-n.z, 0.0, 1.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
+PointLight FetchPointLight(int index)
+{
+    vec4 positionRadius = texelFetch(lightData, index * 4);
+    vec4 diffuseConstant = texelFetch(lightData, index * 4 + 1);
+    vec4 specularLinear = texelFetch(lightData, index * 4 + 2);
+    vec4 ambientQuadratic = texelFetch(lightData, index * 4 + 3);
+    PointLight light;
+    light.position = positionRadius.xyz;
+    light.radius = positionRadius.w;
+    light.diffuse = diffuseConstant.rgb;
+    light.constant = diffuseConstant.w;
+    light.specular = specularLinear.rgb;
+    light.linear = specularLinear.w;
+    light.ambient = ambientQuadratic.rgb;
+    light.quadratic = ambientQuadratic.w;
+    return light;
+}
+
+// same as lighting.fs
+vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
+{
+    vec3 lightDir = normalize(light.position - fragPos);
+    float diff = max(dot(normal, lightDir), 0.0);
+    vec3 reflectDir = reflect(-lightDir, normal);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
+    float distance = length(light.position - fragPos);
+    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));    
+    float falloff = clamp(1.0 - pow(distance / light.radius, 4.0), 0.0, 1.0);
+    attenuation *= falloff * falloff;
+    vec3 ambient = light.ambient * diffuseColor;
+    vec3 diffuse = light.diffuse * diff * diffuseColor;
+    vec3 specular = light.specular * spec * specularColor;
+    ambient *= attenuation;
+    diffuse *= attenuation;
+    specular *= attenuation;
+    return (ambient + diffuse + specular);
+}
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(gDepth, pixel, 0).r;
+    if (depth >= 1.0)
+        discard;
+
+    vec4 clip = inverseViewProjection * vec4(vec3(gl_FragCoord.xy / screenSize, depth) * 2.0 - 1.0, 1.0);
+    vec3 fragPos = clip.xyz / clip.w;
+    PointLight light = FetchPointLight(lightIndex);
+    if (distance(fragPos, light.position) >= light.radius)
+        discard;
+
+    vec4 albedoSpecular = texelFetch(gAlbedoSpecular, pixel, 0);
+    diffuseColor = albedoSpecular.rgb;
+    specularColor = vec3(albedoSpecular.a);
+    vec3 norm = DecodeNormal(texelFetch(gNormal, pixel, 0).rg);
+    FragColor = vec4(CalcPointLight(light, norm, fragPos, normalize(viewPos - fragPos)), 1.0);
+}
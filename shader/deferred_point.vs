@@ -0,0 +1,15 @@
+#version 330 core
+// deferred shading: one bounding sphere per visible point light (instanced), lights from LightClusters
+layout (location = 0) in vec3 aPos;
+
+uniform samplerBuffer lightData;    // 4 texels per light, position / radius first
+uniform mat4 viewProjection;
+
+flat out int lightIndex;
+
+void main()
+{
+    vec4 positionRadius = texelFetch(lightData, gl_InstanceID * 4);
+    lightIndex = gl_InstanceID;
+    gl_Position = viewProjection * vec4(positionRadius.xyz + aPos * positionRadius.w, 1.0);
+}
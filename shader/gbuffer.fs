@@ -0,0 +1,37 @@
+#version 330 core
+// deferred shading G-buffer: lighting.vs geometry, lighting.fs materials
+layout (location = 0) out vec4 albedoSpecular;   // RGBA8: diffuse map rgb, specular map intensity
+layout (location = 1) out vec2 octNormal;        // RG16: octahedral world space normal
+
+struct Material {
+    sampler2D diffuse;
+    sampler2D specular;
+    sampler2D emission;
+    float shininess;
+};
+
+in vec3 FragPos;
+in vec3 Normal;
+in vec2 TexCoords;
+
+uniform Material material;
+
+vec2 OctWrap(vec2 v)
+{
+    return (1.0 - abs(v.yx)) * vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+// unit vector -> [0,1]^2 (octahedron unfolded onto a square)
+vec2 EncodeNormal(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    n.xy = n.z >= 0.0 ? n.xy : OctWrap(n.xy);
+    return n.xy * 0.5 + 0.5;
+}
+
+void main()
+{
+    vec3 specular = texture(material.specular, TexCoords).rgb;
+    albedoSpecular = vec4(texture(material.diffuse, TexCoords).rgb, dot(specular, vec3(1.0 / 3.0)));
+    octNormal = EncodeNormal(normalize(Normal));
+}
@@ -0,0 +1,27 @@
+#version 330 core
+// Hi-Z reduction: every texel keeps the farthest depth of the source texels it covers.
+// source is the occluder depth (level 0, copied) or the previous pyramid level, set as the
+// texture's only visible level so lod 0 reads it.
+layout (location = 0) out float farthestDepth;
+
+uniform sampler2D source;
+uniform bool reduce;
+
+void main()
+{
+    ivec2 coord = ivec2(gl_FragCoord.xy);
+    if (!reduce) {
+        farthestDepth = texelFetch(source, coord, 0).r;
+        return;
+    }
+
+    ivec2 size = textureSize(source, 0);
+    ivec2 base = coord * 2;
+    // odd source size: the last texel of a row / column also covers the leftover one
+    ivec2 extent = ivec2(base.x + 3 == size.x ? 3 : 2, base.y + 3 == size.y ? 3 : 2);
+    float depth = 0.0;
+    for (int y = 0; y < extent.y; ++y)
+        for (int x = 0; x < extent.x; ++x)
+            depth = max(depth, texelFetch(source, min(base + ivec2(x, y), size - 1), 0).r);
+    farthestDepth = depth;
+}
@@ -18,6 +18,7 @@ struct DirLight {
 
 struct PointLight {
     vec3 position;
+    float radius;   // attenuation is faded to 0 here (LightClusters culls at it)
     
     float constant;
     float linear;
@@ -51,31 +52,83 @@ uniform vec3 viewPos;
 uniform Material material;
 
 uniform DirLight dirLight;
-#define NR_POINT_LIGHTS 4
-uniform PointLight pointLights[NR_POINT_LIGHTS];
 uniform SpotLight spotLight;
 
+// clustered point lights (LightClusters); the grid size is injected from LightClusters::kGrid*
+#ifndef CLUSTER_X
+#define CLUSTER_X 16
+#define CLUSTER_Y 9
+#define CLUSTER_Z 24
+#endif
+uniform samplerBuffer lightData;      // 4 texels per light
+uniform usamplerBuffer clusterGrid;   // first index, light count
+uniform usamplerBuffer lightIndices;
+uniform vec2 clusterTileSize;         // pixels
+uniform float clusterNear;
+uniform float clusterFar;
+
+// material samples, fetched once per fragment instead of once per light
+vec3 diffuseColor;
+vec3 specularColor;
+
 // function prototypes
 vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir);
 vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
 vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
+int ClusterIndex();
+PointLight FetchPointLight(int index);
 
 void main()
 {    
     vec3 norm = normalize(Normal);
     vec3 viewDir = normalize(viewPos - FragPos);
+    diffuseColor = texture(material.diffuse, TexCoords).rgb;
+    specularColor = texture(material.specular, TexCoords).rgb;
 
     // phase 1: directional lighting
     vec3 result = CalcDirLight(dirLight, norm, viewDir);
-    // phase 2: point lights
-    for (int i = 0; i < NR_POINT_LIGHTS; i++)
-        result += CalcPointLight(pointLights[i], norm, FragPos, viewDir);    
+    // phase 2: point lights of this fragment's cluster
+    uvec2 cluster = texelFetch(clusterGrid, ClusterIndex()).rg;
+    for (uint i = 0u; i < cluster.y; i++)
+    {
+        int light = int(texelFetch(lightIndices, int(cluster.x + i)).r);
+        result += CalcPointLight(FetchPointLight(light), norm, FragPos, viewDir);
+    }
     // phase 3: spot light
     result += CalcSpotLight(spotLight, norm, FragPos, viewDir); 
  
     FragColor = vec4(result, 1.0);
 }
 
+// screen tile from the pixel, exponential depth slice from the view depth
+int ClusterIndex()
+{
+    ivec2 tile = min(ivec2(gl_FragCoord.xy / clusterTileSize), ivec2(CLUSTER_X - 1, CLUSTER_Y - 1));
+    float ndcDepth = gl_FragCoord.z * 2.0 - 1.0;
+    float viewDepth = 2.0 * clusterNear * clusterFar / (clusterFar + clusterNear - ndcDepth * (clusterFar - clusterNear));
+    int slice = int(log(viewDepth / clusterNear) * float(CLUSTER_Z) / log(clusterFar / clusterNear));
+    slice = clamp(slice, 0, CLUSTER_Z - 1);
+    return (slice * CLUSTER_Y + tile.y) * CLUSTER_X + tile.x;
+}
+
+PointLight FetchPointLight(int index)
+{
+    vec4 positionRadius = texelFetch(lightData, index * 4);
+    vec4 diffuseConstant = texelFetch(lightData, index * 4 + 1);
+    vec4 specularLinear = texelFetch(lightData, index * 4 + 2);
+    vec4 ambientQuadratic = texelFetch(lightData, index * 4 + 3);
+    PointLight light;
+    light.position = positionRadius.xyz;
+    light.radius = positionRadius.w;
+    light.diffuse = diffuseConstant.rgb;
+    light.constant = diffuseConstant.w;
+    light.specular = specularLinear.rgb;
+    light.linear = specularLinear.w;
+    light.ambient = ambientQuadratic.rgb;
+    light.quadratic = ambientQuadratic.w;
+    return light;
+}
+
 // calculates the color when using a directional light.
 vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
 {
@@ -86,9 +139,9 @@ vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
     vec3 reflectDir = reflect(-lightDir, normal);
     float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
     // combine results
-    vec3 ambient = light.ambient * texture(material.diffuse, TexCoords).rgb;
-    vec3 diffuse = light.diffuse * diff * texture(material.diffuse, TexCoords).rgb;
-    vec3 specular = light.specular * spec * texture(material.specular, TexCoords).rgb;
+    vec3 ambient = light.ambient * diffuseColor;
+    vec3 diffuse = light.diffuse * diff * diffuseColor;
+    vec3 specular = light.specular * spec * specularColor;
     return (ambient + diffuse + specular);
 }
 
@@ -104,10 +157,13 @@ vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
     // attenuation
     float distance = length(light.position - fragPos);
     float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));    
+    // smooth window to 0 at the cluster culling radius
+    float falloff = clamp(1.0 - pow(distance / light.radius, 4.0), 0.0, 1.0);
+    attenuation *= falloff * falloff;
     // combine results
-    vec3 ambient = light.ambient * texture(material.diffuse, TexCoords).rgb;
-    vec3 diffuse = light.diffuse * diff * texture(material.diffuse, TexCoords).rgb;
-    vec3 specular = light.specular * spec * texture(material.specular, TexCoords).rgb;
+    vec3 ambient = light.ambient * diffuseColor;
+    vec3 diffuse = light.diffuse * diff * diffuseColor;
+    vec3 specular = light.specular * spec * specularColor;
     ambient *= attenuation;
     diffuse *= attenuation;
     specular *= attenuation;
@@ -131,9 +187,9 @@ vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
     float epsilon = light.cutOff - light.outerCutOff;
     float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);
     // combine results
-    vec3 ambient = light.ambient * texture(material.diffuse, TexCoords).rgb;
-    vec3 diffuse = light.diffuse * diff * texture(material.diffuse, TexCoords).rgb;
-    vec3 specular = light.specular * spec * texture(material.specular, TexCoords).rgb;
+    vec3 ambient = light.ambient * diffuseColor;
+    vec3 diffuse = light.diffuse * diff * diffuseColor;
+    vec3 specular = light.specular * spec * specularColor;
     ambient *= attenuation * intensity;
     diffuse *= attenuation * intensity;
     specular *= attenuation * intensity;
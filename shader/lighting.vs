@@ -2,20 +2,26 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+layout (location = 7) in mat4 aInstanceModel; // Model::DrawInstanced
 
 out vec3 FragPos; // 지금까지 사용했던 World space상에서의 좌표
 out vec3 Normal;
 out vec2 TexCoords;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+uniform mat4 viewProjection;
+uniform bool instanced;
+
+// same position expression as simpleDepthShader.vs (depth prepass)
+invariant gl_Position;
 
 void main()
 {
-    FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = mat3(transpose(inverse(model))) * aNormal;  
+    mat4 world = instanced ? aInstanceModel : model;
+    vec4 worldPosition = world * vec4(aPos, 1.0);
+    FragPos = vec3(worldPosition);
+    Normal = mat3(transpose(inverse(world))) * aNormal;  
     TexCoords = aTexCoords;
     
-    gl_Position = projection * view * vec4(FragPos, 1.0);
+    gl_Position = viewProjection * worldPosition;
 }
\ No newline at end of file
@@ -1,12 +1,21 @@
 #version 330 core
 out vec4 FragColor;
 
+// 0: lit with the vertex normal, the normal map is not sampled
+#ifndef NORMAL_MAPPING
+#define NORMAL_MAPPING 1
+#endif
+
 in VS_OUT {
     vec3 FragPos;
     vec2 TexCoords;
+#if NORMAL_MAPPING
     vec3 TangentLightPos;
     vec3 TangentViewPos;
     vec3 TangentFragPos;
+#else
+    vec3 Normal;
+#endif
 } fs_in;
 
 uniform sampler2D diffuseMap;
@@ -17,21 +26,28 @@ uniform vec3 viewPos;
 
 void main()
 {           
+#if NORMAL_MAPPING
      // obtain normal from normal map in range [0,1]
     vec3 normal = texture(normalMap, fs_in.TexCoords).rgb;
     // transform normal vector to range [-1,1]
     normal = normalize(normal * 2.0 - 1.0);  // this normal is in tangent space
+    vec3 lightDir = normalize(fs_in.TangentLightPos - fs_in.TangentFragPos);
+    vec3 viewDir = normalize(fs_in.TangentViewPos - fs_in.TangentFragPos);
+#else
+    // world space
+    vec3 normal = normalize(fs_in.Normal);
+    vec3 lightDir = normalize(lightPos - fs_in.FragPos);
+    vec3 viewDir = normalize(viewPos - fs_in.FragPos);
+#endif
    
     // get diffuse color
     vec3 color = texture(diffuseMap, fs_in.TexCoords).rgb;
     // ambient
     vec3 ambient = 0.1 * color;
     // diffuse
-    vec3 lightDir = normalize(fs_in.TangentLightPos - fs_in.TangentFragPos);
     float diff = max(dot(lightDir, normal), 0.0);
     vec3 diffuse = diff * color;
     // specular
-    vec3 viewDir = normalize(fs_in.TangentViewPos - fs_in.TangentFragPos);
     vec3 reflectDir = reflect(-lightDir, normal);
     vec3 halfwayDir = normalize(lightDir + viewDir);  
     float spec = pow(max(dot(normal, halfwayDir), 0.0), 32.0);
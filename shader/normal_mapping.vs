@@ -4,28 +4,44 @@ layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
 layout (location = 3) in vec3 aTangent;
 layout (location = 4) in vec3 aBitangent;
+layout (location = 7) in mat4 aInstanceModel; // render queue batches
+
+// 0: plain vertex normals, no tangent frame (see normal_mapping.fs)
+#ifndef NORMAL_MAPPING
+#define NORMAL_MAPPING 1
+#endif
 
 out VS_OUT {
     vec3 FragPos;
     vec2 TexCoords;
+#if NORMAL_MAPPING
     vec3 TangentLightPos;
     vec3 TangentViewPos;
     vec3 TangentFragPos;
+#else
+    vec3 Normal;
+#endif
 } vs_out;
 
-uniform mat4 projection;
-uniform mat4 view;
+uniform mat4 viewProjection;
 uniform mat4 model;
+uniform bool instanced;
 
 uniform vec3 lightPos;
 uniform vec3 viewPos;
 
+// same position expression as simpleDepthShader.vs (depth prepass)
+invariant gl_Position;
+
 void main()
 {
-    vs_out.FragPos = vec3(model * vec4(aPos, 1.0));   
+    mat4 world = instanced ? aInstanceModel : model;
+    vec4 worldPosition = world * vec4(aPos, 1.0);
+    vs_out.FragPos = vec3(worldPosition);
     vs_out.TexCoords = aTexCoords;
     
-    mat3 normalMatrix = transpose(inverse(mat3(model)));
+    mat3 normalMatrix = transpose(inverse(mat3(world)));
+#if NORMAL_MAPPING
     vec3 T = normalize(normalMatrix * aTangent);
     vec3 N = normalize(normalMatrix * aNormal);
     T = normalize(T - dot(T, N) * N);
@@ -35,6 +51,9 @@ void main()
     vs_out.TangentLightPos = TBN * lightPos;
     vs_out.TangentViewPos  = TBN * viewPos;
     vs_out.TangentFragPos  = TBN * vs_out.FragPos;
+#else
+    vs_out.Normal = normalMatrix * aNormal;
+#endif
         
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    gl_Position = viewProjection * worldPosition;
 }
\ No newline at end of file
@@ -5,53 +5,96 @@ in VS_OUT {
     vec3 FragPos;
     vec3 Normal;
     vec2 TexCoords;
-    vec4 FragPosLightSpace;
 } fs_in;
 
+// cascaded shadow map, see CascadedShadowMap
+const int CASCADE_COUNT = 4;
+
+// filter kernel, injected per shadow quality level (a ShaderLibrary variant picked by SelectShaderVariants):
+//   0: 1 tap  - one hardware 2x2 bilinear PCF
+//   1: 4 taps - 3x3 texel tent
+//   2: 9 taps - 4x4 texel footprint
+//   3: 8 tap rotated Poisson-like disc, wide soft edges
+#ifndef SHADOW_FILTER
+#define SHADOW_FILTER 1
+#endif
+
 uniform sampler2D diffuseTexture;
-uniform sampler2D shadowMap;
+uniform sampler2DArrayShadow shadowMap;     // depth compare + linear filtering in the sampler
+uniform mat4 lightSpaceMatrices[CASCADE_COUNT];
+uniform float cascadeSplits[CASCADE_COUNT];     // far view depth of each cascade
+uniform float cascadeTexelDepth[CASCADE_COUNT]; // one shadow texel in depth units
+uniform mat4 view;
+uniform bool showCascades;
 
 uniform vec3 lightPos;
 uniform vec3 viewPos;
 
-float ShadowCalculation(vec4 fragPosLightSpace)
+// first cascade whose slice holds the fragment, CASCADE_COUNT past the last one
+int SelectCascade()
+{
+    float viewDepth = -(view * vec4(fs_in.FragPos, 1.0)).z;
+    for (int i = 0; i < CASCADE_COUNT; ++i)
+    {
+        if (viewDepth < cascadeSplits[i])
+            return i;
+    }
+    return CASCADE_COUNT;
+}
+
+// fraction of a bilinear 2x2 footprint that is lit
+float ShadowTap(vec2 uv, float layer, float depth)
+{
+    return texture(shadowMap, vec4(uv, layer, depth));
+}
+
+float ShadowCalculation(int cascade)
 {
+    if (cascade >= CASCADE_COUNT)
+        return 0.0;
+
     // 1. 투영 나눗셈(Perspective Divide)
+    vec4 fragPosLightSpace = lightSpaceMatrices[cascade] * vec4(fs_in.FragPos, 1.0);
     vec3 projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
     projCoords = projCoords * 0.5 + 0.5; // NDC 좌표를 [0, 1] 범위로 변환
+    if(projCoords.z > 1.0)
+        return 0.0;
 
-    // 2. 깊이 맵에서 가장 가까운 깊이 값 샘플링
-    float closestDepth = texture(shadowMap, projCoords.xy).r;
-
-    // 3. 현재 깊이 계산
-    float currentDepth = projCoords.z;
-
-    // calculate bias (based on depth map resolution and slope)
+    // 2. calculate bias (in texels of this cascade, more on slopes facing away from the light)
     vec3 normal = normalize(fs_in.Normal);
     vec3 lightDir = normalize(lightPos - fs_in.FragPos);
-    float bias = max(0.05 * (1.0 - dot(normal, lightDir)), 0.005);
-    // 4. 그림자 비교
-    // float shadow = currentDepth > closestDepth ? 1.0 : 0.0;
-    // float shadow = currentDepth - bias > closestDepth ? 1.0 : 0.0;
-    // check whether current frag pos is in shadow
-    // float shadow = currentDepth - bias > closestDepth  ? 1.0 : 0.0;
-    // PCF
-    float shadow = 0.0;
-    vec2 texelSize = 1.0 / textureSize(shadowMap, 0);
-    for(int x = -1; x <= 1; ++x)
+    float bias = cascadeTexelDepth[cascade] * (1.5 + 2.0 * (1.0 - max(dot(normal, lightDir), 0.0)));
+    float depth = projCoords.z - bias;
+    float layer = float(cascade);
+
+    // 3. PCF, every tap is already a 2x2 compare in hardware
+    vec2 texelSize = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+    float lit = 0.0;
+#if SHADOW_FILTER == 0
+    lit = ShadowTap(projCoords.xy, layer, depth);
+#elif SHADOW_FILTER == 1
+    for (int x = 0; x < 2; ++x)
+        for (int y = 0; y < 2; ++y)
+            lit += ShadowTap(projCoords.xy + (vec2(x, y) - 0.5) * texelSize, layer, depth);
+    lit *= 0.25;
+#elif SHADOW_FILTER == 2
+    for (int x = -1; x <= 1; ++x)
+        for (int y = -1; y <= 1; ++y)
+            lit += ShadowTap(projCoords.xy + vec2(x, y) * texelSize, layer, depth);
+    lit /= 9.0;
+#else
+    // 8 point disc (golden angle spiral), rotated per pixel with interleaved gradient noise:
+    // banding turns into fine noise
+    float angle = 6.2831853 * fract(52.9829189 * fract(dot(gl_FragCoord.xy, vec2(0.06711056, 0.00583715))));
+    for (int i = 0; i < 8; ++i)
     {
-        for(int y = -1; y <= 1; ++y)
-        {
-            float pcfDepth = texture(shadowMap, projCoords.xy + vec2(x, y) * texelSize).r;
-            shadow += currentDepth - bias > pcfDepth  ? 1.0 : 0.0;
-        }
+        float theta = float(i) * 2.3999632 + angle;
+        vec2 offset = sqrt((float(i) + 0.5) / 8.0) * vec2(cos(theta), sin(theta));
+        lit += ShadowTap(projCoords.xy + offset * 2.0 * texelSize, layer, depth);
     }
-    shadow /= 9.0;
-
-    if(projCoords.z > 1.0)
-        shadow = 0.0;
-
-    return shadow;
+    lit *= 0.125;
+#endif
+    return 1.0 - lit;
 }
 
 void main()
@@ -72,8 +115,14 @@ void main()
     spec = pow(max(dot(normal, halfwayDir), 0.0), 64.0);
     vec3 specular = spec * lightColor;
     // calculate shadow
-    float shadow = ShadowCalculation(fs_in.FragPosLightSpace);
+    int cascade = SelectCascade();
+    float shadow = ShadowCalculation(cascade);
     vec3 lighting = (ambient + (1.0 - shadow) * (diffuse + specular)) * color;
+    if (showCascades && cascade < CASCADE_COUNT)
+    {
+        const vec3 tints[CASCADE_COUNT] = vec3[](vec3(1.0, 0.4, 0.4), vec3(0.4, 1.0, 0.4), vec3(0.4, 0.4, 1.0), vec3(1.0, 1.0, 0.4));
+        lighting *= tints[cascade];
+    }
 
     FragColor = vec4(lighting, 1.0);
 }
\ No newline at end of file
@@ -2,24 +2,27 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+layout (location = 7) in mat4 aInstanceModel; // render queue batches
 
 out VS_OUT {
     vec3 FragPos;
     vec3 Normal;
     vec2 TexCoords;
-    vec4 FragPosLightSpace;
 } vs_out;
 
-uniform mat4 projection;
-uniform mat4 view;
+uniform mat4 viewProjection;
 uniform mat4 model;
-uniform mat4 lightSpaceMatrix;
+uniform bool instanced;
+
+// same position expression as simpleDepthShader.vs (depth prepass)
+invariant gl_Position;
 
 void main()
 {    
-    vs_out.FragPos = vec3(model * vec4(aPos, 1.0));
-    vs_out.Normal = transpose(inverse(mat3(model))) * aNormal;
+    mat4 world = instanced ? aInstanceModel : model;
+    vec4 worldPosition = world * vec4(aPos, 1.0);
+    vs_out.FragPos = vec3(worldPosition);
+    vs_out.Normal = transpose(inverse(mat3(world))) * aNormal;
     vs_out.TexCoords = aTexCoords;
-    vs_out.FragPosLightSpace = lightSpaceMatrix * vec4(vs_out.FragPos, 1.0);
-    gl_Position = projection * view * vec4(vs_out.FragPos, 1.0);
+    gl_Position = viewProjection * worldPosition;
 }
\ No newline at end of file
@@ -1,21 +1,25 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
-layout (location = 3) in ivec4 boneIds;
-layout (location = 4) in vec4 weights;
+layout (location = 5) in ivec4 boneIds;
+layout (location = 6) in vec4 weights;
+layout (location = 7) in mat4 instanceModel; // Model::DrawDepthInstanced
 
+// 그림자 pass: 광원 행렬, occluder / depth prepass: 카메라 viewProjection
 uniform mat4 lightSpaceMatrix;
 uniform mat4 model;
-const int MAX_BONE_INFLUENCE = 4;
-uniform mat4 finalBonesMatrices[100];
+uniform bool instanced;
+
+#include "skinning.glsl"
+
+// the depth prepass must produce exactly the depth of the lit pass (GL_EQUAL),
+// so every main pass shader computes gl_Position with the same expression
+invariant gl_Position;
 
 void main()
 {
-    vec4 totalPosition = vec4(0.0);
-    for (int i = 0; i < MAX_BONE_INFLUENCE; ++i) {
-        if (boneIds[i] == -1) continue; // 유효하지 않은 본 ID 무시
-        totalPosition += finalBonesMatrices[boneIds[i]] * vec4(aPos, 1.0) * weights[i];
-    }
-    
-    gl_Position = lightSpaceMatrix * totalPosition; // 광원 공간에서의 위치
-    // gl_Position = lightSpaceMatrix * model * vec4(aPos, 1.0);
+    mat4 world = skinningWorld(instanced ? instanceModel : model);
+    vec4 totalPosition = skinMatrix(boneIds, weights) * vec4(aPos, 1.0);
+
+    vec4 worldPosition = world * totalPosition;
+    gl_Position = lightSpaceMatrix * worldPosition; // 광원 공간에서의 위치
 } 
\ No newline at end of file
@@ -0,0 +1,86 @@
+// Bone blending shared by every skinning shader (anim_model.vs, simpleDepthShader.vs,
+// skinning_feedback.vs), pulled in with #include "skinning.glsl" by Shader.
+// One copy keeps the depth prepass (GL_EQUAL, invariant gl_Position) and the lit pass on the
+// same expression, and matches CpuSkinning::sanitize on the CPU path.
+
+// 0: static geometry, the bone palette is never read
+#ifndef SKINNING
+#define SKINNING 1
+#endif
+
+const int MAX_BONES = 100;
+const int MAX_BONE_INFLUENCE = 4;
+// 이 행렬들을 사용해 애니메이션된 뼈대 변환을 처리
+uniform mat4 finalBonesMatrices[MAX_BONES];
+
+// BAKED_ANIMATION 1: the bones come from the BakedAnimation texture instead of finalBonesMatrices,
+// the instance matrix's last row carries (clip, time offset, play rate) (crowd instances)
+#ifndef BAKED_ANIMATION
+#define BAKED_ANIMATION 0
+#endif
+#if BAKED_ANIMATION
+const int MAX_BAKED_CLIPS = 8;
+uniform sampler2D bakedBones;
+uniform int bakedClipFirstFrame[MAX_BAKED_CLIPS];
+uniform int bakedClipFrameCount[MAX_BAKED_CLIPS];
+uniform float bakedFrameRate;
+uniform float bakedTime;
+int bakedRow0, bakedRow1;   // texture rows of the two frames blended
+float bakedBlend;
+
+void selectBakedFrames(vec3 playback)
+{
+    int clip = clamp(int(playback.x), 0, MAX_BAKED_CLIPS - 1);
+    int frameCount = bakedClipFrameCount[clip];
+    float frame = mod((bakedTime * playback.z + playback.y) * bakedFrameRate, float(frameCount));
+    int frame0 = min(int(frame), frameCount - 1);
+    bakedRow0 = bakedClipFirstFrame[clip] + frame0;
+    bakedRow1 = bakedClipFirstFrame[clip] + (frame0 + 1 == frameCount ? 0 : frame0 + 1);
+    bakedBlend = frame - float(frame0);
+}
+
+// 3 texels per bone: the rows of the 3x4 matrix
+mat4 bakedBone(int bone)
+{
+    vec4 r0 = mix(texelFetch(bakedBones, ivec2(bone * 3, bakedRow0), 0), texelFetch(bakedBones, ivec2(bone * 3, bakedRow1), 0), bakedBlend);
+    vec4 r1 = mix(texelFetch(bakedBones, ivec2(bone * 3 + 1, bakedRow0), 0), texelFetch(bakedBones, ivec2(bone * 3 + 1, bakedRow1), 0), bakedBlend);
+    vec4 r2 = mix(texelFetch(bakedBones, ivec2(bone * 3 + 2, bakedRow0), 0), texelFetch(bakedBones, ivec2(bone * 3 + 2, bakedRow1), 0), bakedBlend);
+    return transpose(mat4(r0, r1, r2, vec4(0.0, 0.0, 0.0, 1.0)));
+}
+#define BONE_MATRIX(id) bakedBone(id)
+#else
+#define BONE_MATRIX(id) finalBonesMatrices[id]
+#endif
+
+// object to world matrix of the vertex; BAKED_ANIMATION takes the playback out of its last row
+mat4 skinningWorld(mat4 world)
+{
+#if BAKED_ANIMATION
+    selectBakedFrames(vec3(world[0][3], world[1][3], world[2][3]));
+    world[0][3] = 0.0;
+    world[1][3] = 0.0;
+    world[2][3] = 0.0;
+#endif
+    return world;
+}
+
+// weighted sum of the vertex's bone matrices. bone slots with id -1 or weight 0 are unused;
+// a vertex with no used slot, or with any id past the palette, stays in its bind pose
+mat4 skinMatrix(ivec4 boneIds, vec4 weights)
+{
+#if SKINNING
+    mat4 skin = mat4(0.0);
+    bool any = false;
+    for (int i = 0; i < MAX_BONE_INFLUENCE; ++i) {
+        if (boneIds[i] >= MAX_BONES)
+            return mat4(1.0);
+        if (boneIds[i] < 0 || weights[i] == 0.0)
+            continue; // 유효하지 않은 본 ID 무시
+        skin += BONE_MATRIX(boneIds[i]) * weights[i];
+        any = true;
+    }
+    return any ? skin : mat4(1.0);
+#else
+    return mat4(1.0);
+#endif
+}
@@ -0,0 +1,6 @@
+#version 330 core
+
+// never runs: the skinning pass draws with GL_RASTERIZER_DISCARD
+void main()
+{
+}
@@ -0,0 +1,22 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 5) in ivec4 boneIds;
+layout (location = 6) in vec4 weights;
+
+// one point per vertex, captured by transform feedback (SkinningCache)
+#include "skinning.glsl"
+
+out vec3 skinnedPosition;
+out vec3 skinnedNormal;
+
+void main()
+{
+    // the same blend as anim_model.vs / simpleDepthShader.vs
+    mat4 skin = skinMatrix(boneIds, weights);
+    vec4 totalPosition = skin * vec4(aPos, 1.0);
+    vec3 totalNormal = mat3(skin) * aNormal;
+
+    skinnedPosition = totalPosition.xyz;
+    skinnedNormal = dot(totalNormal, totalNormal) > 0.0 ? normalize(totalNormal) : totalNormal;
+}
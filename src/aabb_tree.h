@@ -0,0 +1,416 @@
+#ifndef AABB_TREE_H
+#define AABB_TREE_H
+
+#include <glm/glm.hpp>
+
+#include "bounds.h"
+#include "frustum.h"
+
+#include <algorithm>
+#include <vector>
+
+// Dynamic AABB tree (after Box2D's b2DynamicTree), in 3D.
+// Leaves hold "fat" boxes - the object box grown by a margin - so an object that moves a little
+// stays inside its leaf and costs nothing; only when it escapes is the leaf removed and
+// reinserted, which refits and rebalances just the path to the root.
+// Insertion picks the sibling by the surface area heuristic, AVL-style rotations keep the tree
+// balanced, so queries visit O(log n) nodes plus the results.
+class AABBTree
+{
+public:
+    static const int kNull = -1;
+
+    explicit AABBTree(float margin = 0.1f) : margin(margin) {}
+
+    int CreateProxy(const AABB& box, int userData)
+    {
+        int proxy = allocateNode();
+        nodes[proxy].box = fatten(box);
+        nodes[proxy].userData = userData;
+        nodes[proxy].height = 0;
+        insertLeaf(proxy);
+        proxyCount++;
+        return proxy;
+    }
+
+    void DestroyProxy(int proxy)
+    {
+        removeLeaf(proxy);
+        freeNode(proxy);
+        proxyCount--;
+    }
+
+    // returns true when the proxy had to be reinserted
+    bool MoveProxy(int proxy, const AABB& box)
+    {
+        if (contains(nodes[proxy].box, box))
+            return false;
+        removeLeaf(proxy);
+        nodes[proxy].box = fatten(box);
+        insertLeaf(proxy);
+        return true;
+    }
+
+    int UserData(int proxy) const { return nodes[proxy].userData; }
+    const AABB& FatAABB(int proxy) const { return nodes[proxy].box; }
+    int Height() const { return root == kNull ? 0 : nodes[root].height; }
+    // (fat) box around every proxy, invalid when empty
+    AABB RootBounds() const { return root == kNull ? AABB() : nodes[root].box; }
+    size_t ProxyCount() const { return proxyCount; }
+
+    // calls callback(userData) for every leaf whose fat box intersects the frustum.
+    // subtrees entirely inside are reported without testing their descendants.
+    template <typename Callback>
+    void QueryFrustum(const Frustum& frustum, Callback callback) const
+    {
+        if (root == kNull)
+            return;
+        stack.clear();
+        stack.push_back(root);
+        while (!stack.empty())
+        {
+            int index = stack.back();
+            stack.pop_back();
+            const Node& node = nodes[index];
+            FrustumResult result = frustum.ClassifyBox(node.box.Center(), node.box.Extents());
+            if (result == FRUSTUM_OUTSIDE)
+                continue;
+            if (result == FRUSTUM_INSIDE)
+            {
+                reportSubtree(index, callback);
+                continue;
+            }
+            if (node.IsLeaf())
+            {
+                callback(node.userData);
+                continue;
+            }
+            stack.push_back(node.child1);
+            stack.push_back(node.child2);
+        }
+    }
+
+    // calls callback(userData) for every leaf whose fat box touches the sphere
+    template <typename Callback>
+    void QuerySphere(const glm::vec3& center, float radius, Callback callback) const
+    {
+        if (root == kNull)
+            return;
+        float radius2 = radius * radius;
+        stack.clear();
+        stack.push_back(root);
+        while (!stack.empty())
+        {
+            const Node& node = nodes[stack.back()];
+            stack.pop_back();
+            glm::vec3 closest = glm::clamp(center, node.box.min, node.box.max);
+            glm::vec3 d = closest - center;
+            if (glm::dot(d, d) > radius2)
+                continue;
+            if (node.IsLeaf())
+            {
+                callback(node.userData);
+                continue;
+            }
+            stack.push_back(node.child1);
+            stack.push_back(node.child2);
+        }
+    }
+
+    // walks the leaves hit by the ray in no particular order. callback(userData, maxDistance)
+    // returns the new max distance (the distance of a closer hit, or maxDistance to keep it),
+    // nodes beyond it are skipped.
+    template <typename Callback>
+    void RayCast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, Callback callback) const
+    {
+        if (root == kNull)
+            return;
+        glm::vec3 invDirection = 1.0f / direction;
+        stack.clear();
+        stack.push_back(root);
+        while (!stack.empty())
+        {
+            const Node& node = nodes[stack.back()];
+            stack.pop_back();
+            float distance;
+            if (!RayBox(origin, invDirection, node.box, maxDistance, distance))
+                continue;
+            if (node.IsLeaf())
+            {
+                maxDistance = callback(node.userData, maxDistance);
+                continue;
+            }
+            stack.push_back(node.child1);
+            stack.push_back(node.child2);
+        }
+    }
+
+    // slab test; distance is where the ray enters the box (0 when it starts inside)
+    static bool RayBox(const glm::vec3& origin, const glm::vec3& invDirection, const AABB& box, float maxDistance, float& distance)
+    {
+        glm::vec3 t0 = (box.min - origin) * invDirection;
+        glm::vec3 t1 = (box.max - origin) * invDirection;
+        glm::vec3 tNear = glm::min(t0, t1);
+        glm::vec3 tFar = glm::max(t0, t1);
+        float enter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+        float exit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, maxDistance));
+        distance = enter;
+        return enter <= exit;
+    }
+
+private:
+    struct Node {
+        AABB box;
+        int parent = kNull;     // next free node while on the free list
+        int child1 = kNull;
+        int child2 = kNull;
+        int height = -1;        // leaf = 0, free = -1
+        int userData = -1;
+
+        bool IsLeaf() const { return child1 == kNull; }
+    };
+
+    std::vector<Node> nodes;
+    int root = kNull;
+    int freeList = kNull;
+    size_t proxyCount = 0;
+    float margin;
+    mutable std::vector<int> stack;
+
+    AABB fatten(const AABB& box) const
+    {
+        AABB fat = box;
+        fat.min -= glm::vec3(margin);
+        fat.max += glm::vec3(margin);
+        return fat;
+    }
+
+    static bool contains(const AABB& outer, const AABB& inner)
+    {
+        return outer.min.x <= inner.min.x && outer.min.y <= inner.min.y && outer.min.z <= inner.min.z
+            && inner.max.x <= outer.max.x && inner.max.y <= outer.max.y && inner.max.z <= outer.max.z;
+    }
+
+    static AABB combine(const AABB& a, const AABB& b)
+    {
+        AABB result = a;
+        result.Expand(b);
+        return result;
+    }
+
+    static float area(const AABB& box)
+    {
+        glm::vec3 d = box.max - box.min;
+        return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+    }
+
+    template <typename Callback>
+    void reportSubtree(int index, Callback& callback) const
+    {
+        size_t base = stack.size();
+        stack.push_back(index);
+        while (stack.size() > base)
+        {
+            const Node& node = nodes[stack.back()];
+            stack.pop_back();
+            if (node.IsLeaf())
+            {
+                callback(node.userData);
+                continue;
+            }
+            stack.push_back(node.child1);
+            stack.push_back(node.child2);
+        }
+    }
+
+    int allocateNode()
+    {
+        int index;
+        if (freeList != kNull)
+        {
+            index = freeList;
+            freeList = nodes[index].parent;
+            nodes[index] = Node();
+        }
+        else
+        {
+            index = (int)nodes.size();
+            nodes.push_back(Node());
+        }
+        return index;
+    }
+
+    void freeNode(int index)
+    {
+        nodes[index].parent = freeList;
+        nodes[index].height = -1;
+        freeList = index;
+    }
+
+    void insertLeaf(int leaf)
+    {
+        if (root == kNull)
+        {
+            root = leaf;
+            nodes[root].parent = kNull;
+            return;
+        }
+
+        // find the best sibling: cost of the new parent plus the growth of every ancestor
+        AABB leafBox = nodes[leaf].box;
+        int index = root;
+        while (!nodes[index].IsLeaf())
+        {
+            const Node& node = nodes[index];
+            float nodeArea = area(node.box);
+            float combinedArea = area(combine(node.box, leafBox));
+            float cost = 2.0f * combinedArea;
+            float inheritanceCost = 2.0f * (combinedArea - nodeArea);
+            float cost1 = childCost(node.child1, leafBox) + inheritanceCost;
+            float cost2 = childCost(node.child2, leafBox) + inheritanceCost;
+            if (cost < cost1 && cost < cost2)
+                break;
+            index = cost1 < cost2 ? node.child1 : node.child2;
+        }
+
+        int sibling = index;
+        int newParent = allocateNode();
+        int oldParent = nodes[sibling].parent;
+        nodes[newParent].parent = oldParent;
+        nodes[newParent].box = combine(leafBox, nodes[sibling].box);
+        nodes[newParent].height = nodes[sibling].height + 1;
+        nodes[newParent].child1 = sibling;
+        nodes[newParent].child2 = leaf;
+        nodes[sibling].parent = newParent;
+        nodes[leaf].parent = newParent;
+        if (oldParent != kNull)
+        {
+            if (nodes[oldParent].child1 == sibling)
+                nodes[oldParent].child1 = newParent;
+            else
+                nodes[oldParent].child2 = newParent;
+        }
+        else
+        {
+            root = newParent;
+        }
+
+        refit(nodes[leaf].parent);
+    }
+
+    float childCost(int child, const AABB& leafBox) const
+    {
+        const Node& node = nodes[child];
+        float combinedArea = area(combine(node.box, leafBox));
+        return node.IsLeaf() ? combinedArea : combinedArea - area(node.box);
+    }
+
+    void removeLeaf(int leaf)
+    {
+        if (leaf == root)
+        {
+            root = kNull;
+            return;
+        }
+
+        int parent = nodes[leaf].parent;
+        int grandParent = nodes[parent].parent;
+        int sibling = nodes[parent].child1 == leaf ? nodes[parent].child2 : nodes[parent].child1;
+
+        if (grandParent != kNull)
+        {
+            if (nodes[grandParent].child1 == parent)
+                nodes[grandParent].child1 = sibling;
+            else
+                nodes[grandParent].child2 = sibling;
+            nodes[sibling].parent = grandParent;
+            freeNode(parent);
+            refit(grandParent);
+        }
+        else
+        {
+            root = sibling;
+            nodes[sibling].parent = kNull;
+            freeNode(parent);
+        }
+    }
+
+    // rebalances and recomputes boxes / heights from index up to the root
+    void refit(int index)
+    {
+        while (index != kNull)
+        {
+            index = balance(index);
+            Node& node = nodes[index];
+            node.height = 1 + std::max(nodes[node.child1].height, nodes[node.child2].height);
+            node.box = combine(nodes[node.child1].box, nodes[node.child2].box);
+            index = node.parent;
+        }
+    }
+
+    // rotates the taller child of A up when the children heights differ by more than one.
+    // returns the index now at A's position.
+    int balance(int iA)
+    {
+        Node& A = nodes[iA];
+        if (A.IsLeaf() || A.height < 2)
+            return iA;
+
+        int iB = A.child1;
+        int iC = A.child2;
+        Node& B = nodes[iB];
+        Node& C = nodes[iC];
+        int difference = C.height - B.height;
+
+        if (difference > 1)
+            return rotateUp(iA, iC, iB, false);
+        if (difference < -1)
+            return rotateUp(iA, iB, iC, true);
+        return iA;
+    }
+
+    // promotes child iUp of iA; iOther is A's remaining child.
+    // upIsChild1: iUp was A.child1 (its replacement goes to the same slot)
+    int rotateUp(int iA, int iUp, int iOther, bool upIsChild1)
+    {
+        Node& A = nodes[iA];
+        Node& Up = nodes[iUp];
+        int iF = Up.child1;
+        int iG = Up.child2;
+        Node& F = nodes[iF];
+        Node& G = nodes[iG];
+
+        // Up takes A's place
+        Up.child1 = iA;
+        Up.parent = A.parent;
+        A.parent = iUp;
+        if (Up.parent != kNull)
+        {
+            if (nodes[Up.parent].child1 == iA)
+                nodes[Up.parent].child1 = iUp;
+            else
+                nodes[Up.parent].child2 = iUp;
+        }
+        else
+        {
+            root = iUp;
+        }
+
+        // the taller grandchild stays with Up, the shorter one moves under A
+        int iKeep = F.height > G.height ? iF : iG;
+        int iMove = F.height > G.height ? iG : iF;
+        Up.child2 = iKeep;
+        if (upIsChild1)
+            A.child1 = iMove;
+        else
+            A.child2 = iMove;
+        nodes[iMove].parent = iA;
+
+        A.box = combine(nodes[iOther].box, nodes[iMove].box);
+        A.height = 1 + std::max(nodes[iOther].height, nodes[iMove].height);
+        Up.box = combine(A.box, nodes[iKeep].box);
+        Up.height = 1 + std::max(A.height, nodes[iKeep].height);
+        return iUp;
+    }
+};
+#endif
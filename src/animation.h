@@ -8,6 +8,7 @@
 #include "bone.h"
 #include "animdata.h"
 #include "model_animation.h"
+#include "bounds.h"
 
 struct AssimpNodeData
 {
@@ -42,6 +43,7 @@ public:
 		globalTransformation = globalTransformation.Inverse();
 		ReadHierarchyData(m_RootNode, scene->mRootNode);
 		ReadMissingBones(animation, *model);
+		ComputeMeshBounds(*model);
 	}
 
 	~Animation()
@@ -69,6 +71,58 @@ public:
 		return m_BoneInfoMap;
 	}
 
+	// object space bounds of model.meshes[i] over the whole clip (bind pose bounds for static meshes)
+	const AABB& GetMeshBounds(size_t i) const { return m_MeshBounds[i]; }
+	// union of all mesh bounds
+	const AABB& GetBounds() const { return m_Bounds; }
+
+	// Conservative per-clip bounds. A skinned vertex is a weighted average of its bones'
+	// transforms applied to the bind pose vertex, so at any time it lies inside the union of
+	// its bones' transformed bind pose boxes (Mesh::boneBounds). The clip is sampled about once
+	// per tick and the result padded a little for the motion between samples.
+	void ComputeMeshBounds(const Model& model)
+	{
+		const int kMaxSamples = 240;
+		const float kPadding = 0.02f;
+		int samples = std::min(kMaxSamples, std::max(1, (int)std::ceil(m_Duration)));
+
+		int boneCount = 0;
+		for (const auto& bone : m_BoneInfoMap)
+			boneCount = std::max(boneCount, bone.second.id + 1);
+		std::vector<glm::mat4> boneMatrices(boneCount, glm::mat4(1.0f));
+
+		m_MeshBounds.assign(model.meshes.size(), AABB());
+		m_Bounds = AABB();
+		for (int s = 0; s < samples; s++)
+		{
+			// the clip loops, so the end time is the start pose again
+			float time = m_Duration * (float)s / (float)samples;
+			SampleBoneTransforms(&m_RootNode, glm::mat4(1.0f), time, boneMatrices);
+			for (size_t i = 0; i < model.meshes.size(); i++)
+			{
+				const Mesh& mesh = model.meshes[i];
+				if (!mesh.skinned)
+				{
+					m_MeshBounds[i].Expand(mesh.bounds);
+					continue;
+				}
+				for (size_t b = 0; b < mesh.boneBounds.size() && b < boneMatrices.size(); b++)
+					m_MeshBounds[i].Expand(mesh.boneBounds[b].Transformed(boneMatrices[b]));
+			}
+		}
+
+		for (size_t i = 0; i < m_MeshBounds.size(); i++)
+		{
+			AABB& box = m_MeshBounds[i];
+			if (!box.Valid())
+				continue;
+			glm::vec3 pad = (box.max - box.min) * kPadding;
+			box.min -= pad;
+			box.max += pad;
+			m_Bounds.Expand(box);
+		}
+	}
+
 private:
 	void ReadMissingBones(const aiAnimation* animation, Model& model)
 	{
@@ -95,6 +149,26 @@ private:
 		m_BoneInfoMap = boneInfoMap;
 	}
 
+	// same traversal as Animator::CalculateBoneTransform, for an arbitrary time
+	void SampleBoneTransforms(const AssimpNodeData* node, const glm::mat4& parentTransform, float time, std::vector<glm::mat4>& boneMatrices)
+	{
+		glm::mat4 nodeTransform = node->transformation;
+		Bone* bone = FindBone(node->name);
+		if (bone)
+		{
+			bone->Update(time);
+			nodeTransform = bone->GetLocalTransform();
+		}
+		glm::mat4 globalTransformation = parentTransform * nodeTransform;
+
+		auto it = m_BoneInfoMap.find(node->name);
+		if (it != m_BoneInfoMap.end() && it->second.id < (int)boneMatrices.size())
+			boneMatrices[it->second.id] = globalTransformation * it->second.offset;
+
+		for (int i = 0; i < node->childrenCount; i++)
+			SampleBoneTransforms(&node->children[i], globalTransformation, time, boneMatrices);
+	}
+
 	void ReadHierarchyData(AssimpNodeData& dest, const aiNode* src)
 	{
 		assert(src);
@@ -115,4 +189,6 @@ private:
 	std::vector<Bone> m_Bones;
 	AssimpNodeData m_RootNode;
 	std::map<std::string, BoneInfo> m_BoneInfoMap;
+	std::vector<AABB> m_MeshBounds;
+	AABB m_Bounds;
 };
\ No newline at end of file
@@ -35,6 +35,13 @@ public:
 		}
 	}
 
+	// poses the clip at a time in ticks, without advancing or wrapping (e.g. BakedAnimation)
+	void EvaluateAt(float ticks)
+	{
+		m_CurrentTime = ticks;
+		CalculateBoneTransform(&m_CurrentAnimation->GetRootNode(), glm::mat4(1.0f));
+	}
+
 	void PlayAnimation(Animation* pAnimation)
 	{
 		m_CurrentAnimation = pAnimation;
@@ -0,0 +1,128 @@
+#ifndef BAKED_ANIMATION_H
+#define BAKED_ANIMATION_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <spdlog/spdlog.h>
+
+#include "shader_m.h"
+#include "gl_state.h"
+#include "animation.h"
+#include "animator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+// Animation clips sampled at load time into a bone matrix texture, so instances can be animated
+// entirely in the vertex shader (BAKED_ANIMATION variants of anim_model.vs / simpleDepthShader.vs)
+// with no Animator per instance.
+// RGBA32F, one row per frame with 3 texels per bone: the rows of its 3x4 affine matrix. Clips
+// follow each other down the texture; the shader loops a clip and blends adjacent frames.
+// 32 bit floats because the model space translations of the bones (Timmy is in centimeters)
+// lose too much in half floats.
+class BakedAnimation
+{
+public:
+    static const int kMaxClips = 8;     // MAX_BAKED_CLIPS of the shaders
+    static const int kMaxBones = 100;   // MAX_BONES of skinning.glsl
+
+    // samples a clip over its duration at frameRate (per second), before Upload; returns its id or -1
+    int AddClip(Animation& clip, float frameRate = 30.0f)
+    {
+        if ((int)clips.size() >= kMaxClips)
+        {
+            SPDLOG_ERROR("baked animation: more than {} clips", kMaxClips);
+            return -1;
+        }
+        if (clips.empty())
+            this->frameRate = frameRate;
+        int boneCount = 0;
+        for (const auto& bone : clip.GetBoneIDMap())
+            boneCount = std::max(boneCount, std::min(bone.second.id + 1, kMaxBones));
+        bones = std::max(bones, boneCount);
+
+        // frames cover [0, duration); the shader blends the last one into the first
+        float seconds = clip.GetDuration() / std::max(clip.GetTicksPerSecond(), 1.0f);
+        Clip baked;
+        baked.firstFrame = frameCount();
+        baked.frameCount = std::max(1, (int)std::ceil(seconds * this->frameRate));
+        Animator sampler(&clip);
+        for (int frame = 0; frame < baked.frameCount; frame++)
+        {
+            float ticks = std::fmod(frame / this->frameRate * clip.GetTicksPerSecond(), clip.GetDuration());
+            sampler.EvaluateAt(ticks);
+            std::vector<glm::mat4> palette = sampler.GetFinalBoneMatrices();
+            palette.resize(kMaxBones, glm::mat4(1.0f));
+            frames.insert(frames.end(), palette.begin(), palette.end());
+        }
+        clips.push_back(baked);
+        return (int)clips.size() - 1;
+    }
+
+    // creates the texture from the added clips
+    void Upload()
+    {
+        int height = frameCount();
+        if (height == 0 || bones == 0)
+            return;
+        std::vector<glm::vec4> texels((size_t)height * bones * 3);
+        for (int frame = 0; frame < height; frame++)
+        {
+            for (int bone = 0; bone < bones; bone++)
+            {
+                const glm::mat4& m = frames[(size_t)frame * kMaxBones + bone];
+                glm::vec4* rows = &texels[((size_t)frame * bones + bone) * 3];
+                for (int row = 0; row < 3; row++)
+                    rows[row] = glm::vec4(m[0][row], m[1][row], m[2][row], m[3][row]);
+            }
+        }
+        if (texture == 0)
+            glGenTextures(1, &texture);
+        GLState::Get().BindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, bones * 3, height, 0, GL_RGBA, GL_FLOAT, texels.data());
+        // texelFetch only, the frame blend is done in the shader
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        SPDLOG_INFO("baked {} clips, {} frames of {} bones: {} KB", clips.size(), height, bones,
+            texels.size() * sizeof(glm::vec4) / 1024);
+        // the CPU copy is not needed any more
+        std::vector<glm::mat4>().swap(frames);
+    }
+
+    // clip table, frame rate and playback time (seconds) of a BAKED_ANIMATION program, which must be in use.
+    // the texture itself is bound by the caller
+    void SetUniforms(const Shader& shader, float time) const
+    {
+        for (int i = 0; i < (int)clips.size(); i++)
+        {
+            std::string index = "[" + std::to_string(i) + "]";
+            shader.setInt("bakedClipFirstFrame" + index, clips[i].firstFrame);
+            shader.setInt("bakedClipFrameCount" + index, clips[i].frameCount);
+        }
+        shader.setFloat("bakedFrameRate", frameRate);
+        shader.setFloat("bakedTime", time);
+    }
+
+    GLuint Texture() const { return texture; }
+    int ClipCount() const { return (int)clips.size(); }
+    // length of a clip in seconds
+    float ClipSeconds(int clip) const { return clips[clip].frameCount / frameRate; }
+
+private:
+    struct Clip {
+        int firstFrame = 0;
+        int frameCount = 0;
+    };
+    std::vector<Clip> clips;
+    std::vector<glm::mat4> frames;  // kMaxBones matrices per frame, until Upload
+    int bones = 0;
+    float frameRate = 30.0f;
+    GLuint texture = 0;
+
+    int frameCount() const { return clips.empty() ? 0 : clips.back().firstFrame + clips.back().frameCount; }
+};
+#endif
@@ -0,0 +1,72 @@
+#ifndef BOUNDS_H
+#define BOUNDS_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+// axis aligned bounding box; empty (min > max) until a point is added
+struct AABB {
+    glm::vec3 min = glm::vec3(FLT_MAX);
+    glm::vec3 max = glm::vec3(-FLT_MAX);
+
+    bool Valid() const { return min.x <= max.x && min.y <= max.y && min.z <= max.z; }
+    glm::vec3 Center() const { return (min + max) * 0.5f; }
+    glm::vec3 Extents() const { return (max - min) * 0.5f; }
+
+    void Expand(const glm::vec3& point)
+    {
+        min = glm::min(min, point);
+        max = glm::max(max, point);
+    }
+
+    void Expand(const AABB& box)
+    {
+        if (!box.Valid())
+            return;
+        min = glm::min(min, box.min);
+        max = glm::max(max, box.max);
+    }
+
+    // bounds of the transformed box (center / absolute-matrix extents, Arvo)
+    AABB Transformed(const glm::mat4& m) const
+    {
+        if (!Valid())
+            return *this;
+        glm::vec3 center = glm::vec3(m * glm::vec4(Center(), 1.0f));
+        glm::vec3 extents = Extents();
+        glm::vec3 worldExtents;
+        for (int i = 0; i < 3; i++)
+            worldExtents[i] = std::fabs(m[0][i]) * extents.x + std::fabs(m[1][i]) * extents.y + std::fabs(m[2][i]) * extents.z;
+        AABB result;
+        result.min = center - worldExtents;
+        result.max = center + worldExtents;
+        return result;
+    }
+};
+
+struct BoundingSphere {
+    glm::vec3 center = glm::vec3(0.0f);
+    float radius = -1.0f; // negative: empty
+};
+
+// sphere around the box center that encloses the given points
+template <typename PositionAt>
+BoundingSphere ComputeBoundingSphere(const AABB& box, size_t count, PositionAt positionAt)
+{
+    BoundingSphere sphere;
+    if (!box.Valid())
+        return sphere;
+    sphere.center = box.Center();
+    float radius2 = 0.0f;
+    for (size_t i = 0; i < count; i++)
+    {
+        glm::vec3 d = positionAt(i) - sphere.center;
+        radius2 = std::max(radius2, glm::dot(d, d));
+    }
+    sphere.radius = std::sqrt(radius2);
+    return sphere;
+}
+#endif
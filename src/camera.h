@@ -68,6 +68,18 @@ public:
         return glm::lookAt(Position, Position + Front, Up);
     }
 
+    // perspective projection from the current zoom (field of view)
+    glm::mat4 GetProjectionMatrix(float aspect, float nearPlane = 0.1f, float farPlane = 100.0f)
+    {
+        return glm::perspective(glm::radians(Zoom), aspect, nearPlane, farPlane);
+    }
+
+    // projection * view, the matrix the view frustum is extracted from
+    glm::mat4 GetViewProjectionMatrix(float aspect, float nearPlane = 0.1f, float farPlane = 100.0f)
+    {
+        return GetProjectionMatrix(aspect, nearPlane, farPlane) * GetViewMatrix();
+    }
+
     // processes input received from any keyboard-like input system. Accepts input parameter in the form of camera defined ENUM (to abstract it from windowing systems)
     void ProcessKeyboard(Camera_Movement direction, float deltaTime)
     {
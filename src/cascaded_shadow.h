@@ -0,0 +1,227 @@
+#ifndef CASCADED_SHADOW_H
+#define CASCADED_SHADOW_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <spdlog/spdlog.h>
+
+#include "shader_m.h"
+#include "gl_state.h"
+#include "bounds.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <string>
+
+// Cascaded shadow map for the directional light, one layer of a depth texture array per cascade.
+// The camera range is split with the practical scheme (a blend of logarithmic and uniform splits),
+// and every cascade is an ortho projection around the smallest sphere enclosing its frustum slice.
+// The sphere keeps the projection size fixed while the camera turns, and snapping its center to
+// whole shadow texels keeps it from sliding across texels while the camera moves - the two
+// sources of shadow edge shimmering. The depth range reaches back to the scene bounds so casters
+// between the light and the slice are kept.
+// Static casters are kept in a second texture array: a cascade's cache is re-rendered only when
+// its projection changes (the light turned, or the camera moved by a texel of that cascade) or
+// the static objects changed (InvalidateStatic). Every frame the cache is copied into the shadow
+// map and only the dynamic casters are drawn on top.
+class CascadedShadowMap
+{
+public:
+    static const int kCascadeCount = 4;     // must match shadow_mapping.fs
+
+    // resolution per cascade
+    void Init(int resolution)
+    {
+        this->resolution = resolution;
+        texture = createLayers(framebuffers);
+        // receivers sample through sampler2DArrayShadow: compare + bilinear = 2x2 PCF per fetch
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+        cacheTexture = createLayers(cacheFramebuffers);
+        GLState::Get().BindFramebuffer(0);
+    }
+
+    // fits the cascades to the camera. fovY in radians, lightDirection points from the light
+    // into the scene; sceneBounds covers every shadow caster
+    void Update(const glm::mat4& view, float fovY, float aspect, float nearPlane, float farPlane,
+        const glm::vec3& lightDirection, const AABB& sceneBounds)
+    {
+        float shadowFar = std::min(farPlane, std::max(shadowDistance, nearPlane * 2.0f));
+        glm::mat4 inverseView = glm::inverse(view);
+        glm::vec3 eye = glm::vec3(inverseView[3]);
+        glm::vec3 forward = -glm::vec3(inverseView[2]);
+        float tanY = std::tan(fovY * 0.5f);
+        float tanX = tanY * aspect;
+        float k2 = tanX * tanX + tanY * tanY;   // squared corner offset per unit of depth
+
+        glm::vec3 direction = glm::normalize(lightDirection);
+        glm::vec3 up = std::fabs(direction.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        glm::mat4 lightRotation = glm::lookAt(glm::vec3(0.0f), direction, up);
+        // nearest caster along the light (light view looks down -z)
+        float casterZ = -FLT_MAX;
+        if (sceneBounds.Valid())
+            casterZ = sceneBounds.Transformed(lightRotation).max.z;
+
+        float sliceNear = nearPlane;
+        for (int cascade = 0; cascade < kCascadeCount; cascade++)
+        {
+            // practical split scheme
+            float t = (float)(cascade + 1) / kCascadeCount;
+            float logSplit = nearPlane * std::pow(shadowFar / nearPlane, t);
+            float uniformSplit = nearPlane + (shadowFar - nearPlane) * t;
+            float sliceFar = splitLambda * logSplit + (1.0f - splitLambda) * uniformSplit;
+            splits[cascade] = sliceFar;
+
+            // smallest sphere around the slice: its center is on the view axis, equally far from
+            // the near and far corner rings, or at the far ring's center for wide slices
+            float center = (sliceFar + sliceNear) * (1.0f + k2) * 0.5f;
+            float radius;
+            if (center >= sliceFar)
+            {
+                center = sliceFar;
+                radius = std::sqrt(k2) * sliceFar;
+            }
+            else
+            {
+                radius = std::sqrt((center - sliceNear) * (center - sliceNear) + k2 * sliceNear * sliceNear);
+            }
+            // a fixed size while the camera only turns: round away float noise
+            radius = std::ceil(radius * 16.0f) / 16.0f;
+
+            glm::vec3 lightCenter = glm::vec3(lightRotation * glm::vec4(eye + forward * center, 1.0f));
+            float texelSize = 2.0f * radius / (float)resolution;
+            lightCenter.x = std::floor(lightCenter.x / texelSize) * texelSize;
+            lightCenter.y = std::floor(lightCenter.y / texelSize) * texelSize;
+            // depth too, so a still standing cascade keeps its exact matrix (and its static cache)
+            lightCenter.z = std::floor(lightCenter.z / texelSize) * texelSize;
+
+            float zNear = -std::max(lightCenter.z + radius, casterZ) - 0.5f;
+            float zFar = -(lightCenter.z - radius) + 0.5f;
+            glm::mat4 lightProjection = glm::ortho(lightCenter.x - radius, lightCenter.x + radius,
+                lightCenter.y - radius, lightCenter.y + radius, zNear, zFar);
+            matrices[cascade] = lightProjection * lightRotation;
+            // one texel of world space in depth buffer units
+            texelDepth[cascade] = texelSize / (zFar - zNear);
+
+            sliceNear = sliceFar;
+        }
+    }
+
+    // the static casters of a cascade must be drawn again this frame
+    bool NeedsStaticUpdate(int cascade) const
+    {
+        return !caching || !cacheValid[cascade] || cacheMatrices[cascade] != matrices[cascade];
+    }
+
+    // static casters moved / appeared / disappeared
+    void InvalidateStatic()
+    {
+        for (int cascade = 0; cascade < kCascadeCount; cascade++)
+            cacheValid[cascade] = false;
+    }
+
+    // clears a cascade's cache for this frame's static casters (whether or not any get drawn)
+    void BeginStaticUpdate(int cascade)
+    {
+        BindStaticCache(cascade);
+        glClear(GL_DEPTH_BUFFER_BIT);
+        cacheMatrices[cascade] = matrices[cascade];
+        cacheValid[cascade] = true;
+    }
+
+    // render target of a cascade's static caster pass
+    void BindStaticCache(int cascade)
+    {
+        GLState::Get().BindFramebuffer(cacheFramebuffers[cascade]);
+        GLState::Get().Viewport(0, 0, resolution, resolution);
+    }
+
+    // after the static passes: every cascade starts from its cached static depth
+    void CopyStaticCache()
+    {
+        for (int cascade = 0; cascade < kCascadeCount; cascade++)
+        {
+            GLState::Get().BindFramebuffer(framebuffers[cascade]);
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, cacheFramebuffers[cascade]);
+            glBlitFramebuffer(0, 0, resolution, resolution, 0, 0, resolution, resolution, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffers[cascade]);
+        }
+    }
+
+    // render target of a cascade's dynamic caster pass (holds the static depth already)
+    void BindCascade(int cascade)
+    {
+        GLState::Get().BindFramebuffer(framebuffers[cascade]);
+        GLState::Get().Viewport(0, 0, resolution, resolution);
+    }
+
+    // matrices / split depths / bias scale of the receivers (shadow_mapping.fs); the shader must be in use
+    void SetUniforms(const Shader& shader) const
+    {
+        for (int cascade = 0; cascade < kCascadeCount; cascade++)
+        {
+            std::string index = "[" + std::to_string(cascade) + "]";
+            shader.setMat4("lightSpaceMatrices" + index, matrices[cascade]);
+            shader.setFloat("cascadeSplits" + index, splits[cascade]);
+            shader.setFloat("cascadeTexelDepth" + index, texelDepth[cascade]);
+        }
+    }
+
+    const glm::mat4& LightSpaceMatrix(int cascade) const { return matrices[cascade]; }
+    // far view depth of a cascade
+    float SplitDistance(int cascade) const { return splits[cascade]; }
+    GLuint Texture() const { return texture; }
+    int Resolution() const { return resolution; }
+
+    // 0: uniform splits, 1: logarithmic
+    float splitLambda = 0.75f;
+    // shadows end here (or at the camera far plane)
+    float shadowDistance = 60.0f;
+    // off: the static casters are drawn every frame
+    bool caching = true;
+
+private:
+    int resolution = 0;
+    GLuint texture = 0;
+    GLuint framebuffers[kCascadeCount] = { 0 };
+    GLuint cacheTexture = 0;
+    GLuint cacheFramebuffers[kCascadeCount] = { 0 };
+    glm::mat4 cacheMatrices[kCascadeCount];
+    bool cacheValid[kCascadeCount] = { false };
+    glm::mat4 matrices[kCascadeCount];
+    float splits[kCascadeCount] = { 0.0f };
+    float texelDepth[kCascadeCount] = { 0.0f };
+
+    // depth texture array with a framebuffer per layer, so switching cascades is a bind
+    GLuint createLayers(GLuint* layerFramebuffers)
+    {
+        GLuint layers;
+        glGenTextures(1, &layers);
+        GLState::Get().BindTexture(GL_TEXTURE_2D_ARRAY, layers);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, resolution, resolution, kCascadeCount, 0,
+            GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+        float borderColor[] = { 1.0, 1.0, 1.0, 1.0 };
+        glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, borderColor);
+
+        glGenFramebuffers(kCascadeCount, layerFramebuffers);
+        for (int cascade = 0; cascade < kCascadeCount; cascade++)
+        {
+            GLState::Get().BindFramebuffer(layerFramebuffers[cascade]);
+            glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, layers, 0, cascade);
+            glDrawBuffer(GL_NONE);
+            glReadBuffer(GL_NONE);
+            if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+                SPDLOG_ERROR("shadow cascade {} framebuffer incomplete", cascade);
+        }
+        return layers;
+    }
+};
+#endif
@@ -2,6 +2,14 @@
 #include <fstream>
 #include <sstream>
 
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
 std::optional<std::string> LoadTextFile(const std::string& filename) {
     std::ifstream fin(filename);
     if (!fin.is_open()) {
@@ -11,4 +19,30 @@ std::optional<std::string> LoadTextFile(const std::string& filename) {
     std::stringstream text;
     text << fin.rdbuf();
     return text.str();
-}
\ No newline at end of file
+}
+
+ProcessMemoryUsage GetProcessMemoryUsage() {
+    ProcessMemoryUsage usage;
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        usage.current = counters.WorkingSetSize;
+        usage.peak = counters.PeakWorkingSetSize;
+    }
+#elif defined(__linux__)
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        // "VmRSS:     1234 kB" / "VmHWM:     1234 kB"
+        if (line.compare(0, 6, "VmRSS:") == 0)
+            usage.current = std::stoull(line.substr(6)) * 1024;
+        else if (line.compare(0, 6, "VmHWM:") == 0)
+            usage.peak = std::stoull(line.substr(6)) * 1024;
+    }
+#else
+    struct rusage resourceUsage;
+    if (getrusage(RUSAGE_SELF, &resourceUsage) == 0)
+        usage.peak = (size_t)resourceUsage.ru_maxrss; // bytes on macOS
+#endif
+    return usage;
+}
@@ -19,4 +19,11 @@ using klassName ## WPtr = std::weak_ptr<klassName>;
 
 std::optional<std::string> LoadTextFile(const std::string& filename);
 
+// resident memory of this process in bytes (current / high water mark), 0 if unknown
+struct ProcessMemoryUsage {
+    size_t current { 0 };
+    size_t peak { 0 };
+};
+ProcessMemoryUsage GetProcessMemoryUsage();
+
 #endif // __COMMON_H__
\ No newline at end of file
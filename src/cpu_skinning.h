@@ -0,0 +1,354 @@
+#ifndef CPU_SKINNING_H
+#define CPU_SKINNING_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <spdlog/spdlog.h>
+
+#include "mesh.h"
+#include "skinned_streams.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CPU_SKINNING_SSE 1
+#include <immintrin.h>
+// the AVX2 kernel is compiled for AVX2 + FMA on its own and only called when the CPU has them,
+// the rest of the program keeps the baseline instruction set
+#if defined(__GNUC__) || defined(__clang__)
+#define CPU_SKINNING_AVX2 1
+#define CPU_SKINNING_AVX2_TARGET __attribute__((target("avx2,fma")))
+#elif defined(_MSC_VER)
+#define CPU_SKINNING_AVX2 1
+#define CPU_SKINNING_AVX2_TARGET
+#include <intrin.h>
+#endif
+#endif
+
+enum SkinningPath {
+    SKINNING_PATH_SCALAR = 0,
+    SKINNING_PATH_SSE,          // one vertex per iteration, a matrix column per register
+    SKINNING_PATH_AVX2,         // two vertices per iteration, FMA
+    SKINNING_PATH_COUNT
+};
+
+struct CpuSkinningStats {
+    int meshes = 0;
+    int vertices = 0;
+    float skinMilliseconds = 0.0f;      // palette blend + transform, all threads
+    float uploadMilliseconds = 0.0f;    // streaming buffer update
+    double verticesPerSecond = 0.0;     // from skinMilliseconds
+};
+
+// Skins meshes on the CPU: the same 4 bone linear blend as skinning.glsl, over the vertices kept
+// on the CPU (ModelLoadOptions::keepCpuData), in vertex chunks on the ThreadPool. The results stay
+// readable on the CPU (picking, physics) and are uploaded to SkinnedStreams, whose VAOs draw them
+// as static geometry.
+// Bone ids are sanitized once: unused influences point at an identity matrix after the palette
+// with weight 0, and vertices the shader leaves unskinned (no bone, or an id past the palette)
+// get the identity with weight 1, so every kernel blends exactly four matrices without branches.
+class CpuSkinning
+{
+public:
+    static const int kMaxBones = 100;   // MAX_BONES of skinning.glsl
+
+    CpuSkinning() : palette(kMaxBones + 1, glm::mat4(1.0f))
+    {
+        path = SKINNING_PATH_SCALAR;
+        for (int p = SKINNING_PATH_COUNT - 1; p > SKINNING_PATH_SCALAR; p--)
+        {
+            if (Supported((SkinningPath)p))
+            {
+                path = (SkinningPath)p;
+                break;
+            }
+        }
+    }
+
+    // a skinned mesh with its CPU vertices; false (and nothing added) otherwise
+    bool Add(const Mesh& mesh)
+    {
+        if (!mesh.skinned || mesh.range.page < 0)
+            return false;
+        if (mesh.vertices.size() != (size_t)mesh.range.vertexCount)
+        {
+            SPDLOG_WARN("cpu skinning needs the mesh's vertices on the CPU (ModelLoadOptions::keepCpuData)");
+            return false;
+        }
+
+        // same vertex order as the streams
+        streams.Add(mesh);
+        for (const Vertex& vertex : mesh.vertices)
+        {
+            sourcePositions.push_back(glm::vec4(vertex.Position, 1.0f));
+            sourceNormals.push_back(glm::vec4(vertex.Normal, 0.0f));
+            influences.push_back(sanitize(vertex));
+        }
+        positions.resize(sourcePositions.size());
+        normals.resize(sourcePositions.size());
+        return true;
+    }
+
+    // skins every added mesh with the bone palette (Animator::GetFinalBoneMatrices) and uploads it
+    void Update(const std::vector<glm::mat4>& bones)
+    {
+        std::copy(bones.begin(), bones.begin() + std::min((int)bones.size(), kMaxBones), palette.begin());
+        int count = (int)sourcePositions.size();
+        stats.meshes = (int)streams.Entries().size();
+        stats.vertices = count;
+        if (count == 0)
+            return;
+
+        auto start = std::chrono::steady_clock::now();
+        SkinningPath kernel = path;
+        ThreadPool::Get().ParallelFor(count, 1024, [&](int begin, int end) {
+            skin(kernel, begin, end);
+        });
+        auto skinned = std::chrono::steady_clock::now();
+
+        streams.BeginFrame();
+        glBindBuffer(GL_ARRAY_BUFFER, streams.Buffer());
+        glBufferSubData(GL_ARRAY_BUFFER, streams.PositionOffset(0), count * sizeof(glm::vec3), positions.data());
+        glBufferSubData(GL_ARRAY_BUFFER, streams.NormalOffset(0), count * sizeof(glm::vec3), normals.data());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        auto uploaded = std::chrono::steady_clock::now();
+
+        stats.skinMilliseconds = std::chrono::duration<float, std::milli>(skinned - start).count();
+        stats.uploadMilliseconds = std::chrono::duration<float, std::milli>(uploaded - skinned).count();
+        stats.verticesPerSecond = stats.skinMilliseconds > 0.0f ? count / (stats.skinMilliseconds * 0.001) : 0.0;
+    }
+
+    // stream VAO of an added mesh (valid after the first Update), 0 for other meshes
+    GLuint VAO(const Mesh& mesh, bool depthOnly) const { return streams.VAO(mesh, depthOnly); }
+
+    // last Update's object space positions / normals of an added mesh, nullptr for other meshes
+    const glm::vec3* Positions(const Mesh& mesh) const
+    {
+        const SkinnedStreams::Entry* entry = streams.Find(mesh);
+        return entry ? positions.data() + entry->first : nullptr;
+    }
+    const glm::vec3* Normals(const Mesh& mesh) const
+    {
+        const SkinnedStreams::Entry* entry = streams.Find(mesh);
+        return entry ? normals.data() + entry->first : nullptr;
+    }
+
+    static bool Supported(SkinningPath kernel)
+    {
+        switch (kernel)
+        {
+        case SKINNING_PATH_SCALAR:
+            return true;
+        case SKINNING_PATH_SSE:
+#ifdef CPU_SKINNING_SSE
+            return true;
+#else
+            return false;
+#endif
+        case SKINNING_PATH_AVX2:
+#ifdef CPU_SKINNING_AVX2
+            return cpuHasAvx2();
+#else
+            return false;
+#endif
+        default:
+            return false;
+        }
+    }
+    static const char* PathName(SkinningPath kernel)
+    {
+        static const char* names[SKINNING_PATH_COUNT] = { "scalar", "SSE", "AVX2 + FMA" };
+        return names[kernel];
+    }
+
+    SkinningPath Path() const { return path; }
+    void SetPath(SkinningPath kernel)
+    {
+        if (Supported(kernel))
+            path = kernel;
+    }
+
+    const CpuSkinningStats& Stats() const { return stats; }
+
+private:
+    struct Influences {
+        int ids[MAX_BONE_INFLUENCE];
+        float weights[MAX_BONE_INFLUENCE];
+    };
+
+    SkinnedStreams streams;
+    // every added mesh's vertices, one after the other
+    std::vector<glm::vec4> sourcePositions;     // w = 1
+    std::vector<glm::vec4> sourceNormals;       // w = 0
+    std::vector<Influences> influences;
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> normals;
+    // kMaxBones bone matrices + the identity
+    std::vector<glm::mat4> palette;
+    SkinningPath path;
+    CpuSkinningStats stats;
+
+    static Influences sanitize(const Vertex& vertex)
+    {
+        Influences result;
+        bool any = false, outOfRange = false;
+        for (int i = 0; i < MAX_BONE_INFLUENCE; i++)
+        {
+            int id = vertex.m_BoneIDs[i];
+            bool used = id >= 0 && vertex.m_Weights[i] != 0.0f;
+            outOfRange |= id >= kMaxBones;
+            any |= used;
+            result.ids[i] = used && id < kMaxBones ? id : kMaxBones;
+            result.weights[i] = used && id < kMaxBones ? vertex.m_Weights[i] : 0.0f;
+        }
+        if (!any || outOfRange)
+        {
+            for (int i = 0; i < MAX_BONE_INFLUENCE; i++)
+            {
+                result.ids[i] = kMaxBones;
+                result.weights[i] = i == 0 ? 1.0f : 0.0f;
+            }
+        }
+        return result;
+    }
+
+    void skin(SkinningPath kernel, int begin, int end)
+    {
+#ifdef CPU_SKINNING_AVX2
+        if (kernel == SKINNING_PATH_AVX2)
+        {
+            skinAvx2(begin, end);
+            return;
+        }
+#endif
+#ifdef CPU_SKINNING_SSE
+        if (kernel == SKINNING_PATH_SSE)
+        {
+            skinSse(begin, end);
+            return;
+        }
+#endif
+        skinScalar(begin, end);
+    }
+
+    void storeNormal(int i, float x, float y, float z)
+    {
+        float length2 = x * x + y * y + z * z;
+        float scale = length2 > 0.0f ? 1.0f / std::sqrt(length2) : 0.0f;
+        normals[i] = glm::vec3(x * scale, y * scale, z * scale);
+    }
+
+    void skinScalar(int begin, int end)
+    {
+        for (int i = begin; i < end; i++)
+        {
+            const Influences& in = influences[i];
+            glm::mat4 m = palette[in.ids[0]] * in.weights[0] + palette[in.ids[1]] * in.weights[1]
+                + palette[in.ids[2]] * in.weights[2] + palette[in.ids[3]] * in.weights[3];
+            positions[i] = glm::vec3(m * sourcePositions[i]);
+            glm::vec3 n = glm::vec3(m * sourceNormals[i]);
+            storeNormal(i, n.x, n.y, n.z);
+        }
+    }
+
+#ifdef CPU_SKINNING_SSE
+    void skinSse(int begin, int end)
+    {
+        const float* bones = &palette[0][0][0];
+        alignas(16) float p[4], n[4];
+        for (int i = begin; i < end; i++)
+        {
+            const Influences& in = influences[i];
+            // blended matrix, one column per register
+            __m128 c0 = _mm_setzero_ps(), c1 = _mm_setzero_ps(), c2 = _mm_setzero_ps(), c3 = _mm_setzero_ps();
+            for (int k = 0; k < MAX_BONE_INFLUENCE; k++)
+            {
+                const float* m = bones + 16 * in.ids[k];
+                __m128 w = _mm_set1_ps(in.weights[k]);
+                c0 = _mm_add_ps(c0, _mm_mul_ps(w, _mm_loadu_ps(m)));
+                c1 = _mm_add_ps(c1, _mm_mul_ps(w, _mm_loadu_ps(m + 4)));
+                c2 = _mm_add_ps(c2, _mm_mul_ps(w, _mm_loadu_ps(m + 8)));
+                c3 = _mm_add_ps(c3, _mm_mul_ps(w, _mm_loadu_ps(m + 12)));
+            }
+            const glm::vec4& sp = sourcePositions[i];
+            const glm::vec4& sn = sourceNormals[i];
+            __m128 position = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(sp.x)), _mm_mul_ps(c1, _mm_set1_ps(sp.y))),
+                _mm_add_ps(_mm_mul_ps(c2, _mm_set1_ps(sp.z)), c3));
+            __m128 normal = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(sn.x)), _mm_mul_ps(c1, _mm_set1_ps(sn.y))),
+                _mm_mul_ps(c2, _mm_set1_ps(sn.z)));
+            _mm_store_ps(p, position);
+            _mm_store_ps(n, normal);
+            positions[i] = glm::vec3(p[0], p[1], p[2]);
+            storeNormal(i, n[0], n[1], n[2]);
+        }
+    }
+#endif
+
+#ifdef CPU_SKINNING_AVX2
+    static bool cpuHasAvx2()
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#else
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7)
+            return false;
+        __cpuid(info, 1);
+        bool fma = (info[2] & (1 << 12)) != 0;
+        // the OS must save the ymm registers
+        bool osAvx = (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 6) == 6;
+        __cpuidex(info, 7, 0);
+        return fma && osAvx && (info[1] & (1 << 5)) != 0;
+#endif
+    }
+
+    // two vertices per iteration: the low half of each register belongs to vertex i, the high half to i + 1
+    CPU_SKINNING_AVX2_TARGET void skinAvx2(int begin, int end)
+    {
+        const float* bones = &palette[0][0][0];
+        alignas(32) float p[8], n[8];
+        int i = begin;
+        for (; i + 1 < end; i += 2)
+        {
+            const Influences& a = influences[i];
+            const Influences& b = influences[i + 1];
+            __m256 c0 = _mm256_setzero_ps(), c1 = _mm256_setzero_ps(), c2 = _mm256_setzero_ps(), c3 = _mm256_setzero_ps();
+            for (int k = 0; k < MAX_BONE_INFLUENCE; k++)
+            {
+                const float* ma = bones + 16 * a.ids[k];
+                const float* mb = bones + 16 * b.ids[k];
+                __m256 w = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(a.weights[k])), _mm_set1_ps(b.weights[k]), 1);
+                c0 = _mm256_fmadd_ps(w, _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(ma)), _mm_loadu_ps(mb), 1), c0);
+                c1 = _mm256_fmadd_ps(w, _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(ma + 4)), _mm_loadu_ps(mb + 4), 1), c1);
+                c2 = _mm256_fmadd_ps(w, _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(ma + 8)), _mm_loadu_ps(mb + 8), 1), c2);
+                c3 = _mm256_fmadd_ps(w, _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(ma + 12)), _mm_loadu_ps(mb + 12), 1), c3);
+            }
+            const glm::vec4& pa = sourcePositions[i];
+            const glm::vec4& pb = sourcePositions[i + 1];
+            const glm::vec4& na = sourceNormals[i];
+            const glm::vec4& nb = sourceNormals[i + 1];
+            __m256 position = _mm256_fmadd_ps(c0, _mm256_setr_ps(pa.x, pa.x, pa.x, pa.x, pb.x, pb.x, pb.x, pb.x),
+                _mm256_fmadd_ps(c1, _mm256_setr_ps(pa.y, pa.y, pa.y, pa.y, pb.y, pb.y, pb.y, pb.y),
+                _mm256_fmadd_ps(c2, _mm256_setr_ps(pa.z, pa.z, pa.z, pa.z, pb.z, pb.z, pb.z, pb.z), c3)));
+            __m256 normal = _mm256_fmadd_ps(c0, _mm256_setr_ps(na.x, na.x, na.x, na.x, nb.x, nb.x, nb.x, nb.x),
+                _mm256_fmadd_ps(c1, _mm256_setr_ps(na.y, na.y, na.y, na.y, nb.y, nb.y, nb.y, nb.y),
+                _mm256_mul_ps(c2, _mm256_setr_ps(na.z, na.z, na.z, na.z, nb.z, nb.z, nb.z, nb.z))));
+            _mm256_store_ps(p, position);
+            _mm256_store_ps(n, normal);
+            positions[i] = glm::vec3(p[0], p[1], p[2]);
+            positions[i + 1] = glm::vec3(p[4], p[5], p[6]);
+            storeNormal(i, n[0], n[1], n[2]);
+            storeNormal(i + 1, n[4], n[5], n[6]);
+        }
+        if (i < end)
+            skinSse(i, end);
+    }
+#endif
+};
+#endif
@@ -0,0 +1,223 @@
+#ifndef DEFERRED_H
+#define DEFERRED_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <spdlog/spdlog.h>
+
+#include "shader_m.h"
+#include "gl_state.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Deferred shading for the lighting.fs materials.
+// The G-buffer is 12 bytes a pixel:
+//   RGBA8  diffuse map rgb + specular map intensity
+//   RG16   octahedral encoded world space normal
+//   D24    depth, world position is reconstructed with the inverse view projection
+// Resolve lights it into the bound target: a fullscreen pass for the directional and spot
+// light (which also writes the G-buffer depth, so forward objects drawn afterwards depth test
+// against it), then one instanced sphere per visible point light. The spheres draw their back
+// faces with GL_GEQUAL and additive blending, which only touches pixels in front of the back
+// face - it works with the camera inside a light as well. Point lights come from the
+// LightClusters light data buffer (already compacted to the visible lights).
+class DeferredRenderer
+{
+public:
+    // sampler units of the resolve shaders; the light data buffer unit is the caller's
+    static const int kAlbedoSpecularUnit = 0;
+    static const int kNormalUnit = 1;
+    static const int kDepthUnit = 2;
+
+    void Init(int width, int height, int lightDataUnit)
+    {
+        this->width = width;
+        this->height = height;
+
+        glGenFramebuffers(1, &gBufferFBO);
+        GLState::Get().BindFramebuffer(gBufferFBO);
+        albedoSpecular = createTarget(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE);
+        normal = createTarget(GL_RG16, GL_RG, GL_UNSIGNED_SHORT);
+        depth = createTarget(GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, albedoSpecular, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, normal, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depth, 0);
+        const GLenum drawBuffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+        glDrawBuffers(2, drawBuffers);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            SPDLOG_ERROR("G-buffer framebuffer incomplete");
+        GLState::Get().BindFramebuffer(0);
+
+        directionalShader = Shader("./shader/fullscreen.vs", "./shader/deferred_directional.fs");
+        pointShader = Shader("./shader/deferred_point.vs", "./shader/deferred_point.fs");
+        for (const Shader* shader : { &directionalShader, &pointShader })
+        {
+            shader->use();
+            shader->setInt("gAlbedoSpecular", kAlbedoSpecularUnit);
+            shader->setInt("gNormal", kNormalUnit);
+            shader->setInt("gDepth", kDepthUnit);
+            shader->setVec2("screenSize", (float)width, (float)height);
+        }
+        pointShader.setInt("lightData", lightDataUnit);
+
+        glGenVertexArrays(1, &emptyVAO);
+        createLightVolume();
+    }
+
+    // starts a frame's G-buffer: far depth everywhere
+    void ClearGBuffer()
+    {
+        BindGBuffer();
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    }
+
+    // render target of the G-buffer pass
+    void BindGBuffer()
+    {
+        GLState::Get().BindFramebuffer(gBufferFBO);
+        GLState::Get().Viewport(0, 0, width, height);
+    }
+
+    // program of the directional / spot pass, for the caller's light uniforms
+    const Shader& DirectionalShader() const { return directionalShader; }
+    const Shader& PointShader() const { return pointShader; }
+
+    // lights the G-buffer into the bound framebuffer (same size). light uniforms (dirLight,
+    // spotLight, viewPos, material.shininess) must be set on both programs, the light data
+    // buffer bound to its unit
+    void Resolve(const glm::mat4& viewProjection, int pointLightCount)
+    {
+        GLState& gl = GLState::Get();
+        glm::mat4 inverseViewProjection = glm::inverse(viewProjection);
+        gl.BindTexture(kAlbedoSpecularUnit, GL_TEXTURE_2D, albedoSpecular);
+        gl.BindTexture(kNormalUnit, GL_TEXTURE_2D, normal);
+        gl.BindTexture(kDepthUnit, GL_TEXTURE_2D, depth);
+
+        // directional + spot, G-buffer depth into the target
+        directionalShader.use();
+        directionalShader.setMat4("inverseViewProjection", inverseViewProjection);
+        gl.BindVertexArray(emptyVAO);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+
+        // point light volumes
+        if (pointLightCount > 0)
+        {
+            pointShader.use();
+            pointShader.setMat4("inverseViewProjection", inverseViewProjection);
+            pointShader.setMat4("viewProjection", viewProjection);
+            gl.BindVertexArray(volumeVAO);
+            glEnable(GL_BLEND);
+            glBlendFunc(GL_ONE, GL_ONE);
+            glDepthMask(GL_FALSE);
+            glDepthFunc(GL_GEQUAL);
+            glEnable(GL_CULL_FACE);
+            glCullFace(GL_FRONT);
+            // spheres reaching past the far plane keep their back faces
+            glEnable(GL_DEPTH_CLAMP);
+            glDrawElementsInstanced(GL_TRIANGLES, volumeIndexCount, GL_UNSIGNED_SHORT, 0, pointLightCount);
+            glDisable(GL_DEPTH_CLAMP);
+            glCullFace(GL_BACK);
+            glDisable(GL_CULL_FACE);
+            glDepthFunc(GL_LESS);
+            glDepthMask(GL_TRUE);
+            glDisable(GL_BLEND);
+        }
+    }
+
+    int Width() const { return width; }
+    int Height() const { return height; }
+    // bytes per pixel of the G-buffer
+    static int PixelSize() { return 4 + 4 + 4; }
+
+private:
+    int width = 0, height = 0;
+    GLuint gBufferFBO = 0;
+    GLuint albedoSpecular = 0;
+    GLuint normal = 0;
+    GLuint depth = 0;
+    Shader directionalShader;
+    Shader pointShader;
+    GLuint emptyVAO = 0;
+    GLuint volumeVAO = 0;
+    GLuint volumeVBO = 0;
+    GLuint volumeEBO = 0;
+    GLsizei volumeIndexCount = 0;
+
+    GLuint createTarget(GLenum internalFormat, GLenum format, GLenum type)
+    {
+        GLuint texture;
+        glGenTextures(1, &texture);
+        GLState::Get().BindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        return texture;
+    }
+
+    // icosphere (one subdivision, 80 triangles) scaled so its faces enclose the unit sphere
+    void createLightVolume()
+    {
+        const float t = (1.0f + std::sqrt(5.0f)) * 0.5f;
+        std::vector<glm::vec3> positions = {
+            { -1, t, 0 }, { 1, t, 0 }, { -1, -t, 0 }, { 1, -t, 0 },
+            { 0, -1, t }, { 0, 1, t }, { 0, -1, -t }, { 0, 1, -t },
+            { t, 0, -1 }, { t, 0, 1 }, { -t, 0, -1 }, { -t, 0, 1 }
+        };
+        std::vector<GLushort> indices = {
+            0, 11, 5, 0, 5, 1, 0, 1, 7, 0, 7, 10, 0, 10, 11,
+            1, 5, 9, 5, 11, 4, 11, 10, 2, 10, 7, 6, 7, 1, 8,
+            3, 9, 4, 3, 4, 2, 3, 2, 6, 3, 6, 8, 3, 8, 9,
+            4, 9, 5, 2, 4, 11, 6, 2, 10, 8, 6, 7, 9, 8, 1
+        };
+        for (glm::vec3& p : positions)
+            p = glm::normalize(p);
+
+        // split every edge once
+        std::vector<GLushort> subdivided;
+        auto midpoint = [&](GLushort a, GLushort b) {
+            glm::vec3 p = glm::normalize(positions[a] + positions[b]);
+            for (size_t i = 0; i < positions.size(); i++)
+            {
+                if (glm::length(positions[i] - p) < 1e-5f)
+                    return (GLushort)i;
+            }
+            positions.push_back(p);
+            return (GLushort)(positions.size() - 1);
+        };
+        for (size_t i = 0; i < indices.size(); i += 3)
+        {
+            GLushort a = indices[i], b = indices[i + 1], c = indices[i + 2];
+            GLushort ab = midpoint(a, b), bc = midpoint(b, c), ca = midpoint(c, a);
+            subdivided.insert(subdivided.end(), { a, ab, ca, b, bc, ab, c, ca, bc, ab, bc, ca });
+        }
+
+        // the flat faces cut into the unit sphere; push them out to its tangent planes
+        float inner = 1.0f;
+        for (size_t i = 0; i < subdivided.size(); i += 3)
+        {
+            const glm::vec3& a = positions[subdivided[i]];
+            glm::vec3 n = glm::normalize(glm::cross(positions[subdivided[i + 1]] - a, positions[subdivided[i + 2]] - a));
+            inner = std::min(inner, std::fabs(glm::dot(n, a)));
+        }
+        for (glm::vec3& p : positions)
+            p /= inner;
+
+        volumeIndexCount = (GLsizei)subdivided.size();
+        glGenVertexArrays(1, &volumeVAO);
+        glGenBuffers(1, &volumeVBO);
+        glGenBuffers(1, &volumeEBO);
+        GLState::Get().BindVertexArray(volumeVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, volumeVBO);
+        glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(glm::vec3), positions.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, volumeEBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, subdivided.size() * sizeof(GLushort), subdivided.data(), GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+        GLState::Get().BindVertexArray(0);
+    }
+};
+#endif
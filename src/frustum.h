@@ -0,0 +1,167 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <glm/glm.hpp>
+
+#include "bounds.h"
+
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FRUSTUM_SSE 1
+#include <emmintrin.h>
+#endif
+
+enum FrustumResult {
+    FRUSTUM_OUTSIDE = 0,
+    FRUSTUM_INTERSECT,
+    FRUSTUM_INSIDE
+};
+
+// Six clip planes of a view-projection matrix (camera, or the light's lightSpaceMatrix).
+// Planes are stored structure-of-arrays and padded to 8 with planes nothing is behind,
+// so the SSE path tests four planes per instruction.
+// All tests are conservative: "visible" may include boxes just outside a corner.
+class Frustum
+{
+public:
+    Frustum() { Set(glm::mat4(1.0f)); }
+    explicit Frustum(const glm::mat4& viewProjection) { Set(viewProjection); }
+
+    // Gribb / Hartmann plane extraction, normals point inside
+    void Set(const glm::mat4& m)
+    {
+        glm::vec4 row[4];
+        for (int i = 0; i < 4; i++)
+            row[i] = glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+
+        glm::vec4 planes[6] = {
+            row[3] + row[0], // left
+            row[3] - row[0], // right
+            row[3] + row[1], // bottom
+            row[3] - row[1], // top
+            row[3] + row[2], // near
+            row[3] - row[2]  // far
+        };
+        for (int i = 0; i < kPlaneSlots; i++)
+        {
+            glm::vec4 p = i < 6 ? planes[i] : glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+            float length = glm::length(glm::vec3(p));
+            if (length > 0.0f)
+                p /= length;
+            nx[i] = p.x; ny[i] = p.y; nz[i] = p.z; d[i] = p.w;
+            ax[i] = std::fabs(p.x); ay[i] = std::fabs(p.y); az[i] = std::fabs(p.z);
+        }
+    }
+
+    // box given by center / half extents in the frustum's space
+    bool TestBox(const glm::vec3& center, const glm::vec3& extents) const
+    {
+#ifdef FRUSTUM_SSE
+        const __m128 ex = _mm_set1_ps(extents.x), ey = _mm_set1_ps(extents.y), ez = _mm_set1_ps(extents.z);
+        for (int i = 0; i < kPlaneSlots; i += 4)
+        {
+            // projected radius of the box on each plane normal
+            __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_load_ps(ax + i), ex), _mm_mul_ps(_mm_load_ps(ay + i), ey)),
+                _mm_mul_ps(_mm_load_ps(az + i), ez));
+            if (_mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(planeDistance(i, center), radius), _mm_setzero_ps())))
+                return false;
+        }
+        return true;
+#else
+        for (int i = 0; i < 6; i++)
+        {
+            float radius = ax[i] * extents.x + ay[i] * extents.y + az[i] * extents.z;
+            if (planeDistance(i, center) + radius < 0.0f)
+                return false;
+        }
+        return true;
+#endif
+    }
+
+    // outside / straddling / fully inside, for hierarchical culling
+    FrustumResult ClassifyBox(const glm::vec3& center, const glm::vec3& extents) const
+    {
+#ifdef FRUSTUM_SSE
+        const __m128 ex = _mm_set1_ps(extents.x), ey = _mm_set1_ps(extents.y), ez = _mm_set1_ps(extents.z);
+        int straddling = 0;
+        for (int i = 0; i < kPlaneSlots; i += 4)
+        {
+            __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_load_ps(ax + i), ex), _mm_mul_ps(_mm_load_ps(ay + i), ey)),
+                _mm_mul_ps(_mm_load_ps(az + i), ez));
+            __m128 dist = planeDistance(i, center);
+            if (_mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(dist, radius), _mm_setzero_ps())))
+                return FRUSTUM_OUTSIDE;
+            straddling |= _mm_movemask_ps(_mm_cmplt_ps(_mm_sub_ps(dist, radius), _mm_setzero_ps()));
+        }
+        return straddling ? FRUSTUM_INTERSECT : FRUSTUM_INSIDE;
+#else
+        bool straddling = false;
+        for (int i = 0; i < 6; i++)
+        {
+            float radius = ax[i] * extents.x + ay[i] * extents.y + az[i] * extents.z;
+            float dist = planeDistance(i, center);
+            if (dist + radius < 0.0f)
+                return FRUSTUM_OUTSIDE;
+            straddling |= dist - radius < 0.0f;
+        }
+        return straddling ? FRUSTUM_INTERSECT : FRUSTUM_INSIDE;
+#endif
+    }
+
+    bool TestSphere(const glm::vec3& center, float radius) const
+    {
+#ifdef FRUSTUM_SSE
+        const __m128 negRadius = _mm_set1_ps(-radius);
+        for (int i = 0; i < kPlaneSlots; i += 4)
+        {
+            if (_mm_movemask_ps(_mm_cmplt_ps(planeDistance(i, center), negRadius)))
+                return false;
+        }
+        return true;
+#else
+        for (int i = 0; i < 6; i++)
+        {
+            if (planeDistance(i, center) < -radius)
+                return false;
+        }
+        return true;
+#endif
+    }
+
+    bool TestSphere(const BoundingSphere& sphere) const
+    {
+        return sphere.radius >= 0.0f && TestSphere(sphere.center, sphere.radius);
+    }
+
+    bool TestAABB(const AABB& box) const
+    {
+        return box.Valid() && TestBox(box.Center(), box.Extents());
+    }
+
+    // local space box under a model matrix
+    bool TestAABB(const AABB& localBox, const glm::mat4& model) const
+    {
+        return TestAABB(localBox.Transformed(model));
+    }
+
+private:
+    static const int kPlaneSlots = 8;
+    alignas(16) float nx[kPlaneSlots], ny[kPlaneSlots], nz[kPlaneSlots], d[kPlaneSlots];
+    alignas(16) float ax[kPlaneSlots], ay[kPlaneSlots], az[kPlaneSlots];
+
+#ifdef FRUSTUM_SSE
+    // signed distances of a point to planes i..i+3
+    __m128 planeDistance(int i, const glm::vec3& p) const
+    {
+        return _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_load_ps(nx + i), _mm_set1_ps(p.x)), _mm_mul_ps(_mm_load_ps(ny + i), _mm_set1_ps(p.y))),
+            _mm_add_ps(_mm_mul_ps(_mm_load_ps(nz + i), _mm_set1_ps(p.z)), _mm_load_ps(d + i)));
+    }
+#else
+    float planeDistance(int i, const glm::vec3& p) const
+    {
+        return nx[i] * p.x + ny[i] * p.y + nz[i] * p.z + d[i];
+    }
+#endif
+};
+#endif
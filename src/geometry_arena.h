@@ -0,0 +1,440 @@
+#ifndef GEOMETRY_ARENA_H
+#define GEOMETRY_ARENA_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "gl_state.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+#define MAX_BONE_INFLUENCE 4
+
+// per vertex streams stored in the arena pages
+// stream 0 : position only (depth / shadow passes)
+// stream 1 : shading attributes
+// stream 2 : skinning attributes (skinned pages only)
+struct ShadeVertex {
+    glm::vec3 Normal;
+    glm::vec2 TexCoords;
+    glm::vec3 Tangent;
+    glm::vec3 Bitangent;
+};
+
+struct SkinVertex {
+    int m_BoneIDs[MAX_BONE_INFLUENCE];
+    float m_Weights[MAX_BONE_INFLUENCE];
+};
+
+enum VertexFormat {
+    VERTEX_FORMAT_STATIC = 0,   // position + shading
+    VERTEX_FORMAT_SKINNED,      // position + shading + skinning
+    VERTEX_FORMAT_COUNT
+};
+
+enum GeometryStream {
+    GEOMETRY_STREAM_POSITION = 0,
+    GEOMETRY_STREAM_SHADE,
+    GEOMETRY_STREAM_SKIN,
+    GEOMETRY_STREAM_INDEX
+};
+
+// a mesh's slice of the arena
+struct GeometryRange {
+    int page = -1;
+    GLint baseVertex = 0;       // first vertex in the page's vertex buffers
+    GLsizei vertexCount = 0;
+    size_t indexOffset = 0;     // byte offset in the page's index buffer
+    size_t indexBytes = 0;
+    GLsizei indexCount = 0;
+    GLenum indexType = GL_UNSIGNED_INT;
+};
+
+// Shared vertex/index storage for every Mesh.
+// Geometry lives in a few large pages, one set of streams + one index buffer per page,
+// sub-allocated with a first-fit free list. All meshes of the same vertex format in a page
+// share one VAO and are drawn with glDrawElementsBaseVertex, so drawing many meshes
+// only rebinds the VAO when the page changes.
+class GeometryArena
+{
+public:
+    static const size_t kPageVertices = 256 * 1024;
+    static const size_t kPageIndexBytes = 4 * 1024 * 1024;
+
+    static GeometryArena& Get()
+    {
+        static GeometryArena arena;
+        return arena;
+    }
+
+    // reserves space for a mesh; fill it with Map/Unmap or use Allocate
+    GeometryRange Reserve(VertexFormat format, size_t vertexCount, GLsizei indexCount, GLenum indexType)
+    {
+        GeometryRange range;
+        size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+        // keep every index range 4 byte aligned so it can be addressed with either index type
+        size_t indexBytes = ((size_t)indexCount * indexSize + 3) & ~(size_t)3;
+
+        for (size_t i = 0; i < pages.size() && range.page < 0; i++)
+        {
+            Page& page = pages[i];
+            if (page.format != format)
+                continue;
+            size_t vertexOffset, indexOffset;
+            if (!allocateBlock(page.freeVertices, vertexCount, vertexOffset))
+                continue;
+            if (!allocateBlock(page.freeIndices, indexBytes, indexOffset))
+            {
+                releaseBlock(page.freeVertices, vertexOffset, vertexCount);
+                continue;
+            }
+            range.page = (int)i;
+            range.baseVertex = (GLint)vertexOffset;
+            range.indexOffset = indexOffset;
+        }
+
+        if (range.page < 0)
+        {
+            // meshes bigger than a page get a page of their own
+            range.page = createPage(format, std::max(vertexCount, kPageVertices), std::max(indexBytes, kPageIndexBytes));
+            Page& page = pages[range.page];
+            size_t vertexOffset, indexOffset;
+            allocateBlock(page.freeVertices, vertexCount, vertexOffset);
+            allocateBlock(page.freeIndices, indexBytes, indexOffset);
+            range.baseVertex = (GLint)vertexOffset;
+            range.indexOffset = indexOffset;
+        }
+
+        range.vertexCount = (GLsizei)vertexCount;
+        range.indexBytes = indexBytes;
+        range.indexCount = indexCount;
+        range.indexType = indexType;
+        return range;
+    }
+
+    GeometryRange Allocate(VertexFormat format, size_t vertexCount,
+        const glm::vec3* positions, const ShadeVertex* shading, const SkinVertex* skin,
+        const void* indices, GLsizei indexCount, GLenum indexType)
+    {
+        GeometryRange range = Reserve(format, vertexCount, indexCount, indexType);
+
+        // upload through the copy target so no VAO's element buffer binding is disturbed
+        Page& page = pages[range.page];
+        size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+        upload(page.positionVBO, range.baseVertex * sizeof(glm::vec3), vertexCount * sizeof(glm::vec3), positions);
+        upload(page.shadeVBO, range.baseVertex * sizeof(ShadeVertex), vertexCount * sizeof(ShadeVertex), shading);
+        if (format == VERTEX_FORMAT_SKINNED)
+            upload(page.skinVBO, range.baseVertex * sizeof(SkinVertex), vertexCount * sizeof(SkinVertex), skin);
+        upload(page.ibo, range.indexOffset, (size_t)indexCount * indexSize, indices);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        return range;
+    }
+
+    // maps one stream of a reserved range for writing, so callers can write
+    // de-interleaved vertices straight into GPU memory without a staging copy.
+    // only one stream may be mapped at a time.
+    void* Map(const GeometryRange& range, GeometryStream stream)
+    {
+        Page& page = pages[range.page];
+        GLuint buffer = 0;
+        size_t offset = 0, size = 0;
+        switch (stream)
+        {
+        case GEOMETRY_STREAM_POSITION:
+            buffer = page.positionVBO;
+            offset = range.baseVertex * sizeof(glm::vec3);
+            size = range.vertexCount * sizeof(glm::vec3);
+            break;
+        case GEOMETRY_STREAM_SHADE:
+            buffer = page.shadeVBO;
+            offset = range.baseVertex * sizeof(ShadeVertex);
+            size = range.vertexCount * sizeof(ShadeVertex);
+            break;
+        case GEOMETRY_STREAM_SKIN:
+            buffer = page.skinVBO;
+            offset = range.baseVertex * sizeof(SkinVertex);
+            size = range.vertexCount * sizeof(SkinVertex);
+            break;
+        case GEOMETRY_STREAM_INDEX:
+            buffer = page.ibo;
+            offset = range.indexOffset;
+            size = range.indexBytes;
+            break;
+        }
+        if (buffer == 0 || size == 0)
+            return NULL;
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        return glMapBufferRange(GL_COPY_WRITE_BUFFER, offset, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+    }
+
+    // false when the buffer's contents were lost while mapped (GL_FALSE from glUnmapBuffer)
+    bool Unmap()
+    {
+        GLboolean intact = glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        return intact == GL_TRUE;
+    }
+
+    void Free(GeometryRange& range)
+    {
+        if (range.page < 0)
+            return;
+        Page& page = pages[range.page];
+        releaseBlock(page.freeVertices, range.baseVertex, range.vertexCount);
+        releaseBlock(page.freeIndices, range.indexOffset, range.indexBytes);
+        range = GeometryRange();
+    }
+
+    GLuint VAO(int page, bool depthOnly) const
+    {
+        return depthOnly ? pages[page].depthVAO : pages[page].vao;
+    }
+
+    // binds the page VAO unless it is already bound
+    void Bind(int page, bool depthOnly)
+    {
+        GLState::Get().BindVertexArray(depthOnly ? pages[page].depthVAO : pages[page].vao);
+    }
+
+    // per instance model matrices of instanced draws (attribute locations 7-10, divisor 1).
+    // the buffer is orphaned on every upload so the previous draw is never waited on.
+    void UploadInstances(const glm::mat4* models, size_t count)
+    {
+        if (instanceVBO == 0)
+            glGenBuffers(1, &instanceVBO);
+        // same buffer name when growing, so the page VAOs keep pointing at it
+        if (count > instanceCapacity)
+            instanceCapacity = std::max(count, instanceCapacity * 2);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        glBufferData(GL_ARRAY_BUFFER, instanceCapacity * sizeof(glm::mat4), NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(glm::mat4), models);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // points the instance attributes of the bound page VAO at the given first instance.
+    // GL 3.3 has no baseInstance, so per-command instanced draws re-base the stream instead.
+    // reset to 0 before another draw path uses the VAO.
+    void SetInstanceBase(size_t firstInstance)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        pointInstanceStream(firstInstance);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // VAO for one range whose positions (and normals) come from another buffer, e.g. vertices
+    // deformed on the CPU: attribute 0 reads vec3s at positionOffset, attribute 1 (full VAO only)
+    // at normalOffset, the other shading attributes and the indices stay the page's. The streams
+    // start at the range's first vertex, so draws through it use base vertex 0.
+    // The caller owns (and deletes) the VAO.
+    GLuint CreateStreamVAO(const GeometryRange& range, bool depthOnly, GLuint buffer, size_t positionOffset, size_t normalOffset)
+    {
+        const Page& page = pages[range.page];
+        GLuint vao;
+        glGenVertexArrays(1, &vao);
+        GLState::Get().BindVertexArray(vao);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, page.ibo);
+        if (!depthOnly)
+            setupShadeStream(page, range.baseVertex);
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)positionOffset);
+        if (!depthOnly)
+            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)normalOffset);
+        setupInstanceStream();
+        GLState::Get().BindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        return vao;
+    }
+
+    size_t PageCount() const { return pages.size(); }
+
+private:
+    struct Block {
+        size_t offset;
+        size_t size;
+    };
+
+    struct Page {
+        VertexFormat format;
+        GLuint vao, depthVAO;
+        GLuint positionVBO, shadeVBO, skinVBO, ibo;
+        std::vector<Block> freeVertices;    // sorted by offset, in vertices
+        std::vector<Block> freeIndices;     // sorted by offset, in bytes
+    };
+
+    std::vector<Page> pages;
+    GLuint instanceVBO = 0;
+    size_t instanceCapacity = 0;
+
+    GeometryArena() {}
+    GeometryArena(const GeometryArena&) = delete;
+    GeometryArena& operator=(const GeometryArena&) = delete;
+
+    int createPage(VertexFormat format, size_t vertexCapacity, size_t indexCapacity)
+    {
+        Page page;
+        page.format = format;
+        page.skinVBO = 0;
+        page.freeVertices.push_back({ 0, vertexCapacity });
+        page.freeIndices.push_back({ 0, indexCapacity });
+
+        glGenBuffers(1, &page.positionVBO);
+        glBindBuffer(GL_ARRAY_BUFFER, page.positionVBO);
+        glBufferData(GL_ARRAY_BUFFER, vertexCapacity * sizeof(glm::vec3), NULL, GL_STATIC_DRAW);
+
+        glGenBuffers(1, &page.shadeVBO);
+        glBindBuffer(GL_ARRAY_BUFFER, page.shadeVBO);
+        glBufferData(GL_ARRAY_BUFFER, vertexCapacity * sizeof(ShadeVertex), NULL, GL_STATIC_DRAW);
+
+        if (format == VERTEX_FORMAT_SKINNED)
+        {
+            glGenBuffers(1, &page.skinVBO);
+            glBindBuffer(GL_ARRAY_BUFFER, page.skinVBO);
+            glBufferData(GL_ARRAY_BUFFER, vertexCapacity * sizeof(SkinVertex), NULL, GL_STATIC_DRAW);
+        }
+
+        glGenBuffers(1, &page.ibo);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, page.ibo);
+        glBufferData(GL_COPY_WRITE_BUFFER, indexCapacity, NULL, GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        // full VAO : position + shading (+ skinning)
+        glGenVertexArrays(1, &page.vao);
+        GLState::Get().BindVertexArray(page.vao);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, page.ibo);
+        setupPositionStream(page);
+        setupShadeStream(page);
+        setupSkinStream(page);
+        setupInstanceStream();
+
+        // depth VAO : position (+ skinning) only
+        glGenVertexArrays(1, &page.depthVAO);
+        GLState::Get().BindVertexArray(page.depthVAO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, page.ibo);
+        setupPositionStream(page);
+        setupSkinStream(page);
+        setupInstanceStream();
+
+        GLState::Get().BindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        pages.push_back(page);
+        return (int)pages.size() - 1;
+    }
+
+    void setupPositionStream(const Page& page)
+    {
+        // vertex positions
+        glBindBuffer(GL_ARRAY_BUFFER, page.positionVBO);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+    }
+
+    // firstVertex: vertex the stream starts at (stream VAOs); page VAOs start at 0
+    void setupShadeStream(const Page& page, size_t firstVertex = 0)
+    {
+        size_t base = firstVertex * sizeof(ShadeVertex);
+        glBindBuffer(GL_ARRAY_BUFFER, page.shadeVBO);
+        // vertex normals
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(ShadeVertex), (void*)(base + offsetof(ShadeVertex, Normal)));
+        // vertex texture coords
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(ShadeVertex), (void*)(base + offsetof(ShadeVertex, TexCoords)));
+        // vertex tangent
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(ShadeVertex), (void*)(base + offsetof(ShadeVertex, Tangent)));
+        // vertex bitangent
+        glEnableVertexAttribArray(4);
+        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(ShadeVertex), (void*)(base + offsetof(ShadeVertex, Bitangent)));
+    }
+
+    void setupSkinStream(const Page& page)
+    {
+        if (page.format != VERTEX_FORMAT_SKINNED)
+            return;
+        glBindBuffer(GL_ARRAY_BUFFER, page.skinVBO);
+        // ids
+        glEnableVertexAttribArray(5);
+        glVertexAttribIPointer(5, 4, GL_INT, sizeof(SkinVertex), (void*)offsetof(SkinVertex, m_BoneIDs));
+        // weights
+        glEnableVertexAttribArray(6);
+        glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(SkinVertex), (void*)offsetof(SkinVertex, m_Weights));
+    }
+
+    void setupInstanceStream()
+    {
+        if (instanceVBO == 0)
+        {
+            glGenBuffers(1, &instanceVBO);
+            instanceCapacity = 1;
+            glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+            glBufferData(GL_ARRAY_BUFFER, sizeof(glm::mat4), NULL, GL_STREAM_DRAW);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        // instance model matrix, one column per attribute
+        for (int i = 0; i < 4; i++)
+        {
+            glEnableVertexAttribArray(7 + i);
+            glVertexAttribDivisor(7 + i, 1);
+        }
+        pointInstanceStream(0);
+    }
+
+    // expects instanceVBO bound to GL_ARRAY_BUFFER
+    static void pointInstanceStream(size_t firstInstance)
+    {
+        for (int i = 0; i < 4; i++)
+            glVertexAttribPointer(7 + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+                (void*)(firstInstance * sizeof(glm::mat4) + i * sizeof(glm::vec4)));
+    }
+
+    static void upload(GLuint buffer, size_t offset, size_t size, const void* data)
+    {
+        if (size == 0 || data == NULL)
+            return;
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, offset, size, data);
+    }
+
+    // first fit
+    static bool allocateBlock(std::vector<Block>& freeList, size_t size, size_t& offset)
+    {
+        for (size_t i = 0; i < freeList.size(); i++)
+        {
+            if (freeList[i].size < size)
+                continue;
+            offset = freeList[i].offset;
+            freeList[i].offset += size;
+            freeList[i].size -= size;
+            if (freeList[i].size == 0)
+                freeList.erase(freeList.begin() + i);
+            return true;
+        }
+        return false;
+    }
+
+    // returns a block to the free list, merging it with its neighbours
+    static void releaseBlock(std::vector<Block>& freeList, size_t offset, size_t size)
+    {
+        if (size == 0)
+            return;
+        auto it = std::lower_bound(freeList.begin(), freeList.end(), offset,
+            [](const Block& block, size_t value) { return block.offset < value; });
+        it = freeList.insert(it, { offset, size });
+        if (it + 1 != freeList.end() && it->offset + it->size == (it + 1)->offset)
+        {
+            it->size += (it + 1)->size;
+            freeList.erase(it + 1);
+        }
+        if (it != freeList.begin() && (it - 1)->offset + (it - 1)->size == it->offset)
+        {
+            (it - 1)->size += it->size;
+            freeList.erase(it);
+        }
+    }
+};
+#endif
@@ -0,0 +1,171 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <glad/glad.h>
+
+// calls routed through GLState
+enum GLStateCall {
+    GL_STATE_USE_PROGRAM = 0,
+    GL_STATE_BIND_VERTEX_ARRAY,
+    GL_STATE_ACTIVE_TEXTURE,
+    GL_STATE_BIND_TEXTURE,
+    GL_STATE_VIEWPORT,
+    GL_STATE_BIND_FRAMEBUFFER,
+    GL_STATE_CALL_COUNT
+};
+
+struct GLStateStats {
+    int issued[GL_STATE_CALL_COUNT] = { 0 };   // reached the driver
+    int filtered[GL_STATE_CALL_COUNT] = { 0 }; // matched the tracked state and were dropped
+};
+
+// Thin shadow of the bind state the renderer touches every frame.
+// A call whose value matches the tracked state is not forwarded to GL.
+// Code that changes this state behind the tracker's back (ImGui backend, raw gl calls)
+// must be followed by Invalidate(), after which the next call of every kind is issued.
+class GLState
+{
+public:
+    static const int MAX_TEXTURE_UNITS = 16;
+
+    static GLState& Get()
+    {
+        static GLState instance;
+        return instance;
+    }
+
+    void UseProgram(GLuint program)
+    {
+        if (program == this->program) {
+            stats.filtered[GL_STATE_USE_PROGRAM]++;
+            return;
+        }
+        glUseProgram(program);
+        this->program = program;
+        stats.issued[GL_STATE_USE_PROGRAM]++;
+    }
+
+    void BindVertexArray(GLuint vao)
+    {
+        if (vao == vertexArray) {
+            stats.filtered[GL_STATE_BIND_VERTEX_ARRAY]++;
+            return;
+        }
+        glBindVertexArray(vao);
+        vertexArray = vao;
+        stats.issued[GL_STATE_BIND_VERTEX_ARRAY]++;
+    }
+
+    void ActiveTexture(GLuint unit)
+    {
+        if (unit == activeUnit) {
+            stats.filtered[GL_STATE_ACTIVE_TEXTURE]++;
+            return;
+        }
+        glActiveTexture(GL_TEXTURE0 + unit);
+        activeUnit = unit;
+        stats.issued[GL_STATE_ACTIVE_TEXTURE]++;
+    }
+
+    // binds to the active unit
+    void BindTexture(GLenum target, GLuint texture)
+    {
+        GLuint* bound = slot(activeUnit, target);
+        if (bound && *bound == texture) {
+            stats.filtered[GL_STATE_BIND_TEXTURE]++;
+            return;
+        }
+        glBindTexture(target, texture);
+        if (bound)
+            *bound = texture;
+        stats.issued[GL_STATE_BIND_TEXTURE]++;
+    }
+
+    // binds to the given unit, switching the active unit only when the binding changes
+    void BindTexture(GLuint unit, GLenum target, GLuint texture)
+    {
+        GLuint* bound = slot(unit, target);
+        if (bound && *bound == texture) {
+            stats.filtered[GL_STATE_BIND_TEXTURE]++;
+            return;
+        }
+        ActiveTexture(unit);
+        BindTexture(target, texture);
+    }
+
+    void Viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+    {
+        if (viewportValid && viewport[0] == x && viewport[1] == y && viewport[2] == width && viewport[3] == height) {
+            stats.filtered[GL_STATE_VIEWPORT]++;
+            return;
+        }
+        glViewport(x, y, width, height);
+        viewport[0] = x;
+        viewport[1] = y;
+        viewport[2] = width;
+        viewport[3] = height;
+        viewportValid = true;
+        stats.issued[GL_STATE_VIEWPORT]++;
+    }
+
+    // GL_FRAMEBUFFER only (draw + read)
+    void BindFramebuffer(GLuint fbo)
+    {
+        if (fbo == framebuffer) {
+            stats.filtered[GL_STATE_BIND_FRAMEBUFFER]++;
+            return;
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        framebuffer = fbo;
+        stats.issued[GL_STATE_BIND_FRAMEBUFFER]++;
+    }
+
+    // forget everything, the next call of each kind reaches GL
+    void Invalidate()
+    {
+        program = UNKNOWN;
+        vertexArray = UNKNOWN;
+        activeUnit = UNKNOWN;
+        framebuffer = UNKNOWN;
+        viewportValid = false;
+        for (int unit = 0; unit < MAX_TEXTURE_UNITS; unit++)
+            for (int target = 0; target < TARGET_COUNT; target++)
+                textures[unit][target] = UNKNOWN;
+    }
+
+    // counts since the last ResetStats (once per frame)
+    const GLStateStats& Stats() const { return stats; }
+    void ResetStats() { stats = GLStateStats(); }
+
+private:
+    static const GLuint UNKNOWN = ~0u;
+    enum { TARGET_2D = 0, TARGET_2D_ARRAY, TARGET_CUBE_MAP, TARGET_BUFFER, TARGET_COUNT };
+
+    GLuint program;
+    GLuint vertexArray;
+    GLuint activeUnit;
+    GLuint framebuffer;
+    GLint viewport[4];
+    bool viewportValid;
+    GLuint textures[MAX_TEXTURE_UNITS][TARGET_COUNT];
+    GLStateStats stats;
+
+    GLState() { Invalidate(); }
+    GLState(const GLState&) = delete;
+    GLState& operator=(const GLState&) = delete;
+
+    // tracked binding of a unit/target, nullptr for untracked ones (always issued)
+    GLuint* slot(GLuint unit, GLenum target)
+    {
+        if (unit >= MAX_TEXTURE_UNITS)
+            return nullptr;
+        switch (target) {
+        case GL_TEXTURE_2D: return &textures[unit][TARGET_2D];
+        case GL_TEXTURE_2D_ARRAY: return &textures[unit][TARGET_2D_ARRAY];
+        case GL_TEXTURE_CUBE_MAP: return &textures[unit][TARGET_CUBE_MAP];
+        case GL_TEXTURE_BUFFER: return &textures[unit][TARGET_BUFFER];
+        default: return nullptr;
+        }
+    }
+};
+#endif
@@ -0,0 +1,198 @@
+#ifndef HI_Z_H
+#define HI_Z_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <spdlog/spdlog.h>
+
+#include "shader_m.h"
+#include "gl_state.h"
+#include "bounds.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Hierarchical depth buffer for occlusion culling.
+// Occluders are drawn depth only into a reduced resolution target, which is reduced into an
+// R32F mip chain keeping the farthest depth of every 2x2 block. The coarse levels are read back
+// so objects can be tested on the CPU before their packets are built: an object is occluded when
+// its nearest depth lies behind the farthest occluder depth of every texel its screen rectangle
+// touches. Only GL 3.3 core is used (fragment shader reduction, glGetTexImage), so it runs on
+// software rasterizers like Mesa llvmpipe as well.
+class HiZBuffer
+{
+public:
+    // width / height of the occluder target; levels from readbackLevel up are copied to the CPU
+    void Init(int width, int height, int readbackLevel = 2)
+    {
+        this->width = width;
+        this->height = height;
+        levelCount = 1;
+        while ((width >> levelCount) > 0 || (height >> levelCount) > 0)
+            levelCount++;
+        this->readbackLevel = std::min(readbackLevel, levelCount - 1);
+
+        reduceShader = Shader("./shader/fullscreen.vs", "./shader/hi_z.fs");
+        reduceShader.use();
+        reduceShader.setInt("source", 0);
+
+        // occluder depth
+        glGenTextures(1, &depthTexture);
+        GLState::Get().BindTexture(GL_TEXTURE_2D, depthTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_NONE);
+        glGenFramebuffers(1, &occluderFBO);
+        GLState::Get().BindFramebuffer(occluderFBO);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+
+        // farthest depth pyramid
+        glGenTextures(1, &pyramid);
+        GLState::Get().BindTexture(GL_TEXTURE_2D, pyramid);
+        for (int level = 0; level < levelCount; level++)
+            glTexImage2D(GL_TEXTURE_2D, level, GL_R32F, LevelWidth(level), LevelHeight(level), 0, GL_RED, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+        glGenFramebuffers(1, &reduceFBO);
+        GLState::Get().BindFramebuffer(reduceFBO);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, pyramid, 0);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            SPDLOG_ERROR("Hi-Z framebuffer incomplete");
+        GLState::Get().BindFramebuffer(0);
+
+        // the fullscreen triangle comes from gl_VertexID, core profile still wants a VAO
+        glGenVertexArrays(1, &emptyVAO);
+
+        levels.resize(levelCount);
+        for (int level = this->readbackLevel; level < levelCount; level++)
+            levels[level].assign((size_t)LevelWidth(level) * LevelHeight(level), 1.0f);
+    }
+
+    // starts a frame's occluders: everything at the far plane
+    void ClearOccluders()
+    {
+        BindOccluders();
+        glClear(GL_DEPTH_BUFFER_BIT);
+        ready = false;
+    }
+
+    // render target of the occluder pass
+    void BindOccluders()
+    {
+        GLState::Get().BindFramebuffer(occluderFBO);
+        GLState::Get().Viewport(0, 0, width, height);
+    }
+
+    // reduces the occluder depth into the pyramid and reads the coarse levels back.
+    // the readback waits for the occluder pass; it is small (levels >= readbackLevel)
+    void Build()
+    {
+        GLState& gl = GLState::Get();
+        reduceShader.use();
+        gl.BindVertexArray(emptyVAO);
+        gl.BindFramebuffer(reduceFBO);
+        glDisable(GL_DEPTH_TEST);
+        for (int level = 0; level < levelCount; level++)
+        {
+            if (level == 0)
+            {
+                gl.BindTexture(0, GL_TEXTURE_2D, depthTexture);
+            }
+            else
+            {
+                // only the previous level is visible to the shader, so reading it while writing
+                // this one is not a feedback loop
+                gl.BindTexture(0, GL_TEXTURE_2D, pyramid);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level - 1);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level - 1);
+            }
+            reduceShader.setBool("reduce", level > 0);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, pyramid, level);
+            gl.Viewport(0, 0, LevelWidth(level), LevelHeight(level));
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+        }
+        glEnable(GL_DEPTH_TEST);
+
+        gl.BindTexture(0, GL_TEXTURE_2D, pyramid);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        for (int level = readbackLevel; level < levelCount; level++)
+            glGetTexImage(GL_TEXTURE_2D, level, GL_RED, GL_FLOAT, levels[level].data());
+        ready = true;
+    }
+
+    // world space box against the pyramid; boxes crossing the near plane are never occluded
+    bool IsOccluded(const AABB& box, const glm::mat4& viewProjection) const
+    {
+        if (!ready || !box.Valid())
+            return false;
+
+        glm::vec2 ndcMin(1.0f), ndcMax(-1.0f);
+        float nearestDepth = 1.0f;
+        for (int i = 0; i < 8; i++)
+        {
+            glm::vec3 corner((i & 1) ? box.max.x : box.min.x, (i & 2) ? box.max.y : box.min.y, (i & 4) ? box.max.z : box.min.z);
+            glm::vec4 clip = viewProjection * glm::vec4(corner, 1.0f);
+            if (clip.w <= 1e-4f)
+                return false;
+            glm::vec3 ndc = glm::vec3(clip) / clip.w;
+            ndcMin = glm::min(ndcMin, glm::vec2(ndc));
+            ndcMax = glm::max(ndcMax, glm::vec2(ndc));
+            nearestDepth = std::min(nearestDepth, ndc.z * 0.5f + 0.5f);
+        }
+        if (ndcMax.x < -1.0f || ndcMax.y < -1.0f || ndcMin.x > 1.0f || ndcMin.y > 1.0f)
+            return false; // off screen, nothing to test against (the frustum test handles it)
+
+        // rectangle in level 0 texels
+        int x0 = texel(ndcMin.x, width), x1 = texel(ndcMax.x, width);
+        int y0 = texel(ndcMin.y, height), y1 = texel(ndcMax.y, height);
+
+        // finest level where the rectangle covers at most 2x2 texels
+        int level = readbackLevel;
+        while (level < levelCount - 1 && ((x1 >> level) - (x0 >> level) > 1 || (y1 >> level) - (y0 >> level) > 1))
+            level++;
+
+        int levelWidth = LevelWidth(level), levelHeight = LevelHeight(level);
+        const std::vector<float>& depth = levels[level];
+        float farthest = 0.0f;
+        for (int y = std::min(y0 >> level, levelHeight - 1); y <= std::min(y1 >> level, levelHeight - 1); y++)
+            for (int x = std::min(x0 >> level, levelWidth - 1); x <= std::min(x1 >> level, levelWidth - 1); x++)
+                farthest = std::max(farthest, depth[(size_t)y * levelWidth + x]);
+        return nearestDepth > farthest;
+    }
+
+    int Width() const { return width; }
+    int Height() const { return height; }
+    int LevelCount() const { return levelCount; }
+    int ReadbackLevel() const { return readbackLevel; }
+    int LevelWidth(int level) const { return std::max(1, width >> level); }
+    int LevelHeight(int level) const { return std::max(1, height >> level); }
+    GLuint Pyramid() const { return pyramid; }
+
+private:
+    int width = 0, height = 0;
+    int levelCount = 0;
+    int readbackLevel = 0;
+    Shader reduceShader;
+    GLuint depthTexture = 0;
+    GLuint occluderFBO = 0;
+    GLuint pyramid = 0;
+    GLuint reduceFBO = 0;
+    GLuint emptyVAO = 0;
+    std::vector<std::vector<float>> levels;   // CPU copies of levels >= readbackLevel
+    bool ready = false;
+
+    static int texel(float ndc, int size)
+    {
+        float t = (glm::clamp(ndc, -1.0f, 1.0f) * 0.5f + 0.5f) * (float)size;
+        return std::min((int)t, size - 1);
+    }
+};
+#endif
@@ -0,0 +1,392 @@
+#ifndef LIGHT_CLUSTERS_H
+#define LIGHT_CLUSTERS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "shader_m.h"
+#include "gl_state.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LIGHT_CLUSTERS_SSE 1
+#include <emmintrin.h>
+#endif
+
+struct PointLight {
+    glm::vec3 position = glm::vec3(0.0f);
+    glm::vec3 ambient = glm::vec3(0.0f);
+    glm::vec3 diffuse = glm::vec3(1.0f);
+    glm::vec3 specular = glm::vec3(1.0f);
+    float constant = 1.0f;
+    float linear = 0.022f;
+    float quadratic = 0.0019f;
+
+    // distance where the attenuation of the brightest channel falls below 5/256.
+    // lighting.fs fades the light out towards this radius, so nothing is lost by culling at it
+    float Radius() const
+    {
+        float intensity = std::max(std::max(std::max(diffuse.r, diffuse.g), diffuse.b),
+            std::max(std::max(ambient.r, ambient.g), ambient.b));
+        float c = constant - intensity * (256.0f / 5.0f);
+        if (c >= 0.0f)
+            return 0.0f;
+        if (quadratic <= 0.0f)
+            return linear > 0.0f ? -c / linear : 0.0f;
+        return (-linear + std::sqrt(linear * linear - 4.0f * quadratic * c)) / (2.0f * quadratic);
+    }
+};
+
+struct LightClusterStats {
+    int lights = 0;             // lights touching at least one cluster (uploaded)
+    int references = 0;         // length of the light index list
+    int activeClusters = 0;     // clusters with at least one light
+    int maxPerCluster = 0;
+    int overflow = 0;           // references dropped at kMaxLightsPerCluster
+    float buildMilliseconds = 0.0f;
+};
+
+// Clustered forward shading (Olsson et al.).
+// The view frustum is split into kGridX x kGridY screen tiles and kGridZ exponential depth
+// slices. Every frame the lights are assigned to the clusters their sphere overlaps on the
+// CPU - per light bounds in parallel, then one depth slice per job so no two threads write
+// the same cluster - and the result goes to the GPU as three texture buffers:
+//   lightData    RGBA32F, 4 texels per light (position/radius, diffuse/constant, specular/linear, ambient/quadratic)
+//   clusterGrid  RG32UI, first index / light count per cluster
+//   lightIndices R16UI, the concatenated per cluster lists
+// lighting.fs finds its cluster from gl_FragCoord and loops over that list only.
+// The cluster boxes are separable - a tile column's x range depends only on the slice, a row's
+// y range likewise - so a sphere test is dx^2 + dy^2 + dz^2 with dx^2 for four columns per SSE op.
+class LightClusters
+{
+public:
+    // must match the constants in lighting.fs
+    static const int kGridX = 16;
+    static const int kGridY = 9;
+    static const int kGridZ = 24;
+    static const int kClusterCount = kGridX * kGridY * kGridZ;
+    static const int kMaxLightsPerCluster = 256;
+    static const int kMaxLights = 65535;    // 16 bit indices
+    static_assert(kGridX % 4 == 0, "columns are tested four at a time");
+
+    void Init()
+    {
+        glGenBuffers(3, buffers);
+        glGenTextures(3, textures);
+        const GLenum formats[3] = { GL_RGBA32F, GL_RG32UI, GL_R16UI };
+        for (int i = 0; i < 3; i++)
+        {
+            glBindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+            glBufferData(GL_TEXTURE_BUFFER, 16, NULL, GL_STREAM_DRAW);
+            GLState::Get().BindTexture(GL_TEXTURE_BUFFER, textures[i]);
+            glTexBuffer(GL_TEXTURE_BUFFER, formats[i], buffers[i]);
+        }
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+        clusterLights.resize((size_t)kClusterCount * kMaxLightsPerCluster);
+        clusterCounts.resize(kClusterCount);
+        gridData.resize((size_t)kClusterCount * 2);
+    }
+
+    // assigns the lights for this camera and uploads the buffers.
+    // fovY in radians; near / far / size must be the ones of the main pass projection.
+    // without assignClusters only the visible light list is built (every cluster stays empty)
+    void Build(const std::vector<PointLight>& lights, const glm::mat4& view, float fovY, float aspect,
+        float nearPlane, float farPlane, int screenWidth, int screenHeight, bool assignClusters = true)
+    {
+        auto start = std::chrono::steady_clock::now();
+        stats = LightClusterStats();
+        updateGrid(fovY, aspect, nearPlane, farPlane, screenWidth, screenHeight);
+
+        // 1. view space sphere and cluster range of every light
+        int lightCount = std::min((int)lights.size(), kMaxLights);
+        bounds.resize(lightCount);
+        ThreadPool::Get().ParallelFor(lightCount, 256, [&](int begin, int end) {
+            for (int i = begin; i < end; i++)
+                bounds[i] = lightBounds(lights[i], view);
+        });
+
+        // only lights that reach a cluster are uploaded, indices refer to this compacted list
+        lightData.clear();
+        for (int i = 0; i < lightCount; i++)
+        {
+            if (bounds[i].z0 > bounds[i].z1)
+                continue;
+            bounds[i].index = (uint16_t)(lightData.size() / 4);
+            const PointLight& light = lights[i];
+            lightData.push_back(glm::vec4(light.position, bounds[i].radius));
+            lightData.push_back(glm::vec4(light.diffuse, light.constant));
+            lightData.push_back(glm::vec4(light.specular, light.linear));
+            lightData.push_back(glm::vec4(light.ambient, light.quadratic));
+        }
+        stats.lights = (int)lightData.size() / 4;
+
+        // 2. per depth slice, sphere / cluster tests
+        int sliceOverflow[kGridZ] = { 0 };
+        if (!assignClusters)
+            std::fill(clusterCounts.begin(), clusterCounts.end(), 0);
+        else ThreadPool::Get().ParallelFor(kGridZ, 1, [&](int begin, int end) {
+            for (int slice = begin; slice < end; slice++)
+                sliceOverflow[slice] = assignSlice(slice, lightCount);
+        });
+
+        // 3. concatenate the lists
+        indices.clear();
+        for (int cluster = 0; cluster < kClusterCount; cluster++)
+        {
+            int count = clusterCounts[cluster];
+            gridData[cluster * 2] = (uint32_t)indices.size();
+            gridData[cluster * 2 + 1] = (uint32_t)count;
+            const uint16_t* list = &clusterLights[(size_t)cluster * kMaxLightsPerCluster];
+            indices.insert(indices.end(), list, list + count);
+            stats.activeClusters += count > 0;
+            stats.maxPerCluster = std::max(stats.maxPerCluster, count);
+        }
+        for (int slice = 0; slice < kGridZ; slice++)
+            stats.overflow += sliceOverflow[slice];
+        stats.references = (int)indices.size();
+
+        upload(0, lightData.data(), lightData.size() * sizeof(glm::vec4));
+        upload(1, gridData.data(), gridData.size() * sizeof(uint32_t));
+        upload(2, indices.data(), indices.size() * sizeof(uint16_t));
+
+        stats.buildMilliseconds = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // grid parameters of the last Build; the sampler units are set once by the caller
+    void SetUniforms(const Shader& shader) const
+    {
+        shader.setVec2("clusterTileSize", (float)tileWidth, (float)tileHeight);
+        shader.setFloat("clusterNear", nearPlane);
+        shader.setFloat("clusterFar", farPlane);
+    }
+
+    void Bind(GLuint lightDataUnit, GLuint clusterGridUnit, GLuint lightIndexUnit) const
+    {
+        GLState::Get().BindTexture(lightDataUnit, GL_TEXTURE_BUFFER, textures[0]);
+        GLState::Get().BindTexture(clusterGridUnit, GL_TEXTURE_BUFFER, textures[1]);
+        GLState::Get().BindTexture(lightIndexUnit, GL_TEXTURE_BUFFER, textures[2]);
+    }
+
+    const LightClusterStats& Stats() const { return stats; }
+
+private:
+    // cluster range of a light, empty (z0 > z1) when it touches no cluster
+    struct LightBounds {
+        glm::vec3 center;   // view space
+        float radius;
+        int x0, x1, y0, y1, z0, z1;
+        uint16_t index;     // in the uploaded light list
+    };
+
+    GLuint buffers[3] = { 0 };
+    GLuint textures[3] = { 0 };
+
+    // grid of the current projection
+    float fovY = 0.0f, aspect = 0.0f, nearPlane = 0.0f, farPlane = 0.0f;
+    int screenWidth = 0, screenHeight = 0;
+    int tileWidth = 1, tileHeight = 1;
+    float tanHalfX = 1.0f, tanHalfY = 1.0f;
+    float sliceScale = 1.0f;                        // slices per unit of log(depth / near)
+    float sliceDepth[kGridZ + 1];                   // slice boundaries (positive view depth)
+    alignas(16) float columnMin[kGridZ][kGridX];    // view space x range of a tile column in a slice
+    alignas(16) float columnMax[kGridZ][kGridX];
+    float rowMin[kGridZ][kGridY];                   // view space y range of a tile row
+    float rowMax[kGridZ][kGridY];
+
+    std::vector<LightBounds> bounds;
+    std::vector<uint16_t> clusterLights;            // kMaxLightsPerCluster slots per cluster
+    std::vector<int> clusterCounts;
+    std::vector<glm::vec4> lightData;
+    std::vector<uint32_t> gridData;
+    std::vector<uint16_t> indices;
+    LightClusterStats stats;
+
+    void updateGrid(float fovY, float aspect, float nearPlane, float farPlane, int screenWidth, int screenHeight)
+    {
+        if (fovY == this->fovY && aspect == this->aspect && nearPlane == this->nearPlane && farPlane == this->farPlane
+            && screenWidth == this->screenWidth && screenHeight == this->screenHeight)
+            return;
+        this->fovY = fovY;
+        this->aspect = aspect;
+        this->nearPlane = nearPlane;
+        this->farPlane = farPlane;
+        this->screenWidth = screenWidth;
+        this->screenHeight = screenHeight;
+        tileWidth = std::max(1, (screenWidth + kGridX - 1) / kGridX);
+        tileHeight = std::max(1, (screenHeight + kGridY - 1) / kGridY);
+        tanHalfY = std::tan(fovY * 0.5f);
+        tanHalfX = tanHalfY * aspect;
+        sliceScale = (float)kGridZ / std::log(farPlane / nearPlane);
+
+        for (int z = 0; z <= kGridZ; z++)
+            sliceDepth[z] = nearPlane * std::pow(farPlane / nearPlane, (float)z / kGridZ);
+        // a tile edge at ndc n is the plane x = n * tanHalfX * depth; the box spans both ends of the slice
+        auto ndc = [](int tile, int tileSize, int screenSize) { return 2.0f * (float)(tile * tileSize) / (float)screenSize - 1.0f; };
+        for (int z = 0; z < kGridZ; z++)
+        {
+            float d0 = sliceDepth[z], d1 = sliceDepth[z + 1];
+            for (int x = 0; x < kGridX; x++)
+            {
+                float a = ndc(x, tileWidth, screenWidth) * tanHalfX, b = ndc(x + 1, tileWidth, screenWidth) * tanHalfX;
+                columnMin[z][x] = std::min(a * d0, a * d1);
+                columnMax[z][x] = std::max(b * d0, b * d1);
+            }
+            for (int y = 0; y < kGridY; y++)
+            {
+                float a = ndc(y, tileHeight, screenHeight) * tanHalfY, b = ndc(y + 1, tileHeight, screenHeight) * tanHalfY;
+                rowMin[z][y] = std::min(a * d0, a * d1);
+                rowMax[z][y] = std::max(b * d0, b * d1);
+            }
+        }
+    }
+
+    int sliceOf(float depth) const
+    {
+        if (depth <= nearPlane)
+            return 0;
+        return std::min((int)(std::log(depth / nearPlane) * sliceScale), kGridZ - 1);
+    }
+
+    int tileOf(float ndc, int tileSize, int screenSize, int gridSize) const
+    {
+        float pixel = (glm::clamp(ndc, -1.0f, 1.0f) * 0.5f + 0.5f) * (float)screenSize;
+        return std::min((int)(pixel / (float)tileSize), gridSize - 1);
+    }
+
+    LightBounds lightBounds(const PointLight& light, const glm::mat4& view) const
+    {
+        LightBounds b;
+        b.center = glm::vec3(view * glm::vec4(light.position, 1.0f));
+        b.radius = light.Radius();
+        b.index = 0;
+        b.x0 = b.y0 = b.z0 = 1;
+        b.x1 = b.y1 = b.z1 = 0;
+
+        // the camera looks down -z
+        float depth = -b.center.z;
+        float nearest = depth - b.radius, farthest = depth + b.radius;
+        if (b.radius <= 0.0f || farthest < nearPlane || nearest > farPlane)
+            return b;
+        nearest = std::max(nearest, nearPlane);
+        farthest = std::min(farthest, farPlane);
+
+        // screen rectangle of the sphere's box between its near and far depth:
+        // x / depth is monotonic in depth, so the extremes are at the corners
+        float ndcMinX = 1e30f, ndcMaxX = -1e30f, ndcMinY = 1e30f, ndcMaxY = -1e30f;
+        for (int i = 0; i < 4; i++)
+        {
+            float d = (i & 1) ? farthest : nearest;
+            float side = (i & 2) ? b.radius : -b.radius;
+            float x = (b.center.x + side) / (d * tanHalfX);
+            float y = (b.center.y + side) / (d * tanHalfY);
+            ndcMinX = std::min(ndcMinX, x); ndcMaxX = std::max(ndcMaxX, x);
+            ndcMinY = std::min(ndcMinY, y); ndcMaxY = std::max(ndcMaxY, y);
+        }
+        if (ndcMaxX < -1.0f || ndcMinX > 1.0f || ndcMaxY < -1.0f || ndcMinY > 1.0f)
+            return b;
+
+        b.x0 = tileOf(ndcMinX, tileWidth, screenWidth, kGridX);
+        b.x1 = tileOf(ndcMaxX, tileWidth, screenWidth, kGridX);
+        b.y0 = tileOf(ndcMinY, tileHeight, screenHeight, kGridY);
+        b.y1 = tileOf(ndcMaxY, tileHeight, screenHeight, kGridY);
+        b.z0 = sliceOf(nearest);
+        b.z1 = sliceOf(farthest);
+        return b;
+    }
+
+    // fills the clusters of one slice, returns the number of dropped references
+    int assignSlice(int slice, int lightCount)
+    {
+        int overflow = 0;
+        int* counts = &clusterCounts[(size_t)slice * kGridY * kGridX];
+        std::fill(counts, counts + kGridY * kGridX, 0);
+        alignas(16) float dx2[kGridX];
+
+        for (int i = 0; i < lightCount; i++)
+        {
+            const LightBounds& b = bounds[i];
+            if (slice < b.z0 || slice > b.z1)
+                continue;
+            float r2 = b.radius * b.radius;
+            float depth = -b.center.z;
+            float dz = std::max(std::max(sliceDepth[slice] - depth, depth - sliceDepth[slice + 1]), 0.0f);
+            float remaining = r2 - dz * dz;
+            if (remaining < 0.0f)
+                continue;
+
+            // squared x distance to every column of the range
+            int first = b.x0 & ~3;
+#ifdef LIGHT_CLUSTERS_SSE
+            const __m128 cx = _mm_set1_ps(b.center.x), zero = _mm_setzero_ps();
+            for (int x = first; x <= b.x1; x += 4)
+            {
+                __m128 d = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_load_ps(&columnMin[slice][x]), cx),
+                    _mm_sub_ps(cx, _mm_load_ps(&columnMax[slice][x]))), zero);
+                _mm_store_ps(dx2 + x, _mm_mul_ps(d, d));
+            }
+#else
+            for (int x = first; x <= b.x1; x++)
+            {
+                float d = std::max(std::max(columnMin[slice][x] - b.center.x, b.center.x - columnMax[slice][x]), 0.0f);
+                dx2[x] = d * d;
+            }
+#endif
+
+            for (int y = b.y0; y <= b.y1; y++)
+            {
+                float dy = std::max(std::max(rowMin[slice][y] - b.center.y, b.center.y - rowMax[slice][y]), 0.0f);
+                float rowRemaining = remaining - dy * dy;
+                if (rowRemaining < 0.0f)
+                    continue;
+                int* rowCounts = counts + y * kGridX;
+                uint16_t* rowLights = &clusterLights[((size_t)slice * kGridY + y) * kGridX * kMaxLightsPerCluster];
+#ifdef LIGHT_CLUSTERS_SSE
+                const __m128 limit = _mm_set1_ps(rowRemaining);
+                for (int x = first; x <= b.x1; x += 4)
+                {
+                    int mask = _mm_movemask_ps(_mm_cmple_ps(_mm_load_ps(dx2 + x), limit));
+                    for (int lane = 0; mask && lane < 4; lane++)
+                    {
+                        int column = x + lane;
+                        if (!(mask & (1 << lane)) || column < b.x0 || column > b.x1)
+                            continue;
+                        if (rowCounts[column] < kMaxLightsPerCluster)
+                            rowLights[(size_t)column * kMaxLightsPerCluster + rowCounts[column]++] = b.index;
+                        else
+                            overflow++;
+                    }
+                }
+#else
+                for (int column = b.x0; column <= b.x1; column++)
+                {
+                    if (dx2[column] > rowRemaining)
+                        continue;
+                    if (rowCounts[column] < kMaxLightsPerCluster)
+                        rowLights[(size_t)column * kMaxLightsPerCluster + rowCounts[column]++] = b.index;
+                    else
+                        overflow++;
+                }
+#endif
+            }
+        }
+        return overflow;
+    }
+
+    // orphans the buffer's store each frame so the upload never waits for the last frame's draws
+    void upload(int buffer, const void* data, size_t size)
+    {
+        glBindBuffer(GL_TEXTURE_BUFFER, buffers[buffer]);
+        glBufferData(GL_TEXTURE_BUFFER, std::max(size, (size_t)16), NULL, GL_STREAM_DRAW);
+        if (size > 0)
+            glBufferSubData(GL_TEXTURE_BUFFER, 0, size, data);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+};
+#endif
@@ -10,7 +10,20 @@
 // #include "model.h"
 #include "animator.h"
 #include "model_animation.h"
+#include "render_queue.h"
+#include "frustum.h"
+#include "scene.h"
+#include "hi_z.h"
+#include "light_clusters.h"
+#include "deferred.h"
+#include "cascaded_shadow.h"
+#include "shader_library.h"
+#include "cpu_skinning.h"
+#include "skinning_cache.h"
+#include "baked_animation.h"
 #include <glm/gtx/string_cast.hpp>
+#include <random>
+#include <chrono>
 
 using namespace std;
 
@@ -27,10 +40,7 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 
-void renderCube();
-void renderQuad();
-void renderScene(const Shader &shader);
-void renderOurModel();
+const float* GetCubeVertices();
 
 // clear color
 glm::vec4 m_clearColor { glm::vec4(0.3f, 0.35f, 0.4f, 0.0f) };
@@ -58,12 +68,51 @@ glm::vec2 m_prevMousePos { glm::vec2(0.0f) };
 Shader lightingShader; // 물체를 그리는 쉐이더프로그램 
 Shader lightCubeShader; // 광원을 그리는 쉐이더프로그램
 Shader simpleDepthShader;
+Shader occluderDepthShader; // simpleDepthShader 프로그램을 카메라 행렬로 (Hi-Z occluder pass, depth prepass)
 Shader debugDepthQuad;
 Shader shader; // 그림자 셰이더
 Shader ourShader; // 애니메이션 모델 셰이더
 Shader normalShader; // 노말 매핑 셰이더
+// SKINNING 0 variants of the skinning programs: meshes without a skin stream never read the
+// bone palette (ShaderForFormat picks the variant from the mesh's vertex format)
+Shader staticDepthShader;
+Shader staticOccluderDepthShader;
+Shader staticModelShader;
 //std::unique_ptr<Shader> lightingShader;
 Model ourModel;
+// where ourModel is skinned: in every pass's shader, once per frame by transform feedback
+// (SkinningCache) or on the CPU (e.g. for software GL)
+enum SkinningMode {
+    SKINNING_MODE_SHADER = 0,
+    SKINNING_MODE_FEEDBACK,
+    SKINNING_MODE_CPU
+};
+int m_skinningMode = SKINNING_MODE_FEEDBACK;
+CpuSkinning m_cpuSkinning;
+SkinningCache m_skinningCache;
+int m_shaderSkinnedVertices = 0;    // blended by the pass shaders this frame, all passes
+GLuint PreSkinnedVAO(const Mesh& mesh, bool depthOnly);
+
+// background crowd: instances of ourModel animated in the vertex shader from the baked bone
+// texture, with no Animator per instance. the last row of each instance matrix carries
+// (clip, time offset in seconds, play rate), see the BAKED_ANIMATION variants of the shaders
+const int BAKED_BONES_UNIT = 12;
+BakedAnimation m_bakedAnimation;
+Shader crowdShader;         // anim_model, main pass
+Shader crowdDepthShader;    // shadow cascades
+Shader crowdPrepassShader;  // depth prepass
+int m_crowdCount = 0;
+float m_crowdSpacing = 1.0f;
+bool m_crowdShadows = false;
+float m_crowdTime = 0.0f;
+std::vector<glm::mat4> m_crowdInstances;
+AABB m_crowdBounds;
+// count / spacing m_crowdInstances was built for
+int m_crowdBuiltCount = -1;
+float m_crowdBuiltSpacing = 0.0f;
+// one level for the whole crowd, picked from the distance to m_crowdBounds (PickLod)
+int m_crowdLod = 0;
+void UpdateCrowd();
 
 Animation danceAnimation;
 Animator animator;
@@ -81,15 +130,180 @@ unsigned int VBO;
 // unsigned int VBO, cubeVAO;
 unsigned int lightCubeVAO;
 
-// shadow
-unsigned int depthMapFBO;
-// unsigned int depthMap;
-const unsigned int SHADOW_WIDTH = 1024, SHADOW_HEIGHT = 1024;
-
-// meshes
-unsigned int planeVAO;
+// shadow: 4 cascades of 512 x 512, the memory of the former single 1024 x 1024 map
+const int SHADOW_CASCADE_SIZE = 512;
+CascadedShadowMap m_shadowMap;
+bool m_showCascades = false;
+// shadow filter kernel (SHADOW_FILTER in shadow_mapping.fs): 1, 4, 9 taps or a Poisson disc
+int m_shadowQuality = 1;
+const char* m_shadowQualityNames[] = { "1 tap", "4 taps", "9 taps", "poisson (8 taps)" };
+
+// program variants (ShaderLibrary) behind the Shader globals, picked from the feature switches
+bool m_normalMapping = true;
+void RegisterShaders();
+void SelectShaderVariants();
+static_assert(RENDER_PASS_SHADOW_LAST - RENDER_PASS_SHADOW + 1 == CascadedShadowMap::kCascadeCount, "one shadow pass per cascade");
+static_assert(RENDER_PASS_SHADOW_CACHE_LAST - RENDER_PASS_SHADOW_CACHE + 1 == CascadedShadowMap::kCascadeCount, "one cache pass per cascade");
+
+// meshes - hand-built geometry lives in the arena like the model meshes
+Mesh floorMesh;
+Mesh brickMesh;
+Mesh cubeMesh;
 unsigned int woodTexture;
-unsigned int depthMap;
+// shadow map is bound once per frame to a unit no material uses
+const int SHADOW_MAP_UNIT = 8;
+
+// what a scene node draws; nodes refer to these by index (Scene user data)
+struct SceneDrawable {
+    Mesh* mesh = nullptr;               // a single arena mesh
+    Model* model = nullptr;             // or every mesh of a model
+    const Animation* clip = nullptr;    // skinned model bounds come from the clip
+    const Shader* shader = nullptr;     // main pass program
+    bool castShadow = true;
+    bool dynamic = false;               // moves / deforms every frame: never in the static shadow cache
+    vector<float> lodErrors;            // per LOD level, largest error over the meshes
+};
+enum SceneDrawableId {
+    DRAWABLE_FLOOR = 0,
+    DRAWABLE_BRICK,
+    DRAWABLE_CUBE,
+    DRAWABLE_CHARACTER,
+    DRAWABLE_COUNT
+};
+SceneDrawable m_drawables[DRAWABLE_COUNT];
+const char* m_drawableNames[DRAWABLE_COUNT] = { "floor", "brick wall", "container", "character" };
+
+Scene m_scene;
+int m_cubeFieldNode = -1;
+int m_characterGroupNode = -1;
+std::vector<int> m_cubeNodes;
+std::vector<int> m_characterNodes;
+void BuildScene();
+
+// container field - many small static objects for the batched submission path
+int m_cubeCount = 1000;
+glm::vec3 m_cubeFieldOffset(0.0f);
+void UpdateCubeField();
+
+// sorted draw submission
+RenderQueue m_renderQueue;
+void QueueMesh(RenderPass pass, const Shader& shader, Mesh& mesh, const glm::mat4& world, bool depthOnly,
+    int lod = 0, const glm::mat4* instances = nullptr, GLsizei instanceCount = 0);
+void QueueModel(RenderPass pass, const Shader& shader, Model& model, const glm::mat4& world, bool depthOnly, int lod = 0);
+void QueueSceneNode(RenderPass pass, int node);
+void QueueCrowd(RenderPass pass, const Shader& shader, const Frustum& frustum);
+bool IsShadowPass(RenderPass pass) { return pass >= RENDER_PASS_SHADOW_CACHE && pass <= RENDER_PASS_SHADOW_LAST; }
+// passes that draw the visible objects with their materials (LOD stats count these)
+bool IsShadingPass(RenderPass pass) { return pass == RENDER_PASS_GBUFFER || pass == RENDER_PASS_MAIN; }
+
+// view frustum culling through the scene's AABB tree -
+// camera frustum for the main pass, light frustum for the shadow pass
+bool m_frustumCulling = true;
+struct CullingStats {
+    int submitted[RENDER_PASS_COUNT] = { 0 };
+    int culled[RENDER_PASS_COUNT] = { 0 };
+    int cachedCasters[CascadedShadowMap::kCascadeCount] = { 0 };   // static casters skipped, cache still valid
+    int occluders = 0;  // main pass objects drawn into the Hi-Z occluder depth
+    int occluded = 0;   // main pass objects rejected by the Hi-Z test
+};
+CullingStats m_cullingStats;
+
+// Hi-Z occlusion culling - last frame's visible objects are the occluders of this frame
+bool m_occlusionCulling = true;
+HiZBuffer m_hiZ;
+std::vector<int> m_mainCandidates;      // main pass objects inside the camera frustum
+// dynamic casters found per cascade, queued after the static cache copy
+std::vector<int> m_dynamicCasters[CascadedShadowMap::kCascadeCount];
+std::vector<uint8_t> m_nodeVisible;     // per scene node, drawn in the last main pass
+std::vector<int> m_forwardNodes;        // visible objects of the forward main pass
+bool WasVisible(int node) { return node < (int)m_nodeVisible.size() && m_nodeVisible[node]; }
+
+// depth prepass - the visible objects are drawn depth only first, then the lit pass runs with
+// GL_EQUAL and depth writes off so every pixel is shaded once. the main pass shaders compute
+// gl_Position exactly like simpleDepthShader.vs (invariant), otherwise GL_EQUAL drops pixels
+bool m_depthPrepass = false;
+
+// discrete LODs - per object, the coarsest level whose geometric error projects to at most
+// m_lodPixelError pixels. a coarser level is only taken once it is LOD_HYSTERESIS below the
+// threshold, so objects near a switching distance don't flip every frame
+const int MAX_LOD_LEVELS = 8;
+const float LOD_HYSTERESIS = 0.25f;
+bool m_lodEnabled = true;
+float m_lodPixelError = 1.0f;
+std::vector<uint8_t> m_nodeLod;
+struct LodStats {
+    int objects[MAX_LOD_LEVELS] = { 0 };
+    int triangles = 0;          // main pass
+    int fullTriangles = 0;      // the same objects at level 0
+    int vertices = 0;
+    int fullVertices = 0;
+};
+LodStats m_lodStats;
+int SelectLod(int node);
+int PickLod(const vector<float>& lodErrors, const AABB& bounds, float scale, int current);
+
+// point lights of lightingShader, shaded through the light clusters. the first four are the
+// scene's lights (objects in range of each are found with a scene sphere query), the rest is a
+// random field of small colored lights over the containers to load the clustering
+glm::vec3 pointLightPositions[] = {
+    glm::vec3( 0.7f,  0.2f,  2.0f),
+    glm::vec3( 2.3f, -3.3f, -4.0f),
+    glm::vec3(-4.0f,  2.0f, -12.0f),
+    glm::vec3( 0.0f,  0.0f, -3.0f)
+};
+const float POINT_LIGHT_CONSTANT = 1.0f, POINT_LIGHT_LINEAR = 0.022f, POINT_LIGHT_QUADRATIC = 0.0019f;
+int m_pointLightObjects[4] = { 0 };
+int m_pointLightCount = 4;
+std::vector<PointLight> m_pointLights;
+void UpdatePointLights();
+
+// clustered forward lighting - light lists per view space cluster, rebuilt every frame
+LightClusters m_lightClusters;
+// texture buffer units, after the shadow map
+const int LIGHT_DATA_UNIT = 9;
+const int CLUSTER_GRID_UNIT = 10;
+const int LIGHT_INDEX_UNIT = 11;
+
+// forward (lighting.fs + clusters) or deferred shading of the lightingShader objects;
+// other materials stay forward and draw after the deferred resolve
+enum LightingMode {
+    LIGHTING_FORWARD = 0,
+    LIGHTING_DEFERRED
+};
+int m_lightingMode = LIGHTING_FORWARD;
+DeferredRenderer m_deferred;
+Shader gBufferShader;
+void SetSceneLights(const Shader& shader);
+bool IsDeferred(int node);
+
+// forward vs deferred as the light count grows: every step runs a few frames to settle
+// (timer results lag), then averages the GPU frame time and the CPU time of Render
+const int BENCHMARK_LIGHT_COUNTS[] = { 4, 64, 256, 1024, 2048, 4096, 8192 };
+const int BENCHMARK_STEPS = sizeof(BENCHMARK_LIGHT_COUNTS) / sizeof(BENCHMARK_LIGHT_COUNTS[0]);
+const int BENCHMARK_WARMUP_FRAMES = 10;
+const int BENCHMARK_FRAMES = 60;
+struct LightingBenchmark {
+    bool running = false;
+    int step = 0;               // light count index * 2 + lighting mode
+    int frame = 0;
+    double gpuSum = 0.0;
+    double cpuSum = 0.0;
+    float gpuMilliseconds[BENCHMARK_STEPS][2] = { { 0.0f } };
+    float cpuMilliseconds[BENCHMARK_STEPS][2] = { { 0.0f } };
+    bool done = false;
+    int savedLightCount = 4;    // restored afterwards
+    int savedMode = LIGHTING_FORWARD;
+};
+LightingBenchmark m_benchmark;
+float m_renderMilliseconds = 0.0f;  // CPU time of the last Render
+void UpdateLightingBenchmark();
+
+// picking - left click selects the nearest object under the cursor
+int m_pickedNode = -1;
+void PickObject(double x, double y);
+Mesh MakeStaticMesh(const float* data, size_t vertexCount);
+Mesh MakeStaticMesh(std::vector<Vertex>&& vertices);
+std::vector<Vertex> BuildBrickQuadVertices();
 
 bool m_animation = true;
 // glm::vec3 m_lightPos(0.2f, 0.2f, 1.0f);
@@ -99,10 +313,21 @@ glm::vec3 m_lightDirection(-0.2f, -1.0f, -0.3f);
 
 glm::vec3 m_modelRotation(0.f, 0.f, 0.f);
 
+// hardware instancing - copies of the animated model laid out on a grid
+// (one scene node each, merged into instanced commands by the render queue)
+int m_modelInstances = 1;
+float m_instanceSpacing = 1.5f;
+
+// GL calls of the last frame that reached the driver / were filtered by GLState
+GLStateStats m_glStateStats;
+
+glm::mat4 GetOurModelMatrix();
+void UpdateCharacterNodes();
+
 
 void OnFramebufferSizeChange(GLFWwindow* window, int width, int height) {
     SPDLOG_INFO("framebuffer size changed: ({} x {})", width, height);
-    glViewport(0, 0, width, height);
+    GLState::Get().Viewport(0, 0, width, height);
 }
 
 void OnKeyEvent(GLFWwindow* window,
@@ -124,12 +349,166 @@ void Render() {
     if (ImGui::Begin("ui window")) {
         if (ImGui::CollapsingHeader("model", ImGuiTreeNodeFlags_DefaultOpen)) {
             ImGui::DragFloat3("model rotation", glm::value_ptr(m_modelRotation), 0.01f);
-          
+            ImGui::DragInt("instances", &m_modelInstances, 1.0f, 1, 1000);
+            ImGui::DragFloat("instance spacing", &m_instanceSpacing, 0.01f, 0.1f, 10.0f);
+            ImGui::RadioButton("skin per pass", &m_skinningMode, SKINNING_MODE_SHADER);
+            ImGui::SameLine();
+            ImGui::RadioButton("skin once (feedback)", &m_skinningMode, SKINNING_MODE_FEEDBACK);
+            ImGui::SameLine();
+            ImGui::RadioButton("cpu skinning", &m_skinningMode, SKINNING_MODE_CPU);
+            ImGui::Text("vertex skinning: %d vertices/frame", m_skinningMode == SKINNING_MODE_SHADER ? m_shaderSkinnedVertices
+                : m_skinningMode == SKINNING_MODE_FEEDBACK ? m_skinningCache.SkinnedVertices() : m_cpuSkinning.Stats().vertices);
+            int skinningPath = m_cpuSkinning.Path();
+            if (ImGui::Combo("skinning kernel", &skinningPath, [](void*, int index, const char** name) {
+                    *name = CpuSkinning::PathName((SkinningPath)index);
+                    return true;
+                }, nullptr, SKINNING_PATH_COUNT))
+                m_cpuSkinning.SetPath((SkinningPath)skinningPath); // unsupported kernels are ignored
+            ImGui::SliderInt("crowd", &m_crowdCount, 0, 10000);
+            ImGui::DragFloat("crowd spacing", &m_crowdSpacing, 0.01f, 0.3f, 5.0f);
+            ImGui::Checkbox("crowd shadows", &m_crowdShadows);
+            if (m_skinningMode == SKINNING_MODE_CPU) {
+                const CpuSkinningStats& skinning = m_cpuSkinning.Stats();
+                ImGui::Text("%d vertices: skin %.3f ms (%.1f M vertices/s, %d threads), upload %.3f ms", skinning.vertices,
+                    skinning.skinMilliseconds, skinning.verticesPerSecond * 1e-6, ThreadPool::Get().ThreadCount(), skinning.uploadMilliseconds);
+            }
+
+        }
+        if (ImGui::CollapsingHeader("scene", ImGuiTreeNodeFlags_DefaultOpen)) {
+            if (ImGui::SliderInt("cubes", &m_cubeCount, 0, 10000))
+                UpdateCubeField();
+            if (ImGui::DragFloat3("cube field offset", glm::value_ptr(m_cubeFieldOffset), 0.01f)) {
+                m_scene.SetLocalTransform(m_cubeFieldNode, glm::translate(glm::mat4(1.0f), m_cubeFieldOffset));
+                m_shadowMap.InvalidateStatic();
+            }
+            const Scene::UpdateStats& update = m_scene.LastUpdate();
+            ImGui::Text("nodes: %d, objects: %d, tree height: %d", (int)m_scene.NodeCount(), (int)m_scene.ObjectCount(), m_scene.Tree().Height());
+            ImGui::Text("updated: %d, reinserted: %d", update.updated, update.reinserted);
+            for (int i = 0; i < 4 && i < (int)m_pointLights.size(); i++)
+                ImGui::Text("point light %d: %d objects in range", i, m_pointLightObjects[i]);
+            if (m_pickedNode >= 0 && m_scene.Alive(m_pickedNode)) {
+                glm::vec3 position = glm::vec3(m_scene.World(m_pickedNode)[3]);
+                ImGui::Text("picked: node %d (%s) at (%.2f, %.2f, %.2f)", m_pickedNode,
+                    m_drawableNames[m_scene.UserData(m_pickedNode)], position.x, position.y, position.z);
+            }
+            else {
+                ImGui::Text("picked: none (left click)");
+            }
         }
         if (ImGui::CollapsingHeader("light", ImGuiTreeNodeFlags_DefaultOpen)) {
             ImGui::DragFloat3("light pos", glm::value_ptr(lightPos), 0.01f);
             ImGui::SliderFloat("materialShininess", &m_materialShininess, 0.0f, 256.0f);
             ImGui::DragFloat3("light direction", glm::value_ptr(m_lightDirection), 0.01f);
+            if (ImGui::SliderInt("point lights", &m_pointLightCount, 4, 8192))
+                UpdatePointLights();
+            const LightClusterStats& clusters = m_lightClusters.Stats();
+            ImGui::Text("clusters: %d x %d x %d, active: %d", LightClusters::kGridX, LightClusters::kGridY, LightClusters::kGridZ, clusters.activeClusters);
+            ImGui::Text("visible lights: %d, references: %d", clusters.lights, clusters.references);
+            ImGui::Text("max per cluster: %d, dropped: %d", clusters.maxPerCluster, clusters.overflow);
+            ImGui::Text("assignment: %.3f ms (%d threads)", clusters.buildMilliseconds, ThreadPool::Get().ThreadCount());
+        }
+        if (ImGui::CollapsingHeader("shadows", ImGuiTreeNodeFlags_DefaultOpen)) {
+            ImGui::SliderFloat("split lambda", &m_shadowMap.splitLambda, 0.0f, 1.0f);
+            ImGui::SliderFloat("shadow distance", &m_shadowMap.shadowDistance, 5.0f, 100.0f);
+            ImGui::Checkbox("show cascades", &m_showCascades);
+            ImGui::Checkbox("cache static casters", &m_shadowMap.caching);
+            if (ImGui::Combo("filter", &m_shadowQuality, m_shadowQualityNames, IM_ARRAYSIZE(m_shadowQualityNames)))
+                SelectShaderVariants();
+            ImGui::Text("%d cascades of %d x %d, splits: %.1f / %.1f / %.1f / %.1f", CascadedShadowMap::kCascadeCount,
+                m_shadowMap.Resolution(), m_shadowMap.Resolution(), m_shadowMap.SplitDistance(0), m_shadowMap.SplitDistance(1),
+                m_shadowMap.SplitDistance(2), m_shadowMap.SplitDistance(3));
+        }
+        if (ImGui::CollapsingHeader("shader variants", ImGuiTreeNodeFlags_DefaultOpen)) {
+            if (ImGui::Checkbox("normal mapping", &m_normalMapping))
+                SelectShaderVariants();
+            ImGui::Text("programs: %d, compiled variants: %d", ShaderLibrary::Get().ProgramCount(), ShaderLibrary::Get().VariantCount());
+        }
+        if (ImGui::CollapsingHeader("shading", ImGuiTreeNodeFlags_DefaultOpen)) {
+            ImGui::RadioButton("forward", &m_lightingMode, LIGHTING_FORWARD);
+            ImGui::SameLine();
+            ImGui::RadioButton("deferred", &m_lightingMode, LIGHTING_DEFERRED);
+            ImGui::Text("g-buffer: %d x %d, %d bytes/pixel", m_deferred.Width(), m_deferred.Height(), DeferredRenderer::PixelSize());
+            ImGui::Text("frame: gpu %.3f ms, render cpu %.3f ms", m_renderQueue.FrameMilliseconds(), m_renderMilliseconds);
+            if (m_benchmark.running) {
+                ImGui::Text("benchmark: %d lights, %s (%d / %d)", BENCHMARK_LIGHT_COUNTS[m_benchmark.step / 2],
+                    m_benchmark.step % 2 == LIGHTING_FORWARD ? "forward" : "deferred", m_benchmark.step + 1, BENCHMARK_STEPS * 2);
+            }
+            else if (ImGui::Button("run forward / deferred benchmark")) {
+                m_benchmark = LightingBenchmark();
+                m_benchmark.running = true;
+                m_benchmark.savedLightCount = m_pointLightCount;
+                m_benchmark.savedMode = m_lightingMode;
+                // frame timestamps come with the pass timers
+                m_renderQueue.SetTiming(true);
+            }
+            if (m_benchmark.done) {
+                ImGui::Text("%6s | %-17s | %-17s", "lights", "forward gpu/cpu", "deferred gpu/cpu");
+                for (int i = 0; i < BENCHMARK_STEPS; i++) {
+                    ImGui::Text("%6d | %7.3f %7.3f | %7.3f %7.3f", BENCHMARK_LIGHT_COUNTS[i],
+                        m_benchmark.gpuMilliseconds[i][LIGHTING_FORWARD], m_benchmark.cpuMilliseconds[i][LIGHTING_FORWARD],
+                        m_benchmark.gpuMilliseconds[i][LIGHTING_DEFERRED], m_benchmark.cpuMilliseconds[i][LIGHTING_DEFERRED]);
+                }
+            }
+        }
+        if (ImGui::CollapsingHeader("render queue", ImGuiTreeNodeFlags_DefaultOpen)) {
+            const RenderQueueStats& stats = m_renderQueue.Stats();
+            bool multiDraw = m_renderQueue.MultiDrawEnabled();
+            if (!m_renderQueue.MultiDrawSupported())
+                ImGui::Text("multi draw indirect: not supported (GL 4.3)");
+            else if (ImGui::Checkbox("multi draw indirect", &multiDraw))
+                m_renderQueue.SetMultiDraw(multiDraw);
+            ImGui::Text("packets: %d, commands: %d", stats.packets, stats.commands);
+            ImGui::Text("draws: %d, passes: %d", stats.draws, stats.passes);
+            ImGui::Text("binds - program: %d, texture: %d, vao: %d", stats.programBinds, stats.textureBinds, stats.vaoBinds);
+        }
+        if (ImGui::CollapsingHeader("culling", ImGuiTreeNodeFlags_DefaultOpen)) {
+            ImGui::Checkbox("frustum culling", &m_frustumCulling);
+            for (int i = 0; i < CascadedShadowMap::kCascadeCount; i++) {
+                if (m_cullingStats.cachedCasters[i] > 0)
+                    ImGui::Text("shadow %d - static: %d cached, dynamic: %d, culled: %d", i, m_cullingStats.cachedCasters[i],
+                        m_cullingStats.submitted[RENDER_PASS_SHADOW + i], m_cullingStats.culled[RENDER_PASS_SHADOW + i]);
+                else
+                    ImGui::Text("shadow %d - static: %d, dynamic: %d, culled: %d", i, m_cullingStats.submitted[RENDER_PASS_SHADOW_CACHE + i],
+                        m_cullingStats.submitted[RENDER_PASS_SHADOW + i], m_cullingStats.culled[RENDER_PASS_SHADOW + i]);
+            }
+            ImGui::Text("main   - submitted: %d, culled: %d", m_cullingStats.submitted[RENDER_PASS_MAIN], m_cullingStats.culled[RENDER_PASS_MAIN]);
+            ImGui::Checkbox("occlusion culling (Hi-Z)", &m_occlusionCulling);
+            ImGui::Text("occluders: %d, occluded: %d", m_cullingStats.occluders, m_cullingStats.occluded);
+            ImGui::Text("hi-z: %d x %d, %d levels, tested from %d x %d", m_hiZ.Width(), m_hiZ.Height(), m_hiZ.LevelCount(),
+                m_hiZ.LevelWidth(m_hiZ.ReadbackLevel()), m_hiZ.LevelHeight(m_hiZ.ReadbackLevel()));
+        }
+        if (ImGui::CollapsingHeader("depth prepass", ImGuiTreeNodeFlags_DefaultOpen)) {
+            ImGui::Checkbox("depth prepass", &m_depthPrepass);
+            bool timing = m_renderQueue.TimingEnabled();
+            if (ImGui::Checkbox("gpu pass timing", &timing))
+                m_renderQueue.SetTiming(timing);
+            static const char* passNames[RENDER_PASS_COUNT] = { "cache 0", "cache 1", "cache 2", "cache 3",
+                "shadow 0", "shadow 1", "shadow 2", "shadow 3", "occluder", "prepass", "gbuffer", "main" };
+            float total = 0.0f;
+            for (int i = 0; i < RENDER_PASS_COUNT; i++) {
+                float ms = m_renderQueue.PassMilliseconds((RenderPass)i);
+                total += ms;
+                ImGui::Text("%-8s %6.3f ms", passNames[i], ms);
+            }
+            ImGui::Text("%-8s %6.3f ms", "total", total);
+        }
+        if (ImGui::CollapsingHeader("lod", ImGuiTreeNodeFlags_DefaultOpen)) {
+            ImGui::Checkbox("lod selection", &m_lodEnabled);
+            ImGui::DragFloat("pixel error", &m_lodPixelError, 0.05f, 0.1f, 32.0f);
+            for (int i = 0; i < MAX_LOD_LEVELS; i++) {
+                if (m_lodStats.objects[i] > 0)
+                    ImGui::Text("lod %d: %d objects", i, m_lodStats.objects[i]);
+            }
+            ImGui::Text("triangles: %d (full detail %d)", m_lodStats.triangles, m_lodStats.fullTriangles);
+            ImGui::Text("vertices: %d (full detail %d)", m_lodStats.vertices, m_lodStats.fullVertices);
+        }
+        if (ImGui::CollapsingHeader("gl state")) {
+            static const char* callNames[GL_STATE_CALL_COUNT] = {
+                "glUseProgram", "glBindVertexArray", "glActiveTexture",
+                "glBindTexture", "glViewport", "glBindFramebuffer"
+            };
+            for (int i = 0; i < GL_STATE_CALL_COUNT; i++)
+                ImGui::Text("%-18s issued: %4d, filtered: %4d", callNames[i], m_glStateStats.issued[i], m_glStateStats.filtered[i]);
         }
 
         ImGui::Checkbox("animation", &m_animation);
@@ -154,192 +533,252 @@ void Render() {
         }
     }
     ImGui::End();
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    // 1. render depth of scene to texture (from light's perspective)
+    UpdateCharacterNodes();
+    UpdateCrowd();
+    m_scene.UpdateTransforms();
+
+    glm::mat4 projection = camera.GetProjectionMatrix((float)SCR_WIDTH / (float)SCR_HEIGHT);
+    glm::mat4 view = camera.GetViewMatrix();
+    // one matrix for every camera pass, so the prepass and the lit pass see identical values
+    glm::mat4 viewProjection = projection * view;
+
+    // 1. shadow cascades fitted to the camera, the light shines from lightPos towards the origin
+    // --------------------------------------------------------------
+    AABB casterBounds = m_scene.Bounds();
+    if (m_crowdShadows && m_crowdCount > 0)
+        casterBounds.Expand(m_crowdBounds);
+    m_shadowMap.Update(view, glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f,
+        glm::length(lightPos) > 1e-4f ? -lightPos : glm::vec3(0.0f, -1.0f, 0.0f), casterBounds);
+
+    // per-frame uniforms - every program is set up once, draws go through the render queue.
+    // simpleDepthShader gets its lightSpaceMatrix from the cascade pass setups
     // --------------------------------------------------------------
-    glm::mat4 lightProjection, lightView;
-    glm::mat4 lightSpaceMatrix;
-    float near_plane = 1.0f, far_plane = 30.f;
-    lightProjection = glm::ortho(-10.0f, 10.0f, -10.0f, 10.0f, near_plane, far_plane);
-    lightView = glm::lookAt(lightPos, glm::vec3(0.0f), glm::vec3(0.0, 1.0, 0.0));
-    lightSpaceMatrix = lightProjection * lightView;
-    // render scene from light's point of view
     simpleDepthShader.use();
-    simpleDepthShader.setMat4("lightSpaceMatrix", lightSpaceMatrix);
-
     std::vector<glm::mat4> boneMatrices = animator.GetFinalBoneMatrices(); // 뼈대 행렬 계산
     for (int i = 0; i < boneMatrices.size(); ++i) {
         std::string uniformName = "finalBonesMatrices[" + std::to_string(i) + "]";
         simpleDepthShader.setMat4(uniformName, boneMatrices[i]);
-        // simpleDepthShader.setMat4("finalBonesMatrices[" + std::to_string(i) + "]", boneMatrices[i]); // 셰이더에 전달
         // std::cout << "Bone " << i << ": " << glm::to_string(boneMatrices[i]) << std::endl;
     }
-
-    glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
-    glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
-        glClear(GL_DEPTH_BUFFER_BIT);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, woodTexture);
-        renderScene(simpleDepthShader);
-        // 아래 코드는 모델을 렌더링하기 위한 것
-        glm::mat4 modelB = glm::mat4(1.0f);
-        modelB = glm::scale(modelB, glm::vec3(0.7f, 0.7f, 0.7f));  // 크기 조정
-        simpleDepthShader.setMat4("model", modelB);
-        ourModel.Draw(simpleDepthShader);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-    // 현재 코드는 디버깅용 - depth map을 사각형에 입혀서 렌더링 결과 확인함 
-    // reset viewport
-    glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-    // 2. render scene as normal using the generated depth/shadow map  
-    // --------------------------------------------------------------
+    // skinned once for all passes: the passes draw the streams with the static program variants
+    if (m_skinningMode == SKINNING_MODE_FEEDBACK)
+        m_skinningCache.Update(boneMatrices);
+    else if (m_skinningMode == SKINNING_MODE_CPU)
+        m_cpuSkinning.Update(boneMatrices);
+
+    // occluder / prepass depth: the depth shader seen from the camera
+    occluderDepthShader.use();
+    occluderDepthShader.setMat4("lightSpaceMatrix", viewProjection);
+    for (int i = 0; i < boneMatrices.size(); ++i)
+        occluderDepthShader.setMat4("finalBonesMatrices[" + std::to_string(i) + "]", boneMatrices[i]);
+    staticOccluderDepthShader.use();
+    staticOccluderDepthShader.setMat4("lightSpaceMatrix", viewProjection);
+
+    // shadow mapped floor
     shader.use();
-    glm::mat4 projectionS = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-    glm::mat4 viewS = camera.GetViewMatrix();
-    shader.setMat4("projection", projectionS);
-    shader.setMat4("view", viewS);
+    shader.setMat4("viewProjection", viewProjection);
     // set light uniforms
     shader.setVec3("viewPos", camera.Position);
     shader.setVec3("lightPos", lightPos);
-    shader.setMat4("lightSpaceMatrix", lightSpaceMatrix);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, woodTexture);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, depthMap);
-    renderScene(shader);
+    shader.setMat4("view", view);
+    shader.setBool("showCascades", m_showCascades);
+    m_shadowMap.SetUniforms(shader);
 
     // render Depth map to quad for visual debugging
     // ---------------------------------------------
-    debugDepthQuad.use();
-    debugDepthQuad.setFloat("near_plane", near_plane);
-    debugDepthQuad.setFloat("far_plane", far_plane);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, depthMap);
+    // debugDepthQuad.use();
+    // debugDepthQuad.setFloat("near_plane", near_plane);
+    // debugDepthQuad.setFloat("far_plane", far_plane);
+    // glActiveTexture(GL_TEXTURE0);
+    // glBindTexture(GL_TEXTURE_2D, depthMap);
     // renderQuad();// depth map 디버깅용이므로 여기서는 안그림
 
     // normal mapping 
     normalShader.use();
-    glm::mat4 projectionN = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-    glm::mat4 viewN = camera.GetViewMatrix();
-    normalShader.setMat4("projection", projectionN);
-    normalShader.setMat4("view", viewN);
-    glm::mat4 modelN = glm::mat4(1.0f);
-    // modelN = glm::rotate(modelN, glm::radians((float)glfwGetTime() * -10.0f), glm::normalize(glm::vec3(1.0, 0.0, 1.0))); // rotate the quad to show normal mapping from multiple directions
-    normalShader.setMat4("model", modelN);
+    normalShader.setMat4("viewProjection", viewProjection);
     normalShader.setVec3("viewPos", camera.Position);
     normalShader.setVec3("lightPos", lightPos);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, diffuseMapBlock);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, normalMapBlock);
-    modelN = glm::translate(modelN, glm::vec3(4.0f, 2.0f, 0.2f));
-    modelN = glm::scale(modelN, glm::vec3(2.5f));
-    normalShader.setMat4("model", modelN);
-    renderQuad();
-
-
-    // positions of the point lights
-    glm::vec3 pointLightPositions[] = {
-        glm::vec3( 0.7f,  0.2f,  2.0f),
-        glm::vec3( 2.3f, -3.3f, -4.0f),
-        glm::vec3(-4.0f,  2.0f, -12.0f),
-        glm::vec3( 0.0f,  0.0f, -3.0f)
-    };
 
      // be sure to activate shader when setting uniforms/drawing objects
     lightingShader.use();
-
-    // directional light
-    lightingShader.setVec3("dirLight.direction", -0.2f, -1.0f, -0.3f);
-    lightingShader.setVec3("dirLight.ambient", 0.2f, 0.2f, 0.2f);
-    lightingShader.setVec3("dirLight.diffuse", 0.9f, 0.9f, 0.9f);
-    lightingShader.setVec3("dirLight.specular", 0.7f, 0.7f, 0.7f);
-    // point light 1
-    lightingShader.setVec3("pointLights[0].position", pointLightPositions[0]);
-    lightingShader.setVec3("pointLights[0].ambient", 0.5f, 0.5f, 0.5f);
-    lightingShader.setVec3("pointLights[0].diffuse", 0.8f, 0.8f, 0.8f);
-    lightingShader.setVec3("pointLights[0].specular", 1.0f, 1.0f, 1.0f);
-    lightingShader.setFloat("pointLights[0].constant", 1.0f);
-    lightingShader.setFloat("pointLights[0].linear", 0.022f);
-    lightingShader.setFloat("pointLights[0].quadratic", 0.0019f);
-    // point light 2
-    lightingShader.setVec3("pointLights[1].position", pointLightPositions[1]);
-    lightingShader.setVec3("pointLights[1].ambient", 0.5f, 0.5f, 0.5f);
-    lightingShader.setVec3("pointLights[1].diffuse", 0.8f, 0.8f, 0.8f);
-    lightingShader.setVec3("pointLights[1].specular", 1.0f, 1.0f, 1.0f);
-    lightingShader.setFloat("pointLights[1].constant", 1.0f);
-    lightingShader.setFloat("pointLights[1].linear", 0.022f);
-    lightingShader.setFloat("pointLights[1].quadratic", 0.0019f);
-    // point light 3
-    lightingShader.setVec3("pointLights[2].position", pointLightPositions[2]);
-    lightingShader.setVec3("pointLights[2].ambient", 0.5f, 0.5f, 0.5f);
-    lightingShader.setVec3("pointLights[2].diffuse", 0.8f, 0.8f, 0.8f);
-    lightingShader.setVec3("pointLights[2].specular", 1.0f, 1.0f, 1.0f);
-    lightingShader.setFloat("pointLights[2].constant", 1.0f);
-    lightingShader.setFloat("pointLights[2].linear", 0.022f);
-    lightingShader.setFloat("pointLights[2].quadratic", 0.0019f);
-    // point light 4
-    lightingShader.setVec3("pointLights[3].position", pointLightPositions[3]);
-    lightingShader.setVec3("pointLights[3].ambient", 0.5f, 0.5f, 0.5f);
-    lightingShader.setVec3("pointLights[3].diffuse", 0.8f, 0.8f, 0.8f);
-    lightingShader.setVec3("pointLights[3].specular", 1.0f, 1.0f, 1.0f);
-    lightingShader.setFloat("pointLights[3].constant", 1.0f);
-    lightingShader.setFloat("pointLights[3].linear", 0.022f);
-    lightingShader.setFloat("pointLights[3].quadratic", 0.0019f);
-    // spotLight
-    lightingShader.setVec3("spotLight.position", camera.Position);
-    lightingShader.setVec3("spotLight.direction", camera.Front);
-    lightingShader.setVec3("spotLight.ambient", 0.0f, 0.0f, 0.0f);
-    lightingShader.setVec3("spotLight.diffuse", 0.3f, 0.3f, 0.3f);
-    lightingShader.setVec3("spotLight.specular", 0.3f, 0.3f, 0.3f);
-    lightingShader.setFloat("spotLight.constant", 1.0f);
-    lightingShader.setFloat("spotLight.linear", 0.022f);
-    lightingShader.setFloat("spotLight.quadratic", 0.0019f);
-    lightingShader.setFloat("spotLight.cutOff", glm::cos(glm::radians(12.5f)));
-    lightingShader.setFloat("spotLight.outerCutOff", glm::cos(glm::radians(15.0f)));
-
-    lightingShader.setVec3("viewPos", camera.Position);
-
-    // material properties
-    lightingShader.setFloat("material.shininess", m_materialShininess);
+    SetSceneLights(lightingShader);
+    // point lights: per cluster lists, the buffers are bound by the main pass setup.
+    // deferred shading only needs the visible light list
+    m_lightClusters.Build(m_pointLights, view, glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT,
+        0.1f, 100.0f, SCR_WIDTH, SCR_HEIGHT, m_lightingMode == LIGHTING_FORWARD);
+    m_lightClusters.SetUniforms(lightingShader);
 
     // view/projection transformations
-    glm::mat4 projectionL = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-    glm::mat4 viewL = camera.GetViewMatrix();
-    lightingShader.setMat4("projection", projectionL);
-    lightingShader.setMat4("view", viewL);
-
-    renderScene(lightingShader);
-    lightingShader.setMat4("model", modelN);
-    // renderOurModel();
+    lightingShader.setMat4("viewProjection", viewProjection);
+
+    // deferred shading: G-buffer pass (lighting.vs) and the resolve programs
+    if (m_lightingMode == LIGHTING_DEFERRED) {
+        gBufferShader.use();
+        gBufferShader.setMat4("viewProjection", viewProjection);
+        m_deferred.DirectionalShader().use();
+        SetSceneLights(m_deferred.DirectionalShader());
+        m_deferred.PointShader().use();
+        SetSceneLights(m_deferred.PointShader());
+    }
 
-    // don't forget to enable shader before setting uniforms
+    // animated model
 	ourShader.use();
-
-	// view/projection transformations
-	glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-	glm::mat4 view = camera.GetViewMatrix();
-	ourShader.setMat4("projection", projection);
-	ourShader.setMat4("view", view);
+	ourShader.setMat4("viewProjection", viewProjection);
 
     auto transforms = animator.GetFinalBoneMatrices();
 	for (int i = 0; i < transforms.size(); ++i){
 		ourShader.setMat4("finalBonesMatrices[" + std::to_string(i) + "]", transforms[i]);
         // SPDLOG_DEBUG("finalBonesMatrices[{}]", transforms[i]);
     }
+    staticModelShader.use();
+    staticModelShader.setMat4("viewProjection", viewProjection);
+
+    // crowd: the baked clips' playback time, nothing per instance
+    GLState::Get().BindTexture(BAKED_BONES_UNIT, GL_TEXTURE_2D, m_bakedAnimation.Texture());
+    crowdShader.use();
+    crowdShader.setMat4("viewProjection", viewProjection);
+    m_bakedAnimation.SetUniforms(crowdShader, m_crowdTime);
+    crowdPrepassShader.use();
+    crowdPrepassShader.setMat4("lightSpaceMatrix", viewProjection);
+    m_bakedAnimation.SetUniforms(crowdPrepassShader, m_crowdTime);
+    crowdDepthShader.use();
+    m_bakedAnimation.SetUniforms(crowdDepthShader, m_crowdTime);
+
+    // 2. draw packets
+    // --------------------------------------------------------------
 
-	// render the loaded model
-	glm::mat4 model = glm::mat4(1.0f);
-    model = glm::translate(model, glm::vec3(0.0f, 0.0f, 0.0f)); 
-    model = glm::scale(model, glm::vec3(0.025f, 0.025f, 0.025f));
-    // 뒤집힌 모델 Y축 기준으로 180도 회전
-    model = glm::rotate(model, glm::radians(180.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-	ourShader.setMat4("model", model);
-	ourModel.Draw(ourShader);
+    // light-to-object assignment of the scene's lights
+    for (int i = 0; i < 4 && i < (int)m_pointLights.size(); i++) {
+        m_pointLightObjects[i] = 0;
+        m_scene.QuerySphere(m_pointLights[i].position, m_pointLights[i].Radius(), [i](int) { m_pointLightObjects[i]++; });
+    }
+
+    UpdateLightingBenchmark();
+    auto renderStart = std::chrono::steady_clock::now();
+    m_cullingStats = CullingStats();
+    m_lodStats = LodStats();
+    m_shaderSkinnedVertices = 0;
+    m_renderQueue.BeginFrame();
+    m_renderQueue.SetDepthRange(100.0f);
+
+    // shadow passes: each cascade's light frustum. static casters are drawn into the cascade's
+    // cache only when it is stale and submitted first; the caches are then copied into the
+    // shadow map, and the dynamic casters go on top in a second submit, so a still scene
+    // costs the dynamic casters + 4 depth copies
+    for (int i = 0; i < CascadedShadowMap::kCascadeCount; i++) {
+        RenderPass staticPass = (RenderPass)(RENDER_PASS_SHADOW_CACHE + i);
+        RenderPass dynamicPass = (RenderPass)(RENDER_PASS_SHADOW + i);
+        bool updateStatic = m_shadowMap.NeedsStaticUpdate(i);
+        if (updateStatic)
+            m_shadowMap.BeginStaticUpdate(i);
+        m_dynamicCasters[i].clear();
+        int casters = 0;
+        auto queueShadow = [&](int node) {
+            casters++;
+            if (m_drawables[m_scene.UserData(node)].dynamic) {
+                m_dynamicCasters[i].push_back(node);
+                return;
+            }
+            if (!updateStatic) {
+                m_cullingStats.cachedCasters[i]++;
+                return;
+            }
+            m_cullingStats.submitted[staticPass]++;
+            QueueSceneNode(staticPass, node);
+        };
+        if (m_frustumCulling)
+            m_scene.QueryFrustum(Frustum(m_shadowMap.LightSpaceMatrix(i)), queueShadow);
+        else
+            m_scene.ForEachObject(queueShadow);
+        m_cullingStats.culled[dynamicPass] = (int)m_scene.ObjectCount() - casters;
+    }
+    m_renderQueue.Submit();
+    // every cascade starts from its static depth, also cascades without dynamic casters
+    m_shadowMap.CopyStaticCache();
+    for (int i = 0; i < CascadedShadowMap::kCascadeCount; i++) {
+        RenderPass dynamicPass = (RenderPass)(RENDER_PASS_SHADOW + i);
+        for (int node : m_dynamicCasters[i]) {
+            m_cullingStats.submitted[dynamicPass]++;
+            QueueSceneNode(dynamicPass, node);
+        }
+        if (m_crowdShadows)
+            QueueCrowd(dynamicPass, crowdDepthShader, Frustum(m_shadowMap.LightSpaceMatrix(i)));
+    }
+    m_renderQueue.Submit();
+
+    // main pass candidates: camera frustum
+    m_mainCandidates.clear();
+    auto collectMain = [](int node) { m_mainCandidates.push_back(node); };
+    if (m_frustumCulling)
+        m_scene.QueryFrustum(Frustum(viewProjection), collectMain);
+    else
+        m_scene.ForEachObject(collectMain);
+    m_cullingStats.submitted[RENDER_PASS_MAIN] = (int)m_mainCandidates.size();
+    m_cullingStats.culled[RENDER_PASS_MAIN] = (int)m_scene.ObjectCount() - (int)m_mainCandidates.size();
+
+    // occluder depth of the candidates that were visible last frame
+    if (m_occlusionCulling) {
+        m_hiZ.ClearOccluders();
+        for (int node : m_mainCandidates) {
+            if (WasVisible(node)) {
+                QueueSceneNode(RENDER_PASS_OCCLUDER, node);
+                m_cullingStats.occluders++;
+            }
+        }
+    }
+    m_renderQueue.Submit();
 
+    // Hi-Z test, then the shaded passes draw only what survived
+    if (m_occlusionCulling)
+        m_hiZ.Build();
+    GLState::Get().BindFramebuffer(0);
+    GLState::Get().Viewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    bool deferred = m_lightingMode == LIGHTING_DEFERRED;
+    if (deferred)
+        m_deferred.ClearGBuffer();
+    std::fill(m_nodeVisible.begin(), m_nodeVisible.end(), 0);
+    m_forwardNodes.clear();
+    for (int node : m_mainCandidates) {
+        if (m_occlusionCulling && m_hiZ.IsOccluded(m_scene.WorldBounds(node), viewProjection)) {
+            m_cullingStats.occluded++;
+            continue;
+        }
+        if (node >= (int)m_nodeVisible.size())
+            m_nodeVisible.resize(node + 1, 0);
+        m_nodeVisible[node] = 1;
+        if (deferred && IsDeferred(node)) {
+            QueueSceneNode(RENDER_PASS_GBUFFER, node);
+            continue;
+        }
+        if (m_depthPrepass)
+            QueueSceneNode(RENDER_PASS_DEPTH_PREPASS, node);
+        m_forwardNodes.push_back(node);
+    }
+    if (m_depthPrepass)
+        QueueCrowd(RENDER_PASS_DEPTH_PREPASS, crowdPrepassShader, Frustum(viewProjection));
+    m_renderQueue.Submit();
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+    // deferred lighting into the default framebuffer, before the forward objects
+    if (deferred) {
+        GLState::Get().BindFramebuffer(0);
+        GLState::Get().Viewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
+        m_lightClusters.Bind(LIGHT_DATA_UNIT, CLUSTER_GRID_UNIT, LIGHT_INDEX_UNIT);
+        m_deferred.Resolve(viewProjection, m_lightClusters.Stats().lights);
+    }
+
+    for (int node : m_forwardNodes)
+        QueueSceneNode(RENDER_PASS_MAIN, node);
+    QueueCrowd(RENDER_PASS_MAIN, crowdShader, Frustum(viewProjection));
+    m_renderQueue.Submit();
+    if (m_depthPrepass) {
+        glDepthFunc(GL_LESS);
+        glDepthMask(GL_TRUE);
+    }
+    m_renderQueue.EndFrame();
+    m_renderMilliseconds = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - renderStart).count();
 
     // // bind diffuse map
     // glActiveTexture(GL_TEXTURE0);
@@ -404,26 +843,20 @@ void Init() {
     glEnable(GL_DEPTH_TEST);  
     glClearColor(m_clearColor.r, m_clearColor.g, m_clearColor.b, m_clearColor.a);
 
-    lightingShader = Shader("./shader/lighting.vs", "./shader/lighting.fs");
-    lightCubeShader= Shader("./shader/lighting_cube.vs", "./shader/lighting_cube.fs");
-
     // build and compile shaders
     // -------------------------
-    shader = Shader("./shader/shadow_mapping.vs", "./shader/shadow_mapping.fs");
-    simpleDepthShader = Shader("./shader/simpleDepthShader.vs", "./shader/simpleDepthShader.fs");
+    RegisterShaders();
+    SelectShaderVariants();
+    m_lightClusters.Init();
+    UpdatePointLights();
+    lightCubeShader= Shader("./shader/lighting_cube.vs", "./shader/lighting_cube.fs");
+
     debugDepthQuad = Shader("./shader/debug_quad.vs", "./shader/debug_quad_depth.fs");
 
     // normal mapping
-    normalShader = Shader("./shader/normal_mapping.vs", "./shader/normal_mapping.fs");
-
     diffuseMapBlock =  loadTexture("./image/brickwall.jpg");
     normalMapBlock  = loadTexture("./image/brickwall_normal.jpg");
 
-    // shader configuration
-    normalShader.use();
-    normalShader.setInt("diffuseMap", 0);
-    normalShader.setInt("normalMap", 1);
-
     // load textures
     // -------------
     woodTexture = loadTexture("./image/wood.png");
@@ -440,62 +873,90 @@ void Init() {
         -25.0f, -0.5f, -25.0f,  0.0f, 1.0f, 0.0f,   0.0f, 25.0f,
          25.0f, -0.5f, -25.0f,  0.0f, 1.0f, 0.0f,  25.0f, 25.0f
     };
-    // plane VAO
-    unsigned int planeVBO;
-    glGenVertexArrays(1, &planeVAO);
-    glGenBuffers(1, &planeVBO);
-    glBindVertexArray(planeVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, planeVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(planeVertices), planeVertices, GL_STATIC_DRAW);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-    glBindVertexArray(0);
-
-    // configure depth map FBO
+    floorMesh = MakeStaticMesh(planeVertices, 6);
+    floorMesh.material.AddTexture("diffuseTexture", woodTexture);
+
+    brickMesh = MakeStaticMesh(BuildBrickQuadVertices());
+    brickMesh.material.AddTexture("diffuseMap", diffuseMapBlock);
+    brickMesh.material.AddTexture("normalMap", normalMapBlock);
+
+    cubeMesh = MakeStaticMesh(GetCubeVertices(), 36);
+    cubeMesh.material.AddTexture("diffuse", loadTexture("./image/container2.png"));
+    cubeMesh.material.AddTexture("specular", loadTexture("./image/container2_specular.png"));
+
+    // configure the shadow cascades (depth texture array + a framebuffer per layer)
     // -----------------------
- 
-    glGenFramebuffers(1, &depthMapFBO);
-    // create depth texture
-    glGenTextures(1, &depthMap);
-    glBindTexture(GL_TEXTURE_2D, depthMap);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, SHADOW_WIDTH, SHADOW_HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-    float borderColor[] = { 1.0, 1.0, 1.0, 1.0 };
-    glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
-   
-    // attach depth texture as FBO's depth buffer
-    glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthMap, 0);
-    glDrawBuffer(GL_NONE);
-    glReadBuffer(GL_NONE);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-
-    // shader configuration
-    // --------------------
-    //shadow rendering 위해 추가 
-    shader.use();
-    shader.setInt("diffuseTexture", 0);
-    shader.setInt("shadowMap", 1);
+    m_shadowMap.Init(SHADOW_CASCADE_SIZE);
+
+
+    // render queue passes
+    // the cache layers are cleared by BeginStaticUpdate, the shadow layers start as a copy of them
+    for (int i = 0; i < CascadedShadowMap::kCascadeCount; i++) {
+        m_renderQueue.SetPassSetup((RenderPass)(RENDER_PASS_SHADOW_CACHE + i), [i]() {
+            m_shadowMap.BindStaticCache(i);
+            for (const Shader* depthShader : { &simpleDepthShader, &staticDepthShader, &crowdDepthShader }) {
+                depthShader->use();
+                depthShader->setMat4("lightSpaceMatrix", m_shadowMap.LightSpaceMatrix(i));
+            }
+        });
+        m_renderQueue.SetPassSetup((RenderPass)(RENDER_PASS_SHADOW + i), [i]() {
+            m_shadowMap.BindCascade(i);
+            for (const Shader* depthShader : { &simpleDepthShader, &staticDepthShader, &crowdDepthShader }) {
+                depthShader->use();
+                depthShader->setMat4("lightSpaceMatrix", m_shadowMap.LightSpaceMatrix(i));
+            }
+        });
+    }
+    // occluders at half resolution, cleared by HiZBuffer::ClearOccluders
+    m_hiZ.Init(SCR_WIDTH / 2, SCR_HEIGHT / 2);
+    m_renderQueue.SetPassSetup(RENDER_PASS_OCCLUDER, []() {
+        m_hiZ.BindOccluders();
+    });
+    // the default framebuffer is cleared by Render before the prepass / main pass
+    m_renderQueue.SetPassSetup(RENDER_PASS_DEPTH_PREPASS, []() {
+        GLState::Get().BindFramebuffer(0);
+        GLState::Get().Viewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    });
+    // cleared by DeferredRenderer::ClearGBuffer
+    m_deferred.Init(SCR_WIDTH, SCR_HEIGHT, LIGHT_DATA_UNIT);
+    m_renderQueue.SetPassSetup(RENDER_PASS_GBUFFER, []() {
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        m_deferred.BindGBuffer();
+    });
+    m_renderQueue.SetPassSetup(RENDER_PASS_MAIN, []() {
+        GLState::Get().BindFramebuffer(0);
+        GLState::Get().Viewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
+        if (m_depthPrepass) {
+            // depth is final: shade only the fragment that won, write no depth
+            glDepthFunc(GL_EQUAL);
+            glDepthMask(GL_FALSE);
+        }
+        GLState::Get().BindTexture(SHADOW_MAP_UNIT, GL_TEXTURE_2D_ARRAY, m_shadowMap.Texture());
+        m_lightClusters.Bind(LIGHT_DATA_UNIT, CLUSTER_GRID_UNIT, LIGHT_INDEX_UNIT);
+    });
     
     debugDepthQuad.use();
     debugDepthQuad.setInt("depthMap", 0);
 
-    ourShader = Shader("./shader/anim_model.vs", "./shader/anim_model.fs");
-
     // load models
     // -----------
     // ourModel = Model("./model/backpack/backpack.obj");
-    ourModel = Model("./model/Timmy/Timmy_Model.dae");
+    // vertices stay on the CPU for CpuSkinning
+    ModelLoadOptions characterOptions;
+    characterOptions.keepCpuData = true;
+    ourModel = Model("./model/Timmy/Timmy_Model.dae", false, characterOptions);
 	danceAnimation = Animation("./model/Timmy/Timmy_Model.dae", &ourModel);
 	animator = Animator(&danceAnimation);
+    m_skinningCache.Init();
+    m_bakedAnimation.AddClip(danceAnimation);
+    m_bakedAnimation.Upload();
+    for (Mesh& mesh : ourModel.meshes) {
+        m_cpuSkinning.Add(mesh);
+        m_skinningCache.Add(mesh);
+    }
+
+    BuildScene();
 
     // // second, configure the light's VAO (VBO stays the same; the vertices are the same for the light object which is also a 3D cube)
     // //unsigned int lightCubeVAO;
@@ -527,216 +988,581 @@ void Shutdown() {
     // glDeleteVertexArrays(1, &cubeVAO);
     glDeleteVertexArrays(1, &lightCubeVAO);
     glDeleteBuffers(1, &VBO);
+    // global meshes give their ranges back while the GL context and the arena
+    // (a function local static, destroyed before these globals) are still alive
+    ourModel = Model();
+    floorMesh = Mesh();
+    brickMesh = Mesh();
+    cubeMesh = Mesh();
 }
 
-void renderOurModel() {
+// world transform of the animated model
+glm::mat4 GetOurModelMatrix() {
+	glm::mat4 model = glm::mat4(1.0f);
+    model = glm::translate(model, glm::vec3(0.0f, 0.0f, 0.0f)); 
+    model = glm::scale(model, glm::vec3(0.025f, 0.025f, 0.025f));
+    // 뒤집힌 모델 Y축 기준으로 180도 회전
+    model = glm::rotate(model, glm::radians(180.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    return model;
+}
 
-    // world transformation
-    glm::mat4 model = glm::mat4(1.0f);
-    model = glm::translate(model, glm::vec3(0.0f, -0.45f, 1.0));
-    model = glm::scale(model, glm::vec3(0.01f, 0.01f, 0.01));
-    model = glm::rotate(model, glm::radians(m_modelRotation.x), glm::vec3(1.0f, 0.0f, 0.0f));
-    model = glm::rotate(model, glm::radians(m_modelRotation.y), glm::vec3(0.0f, 1.0f, 0.0f));
-    model = glm::rotate(model, glm::radians(m_modelRotation.z), glm::vec3(0.0f, 0.0f, 1.0f));
-    lightingShader.setMat4("model", model);
-    
-    ourModel.Draw(lightingShader);
+// the variant of a program for the vertex format drawn: static meshes (and cpu skinned ones)
+// drawn with a skinning program get its SKINNING 0 variant, everything else draws as given
+const Shader& ShaderForFormat(const Shader& shader, VertexFormat format) {
+    if (format == VERTEX_FORMAT_SKINNED)
+        return shader;
+    if (&shader == &simpleDepthShader)
+        return staticDepthShader;
+    if (&shader == &occluderDepthShader)
+        return staticOccluderDepthShader;
+    if (&shader == &ourShader)
+        return staticModelShader;
+    return shader;
 }
 
-// renders the 3D scene
-// --------------------
-void renderScene(const Shader &shader)
-{
-    // floor
-    glm::mat4 model = glm::mat4(1.0f);
-    shader.setMat4("model", model);
-    glBindVertexArray(planeVAO);
-    glDrawArrays(GL_TRIANGLES, 0, 6);
-
-    // // cubes
-    // model = glm::mat4(1.0f);
-    // model = glm::translate(model, glm::vec3(-1.0f, 1.5f, 0.0));
-    // model = glm::scale(model, glm::vec3(0.5f));
-    // shader.setMat4("model", model);
-    // renderCube();
-    // model = glm::mat4(1.0f);
-    // model = glm::translate(model, glm::vec3(2.0f, 0.5f, 1.0));
-    // model = glm::scale(model, glm::vec3(0.5f));
-    // shader.setMat4("model", model);
-    // renderCube();
-    // model = glm::mat4(1.0f);
-    // model = glm::translate(model, glm::vec3(-1.0f, 0.5f, 2.0));
-    // model = glm::rotate(model, glm::radians(60.0f), glm::normalize(glm::vec3(1.0, 0.0, 1.0)));
-    // model = glm::scale(model, glm::vec3(0.25));
-    // shader.setMat4("model", model);
-    // renderCube();
-}
-
-// renderCube() renders a 1x1 3D cube in NDC.
-// -------------------------------------------------
-unsigned int cubeVAO = 0;
-unsigned int cubeVBO = 0;
-void renderCube()
+// stream VAO of a mesh skinned before the passes (m_skinningMode), 0: the pass shaders skin it
+GLuint PreSkinnedVAO(const Mesh& mesh, bool depthOnly) {
+    if (m_skinningMode == SKINNING_MODE_FEEDBACK)
+        return m_skinningCache.VAO(mesh, depthOnly);
+    if (m_skinningMode == SKINNING_MODE_CPU)
+        return m_cpuSkinning.VAO(mesh, depthOnly);
+    return 0;
+}
+
+// one packet for an arena mesh, optionally drawn once per instance matrix
+void QueueMesh(RenderPass pass, const Shader& shader, Mesh& mesh, const glm::mat4& world, bool depthOnly,
+    int lod, const glm::mat4* instances, GLsizei instanceCount) {
+    if (mesh.range.page < 0)
+        return;
+    lod = std::min(lod, mesh.LodCount() - 1);
+    const MeshLod& level = mesh.lods[lod];
+    if (IsShadingPass(pass)) {
+        int copies = instanceCount > 0 ? instanceCount : 1;
+        m_lodStats.triangles += level.indexCount / 3 * copies;
+        m_lodStats.fullTriangles += mesh.lods[0].indexCount / 3 * copies;
+        m_lodStats.vertices += level.vertexCount * copies;
+        m_lodStats.fullVertices += mesh.lods[0].vertexCount * copies;
+    }
+    DrawPacket packet;
+    packet.pass = pass;
+    // programs skinning from the bone palette (those with a static variant) can draw the
+    // pre-skinned streams instead, which start at the mesh's first vertex
+    bool paletteSkinning = &ShaderForFormat(shader, VERTEX_FORMAT_STATIC) != &shader;
+    GLuint skinnedVAO = paletteSkinning ? PreSkinnedVAO(mesh, depthOnly) : 0;
+    if (paletteSkinning && mesh.Format() == VERTEX_FORMAT_SKINNED && skinnedVAO == 0)
+        m_shaderSkinnedVertices += level.vertexCount * (instanceCount > 0 ? instanceCount : 1);
+    packet.shader = &ShaderForFormat(shader, skinnedVAO != 0 ? VERTEX_FORMAT_STATIC : mesh.Format());
+    packet.material = depthOnly ? nullptr : &mesh.material;
+    packet.vao = skinnedVAO != 0 ? skinnedVAO : GeometryArena::Get().VAO(mesh.range.page, depthOnly);
+    packet.indexType = mesh.range.indexType;
+    packet.first = skinnedVAO != 0 ? 0 : mesh.range.baseVertex;
+    packet.count = level.indexCount;
+    packet.indexOffset = mesh.LodIndexOffset(lod);
+    packet.model = world;
+    packet.instances = instances;
+    packet.instanceCount = instanceCount;
+    packet.depth = glm::length(glm::vec3(world[3]) - camera.Position);
+    m_renderQueue.Add(packet);
+}
+
+// one packet per mesh, meshes with fewer levels use their coarsest
+void QueueModel(RenderPass pass, const Shader& shader, Model& model, const glm::mat4& world, bool depthOnly, int lod) {
+    for (Mesh& mesh : model.meshes)
+        QueueMesh(pass, shader, mesh, world, depthOnly, lod);
+}
+
+// packets of a visible scene node; the depth passes sample no textures,
+// only position (+ skinning) streams are fetched
+void QueueSceneNode(RenderPass pass, int node) {
+    const SceneDrawable& drawable = m_drawables[m_scene.UserData(node)];
+    bool depthOnly = !IsShadingPass(pass);
+    if (IsShadowPass(pass) && !drawable.castShadow)
+        return;
+    const Shader& shader = IsShadowPass(pass) ? simpleDepthShader
+        : pass == RENDER_PASS_MAIN ? *drawable.shader
+        : pass == RENDER_PASS_GBUFFER ? gBufferShader : occluderDepthShader;
+    // levels are picked from the camera, the depth passes reuse them
+    int lod = SelectLod(node);
+    if (IsShadingPass(pass))
+        m_lodStats.objects[std::min(lod, MAX_LOD_LEVELS - 1)]++;
+    if (drawable.mesh)
+        QueueMesh(pass, shader, *drawable.mesh, m_scene.World(node), depthOnly, lod);
+    else if (drawable.model)
+        QueueModel(pass, shader, *drawable.model, m_scene.World(node), depthOnly, lod);
+}
+
+// all crowd instances of ourModel in one instanced packet per mesh, culled as a whole.
+// the level comes from the camera distance to the closest point of the crowd, so no instance
+// is coarser than its own distance allows; like SelectLod every pass gets the same level
+void QueueCrowd(RenderPass pass, const Shader& shader, const Frustum& frustum) {
+    if (m_crowdInstances.empty())
+        return;
+    if (m_frustumCulling && !frustum.TestBox(m_crowdBounds.Center(), m_crowdBounds.Extents()))
+        return;
+    const glm::mat4& instance = m_crowdInstances[0];
+    float scale = std::max(glm::length(glm::vec3(instance[0])), std::max(glm::length(glm::vec3(instance[1])), glm::length(glm::vec3(instance[2]))));
+    m_crowdLod = m_lodEnabled ? PickLod(m_drawables[DRAWABLE_CHARACTER].lodErrors, m_crowdBounds, scale, m_crowdLod) : 0;
+    if (IsShadingPass(pass))
+        m_lodStats.objects[std::min(m_crowdLod, MAX_LOD_LEVELS - 1)] += (int)m_crowdInstances.size();
+    for (Mesh& mesh : ourModel.meshes)
+        QueueMesh(pass, shader, mesh, glm::mat4(1.0f), !IsShadingPass(pass), m_crowdLod, m_crowdInstances.data(), (GLsizei)m_crowdInstances.size());
+}
+
+int SelectLod(int node) {
+    const SceneDrawable& drawable = m_drawables[m_scene.UserData(node)];
+    if (!m_lodEnabled || drawable.lodErrors.size() <= 1)
+        return 0;
+    if (node >= (int)m_nodeLod.size())
+        m_nodeLod.resize(node + 1, 0);
+    const glm::mat4& world = m_scene.World(node);
+    float scale = std::max(glm::length(glm::vec3(world[0])), std::max(glm::length(glm::vec3(world[1])), glm::length(glm::vec3(world[2]))));
+    int lod = PickLod(drawable.lodErrors, m_scene.WorldBounds(node), scale, m_nodeLod[node]);
+    m_nodeLod[node] = (uint8_t)lod;
+    return lod;
+}
+
+// level whose object space error (lodErrors, scaled to world by scale) projects to at most
+// m_lodPixelError at the distance of bounds, moving from the current level with hysteresis
+int PickLod(const vector<float>& lodErrors, const AABB& bounds, float scale, int current) {
+    int levels = (int)lodErrors.size();
+    if (levels <= 1)
+        return 0;
+    // distance to the closest point of the world box; inside it everything is full detail
+    float distance = glm::length(glm::clamp(camera.Position, bounds.min, bounds.max) - camera.Position);
+    if (distance <= 0.0f)
+        return 0;
+    // pixels covered by one world unit at this distance
+    float pixelsPerUnit = (float)SCR_HEIGHT / (2.0f * std::tan(glm::radians(camera.Zoom) * 0.5f) * distance);
+    auto projectedError = [&](int lod) { return lodErrors[lod] * scale * pixelsPerUnit; };
+
+    int lod = std::min(current, levels - 1);
+    while (lod > 0 && projectedError(lod) > m_lodPixelError)
+        lod--;
+    while (lod + 1 < levels && projectedError(lod + 1) <= m_lodPixelError * (1.0f - LOD_HYSTERESIS))
+        lod++;
+    return lod;
+}
+
+// largest error at each level over the meshes (a mesh past its last level stays there)
+vector<float> ComputeLodErrors(const vector<Mesh*>& meshes) {
+    int levels = 0;
+    for (const Mesh* mesh : meshes)
+        levels = std::max(levels, mesh->LodCount());
+    vector<float> errors(levels, 0.0f);
+    for (const Mesh* mesh : meshes)
+        for (int lod = 0; lod < levels && mesh->LodCount() > 0; lod++)
+            errors[lod] = std::max(errors[lod], mesh->lods[std::min(lod, mesh->LodCount() - 1)].error);
+    return errors;
+}
+
+// drawables and the node hierarchy: static floor / wall, the container field group and
+// the character group. skinned models use the clip's conservative bounds instead of the bind pose
+void BuildScene() {
+    m_drawables[DRAWABLE_FLOOR].mesh = &floorMesh;
+    m_drawables[DRAWABLE_FLOOR].shader = &shader;
+    // 깊이 테스트에서 항상 가려지던 lightingShader 바닥 드로우는 제거
+    m_drawables[DRAWABLE_BRICK].mesh = &brickMesh;
+    m_drawables[DRAWABLE_BRICK].shader = &normalShader;
+    m_drawables[DRAWABLE_BRICK].castShadow = false;
+    m_drawables[DRAWABLE_CUBE].mesh = &cubeMesh;
+    m_drawables[DRAWABLE_CUBE].shader = &lightingShader;
+    m_drawables[DRAWABLE_CHARACTER].model = &ourModel;
+    m_drawables[DRAWABLE_CHARACTER].clip = &danceAnimation;
+    m_drawables[DRAWABLE_CHARACTER].shader = &ourShader;
+    m_drawables[DRAWABLE_CHARACTER].dynamic = true;
+    for (SceneDrawable& drawable : m_drawables) {
+        vector<Mesh*> meshes;
+        if (drawable.mesh)
+            meshes.push_back(drawable.mesh);
+        if (drawable.model)
+            for (Mesh& mesh : drawable.model->meshes)
+                meshes.push_back(&mesh);
+        drawable.lodErrors = ComputeLodErrors(meshes);
+    }
+
+    glm::mat4 identity = glm::mat4(1.0f);
+    m_scene.CreateNode(Scene::kNoParent, identity, floorMesh.bounds, DRAWABLE_FLOOR);
+
+    // normal mapped quad
+    glm::mat4 modelN = glm::mat4(1.0f);
+    // modelN = glm::rotate(modelN, glm::radians((float)glfwGetTime() * -10.0f), glm::normalize(glm::vec3(1.0, 0.0, 1.0))); // rotate the quad to show normal mapping from multiple directions
+    modelN = glm::translate(modelN, glm::vec3(4.0f, 2.0f, 0.2f));
+    modelN = glm::scale(modelN, glm::vec3(2.5f));
+    m_scene.CreateNode(Scene::kNoParent, modelN, brickMesh.bounds, DRAWABLE_BRICK);
+
+    m_cubeFieldNode = m_scene.CreateNode(Scene::kNoParent, glm::translate(identity, m_cubeFieldOffset));
+    UpdateCubeField();
+
+    m_characterGroupNode = m_scene.CreateNode(Scene::kNoParent, identity);
+    UpdateCharacterNodes();
+}
+
+// square grid of small containers behind the model, resting on the floor
+void UpdateCubeField() {
+    for (int node : m_cubeNodes)
+        m_scene.DestroyNode(node);
+    m_cubeNodes.resize(m_cubeCount);
+    int columns = (int)std::ceil(std::sqrt((float)m_cubeCount));
+    for (int i = 0; i < m_cubeCount; ++i) {
+        float x = ((float)(i % columns) - (columns - 1) * 0.5f) * 0.8f;
+        float z = -4.0f - (float)(i / columns) * 0.8f;
+        glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(x, -0.25f, z));
+        model = glm::rotate(model, glm::radians(20.0f * i), glm::vec3(0.0f, 1.0f, 0.0f));
+        model = glm::scale(model, glm::vec3(0.25f));
+        m_cubeNodes[i] = m_scene.CreateNode(m_cubeFieldNode, model, cubeMesh.bounds, DRAWABLE_CUBE);
+    }
+    m_shadowMap.InvalidateStatic();
+}
+
+// square grid of character instances centered on the base model.
+// unchanged transforms are ignored by the scene, so this is cheap to call every frame
+void UpdateCharacterNodes() {
+    while ((int)m_characterNodes.size() > m_modelInstances) {
+        m_scene.DestroyNode(m_characterNodes.back());
+        m_characterNodes.pop_back();
+    }
+    glm::mat4 baseModel = GetOurModelMatrix();
+    const AABB& bounds = danceAnimation.GetBounds();
+    int columns = (int)std::ceil(std::sqrt((float)m_modelInstances));
+    for (int i = 0; i < m_modelInstances; ++i) {
+        float x = (float)(i % columns) - (columns - 1) * 0.5f;
+        float z = (float)(i / columns) - (columns - 1) * 0.5f;
+        glm::mat4 offset = glm::translate(glm::mat4(1.0f), glm::vec3(x, 0.0f, z) * m_instanceSpacing);
+        if (i < (int)m_characterNodes.size())
+            m_scene.SetLocalTransform(m_characterNodes[i], offset * baseModel);
+        else
+            m_characterNodes.push_back(m_scene.CreateNode(m_characterGroupNode, offset * baseModel, bounds, DRAWABLE_CHARACTER));
+    }
+}
+
+// grid of crowd instances behind the scene, rebuilt when the count or spacing changes.
+// clip offsets / play rates come from a fixed seed, so the crowd does not reshuffle
+void UpdateCrowd() {
+    if (m_crowdBuiltCount == m_crowdCount && m_crowdBuiltSpacing == m_crowdSpacing)
+        return;
+    m_crowdBuiltCount = m_crowdCount;
+    m_crowdBuiltSpacing = m_crowdSpacing;
+
+    m_crowdInstances.resize(m_crowdCount);
+    m_crowdBounds = AABB();
+    if (m_crowdCount == 0 || m_bakedAnimation.ClipCount() == 0)
+        return;
+    std::mt19937 random(7);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    glm::mat4 baseModel = GetOurModelMatrix();
+    int columns = (int)std::ceil(std::sqrt((float)m_crowdCount));
+    for (int i = 0; i < m_crowdCount; i++) {
+        float x = ((float)(i % columns) - (columns - 1) * 0.5f) * m_crowdSpacing;
+        float z = -4.0f - (float)(i / columns) * m_crowdSpacing;
+        glm::mat4 instance = glm::translate(glm::mat4(1.0f), glm::vec3(x, 0.0f, z)) * baseModel;
+        m_crowdBounds.Expand(danceAnimation.GetBounds().Transformed(instance));
+        int clip = (int)(unit(random) * m_bakedAnimation.ClipCount()) % m_bakedAnimation.ClipCount();
+        instance[0][3] = (float)clip;
+        instance[1][3] = unit(random) * m_bakedAnimation.ClipSeconds(clip);
+        instance[2][3] = 0.8f + 0.4f * unit(random);
+        m_crowdInstances[i] = instance;
+    }
+}
+
+// the four scene lights, then m_pointLightCount - 4 random ones (fixed seed, so the field
+// only grows or shrinks when the count changes)
+void UpdatePointLights() {
+    m_pointLights.resize(m_pointLightCount);
+    for (int i = 0; i < 4 && i < m_pointLightCount; i++) {
+        PointLight& light = m_pointLights[i];
+        light.position = pointLightPositions[i];
+        light.ambient = glm::vec3(0.5f);
+        light.diffuse = glm::vec3(0.8f);
+        light.specular = glm::vec3(1.0f);
+        light.constant = POINT_LIGHT_CONSTANT;
+        light.linear = POINT_LIGHT_LINEAR;
+        light.quadratic = POINT_LIGHT_QUADRATIC;
+    }
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    for (int i = 4; i < m_pointLightCount; i++) {
+        PointLight& light = m_pointLights[i];
+        light.position = glm::vec3(-12.0f + 24.0f * unit(random), -0.4f + 1.6f * unit(random), 2.0f - 32.0f * unit(random));
+        glm::vec3 color(unit(random), unit(random), unit(random));
+        color /= std::max(std::max(color.r, color.g), std::max(color.b, 0.001f));
+        light.ambient = glm::vec3(0.0f);
+        light.diffuse = color;
+        light.specular = color * 0.5f;
+        // short range: about 5 units
+        light.constant = 1.0f;
+        light.linear = 0.7f;
+        light.quadratic = 1.8f;
+    }
+}
+
+// every program with variants; the setups run once per compiled variant and only assign the
+// units outside the materials (shadow map, light buffers, baked bones): material samplers
+// get theirs from Material::SamplerUnit
+void RegisterShaders() {
+    ShaderLibrary& library = ShaderLibrary::Get();
+    library.Register("lighting", "./shader/lighting.vs", "./shader/lighting.fs", [](const Shader& program) {
+        program.setInt("lightData", LIGHT_DATA_UNIT);
+        program.setInt("clusterGrid", CLUSTER_GRID_UNIT);
+        program.setInt("lightIndices", LIGHT_INDEX_UNIT);
+    });
+    library.Register("gbuffer", "./shader/lighting.vs", "./shader/gbuffer.fs");
+    //shadow rendering 위해 추가
+    library.Register("shadow_mapping", "./shader/shadow_mapping.vs", "./shader/shadow_mapping.fs", [](const Shader& program) {
+        program.setInt("shadowMap", SHADOW_MAP_UNIT);
+    });
+    // same sources, different per-frame uniforms: light matrices vs the camera
+    library.Register("shadow_depth", "./shader/simpleDepthShader.vs", "./shader/simpleDepthShader.fs", [](const Shader& program) {
+        program.setInt("bakedBones", BAKED_BONES_UNIT);
+    });
+    library.Register("camera_depth", "./shader/simpleDepthShader.vs", "./shader/simpleDepthShader.fs", [](const Shader& program) {
+        program.setInt("bakedBones", BAKED_BONES_UNIT);
+    });
+    library.Register("normal_mapping", "./shader/normal_mapping.vs", "./shader/normal_mapping.fs");
+    library.Register("anim_model", "./shader/anim_model.vs", "./shader/anim_model.fs", [](const Shader& program) {
+        program.setInt("bakedBones", BAKED_BONES_UNIT);
+    });
+}
+
+// points the Shader globals (and so the drawables and passes using them) at the variants of
+// the current switches; already compiled variants are reused
+void SelectShaderVariants() {
+    ShaderLibrary& library = ShaderLibrary::Get();
+    lightingShader = library.Variant("lighting", ShaderDefines()
+        .Set("CLUSTER_X", LightClusters::kGridX)
+        .Set("CLUSTER_Y", LightClusters::kGridY)
+        .Set("CLUSTER_Z", LightClusters::kGridZ));
+    gBufferShader = library.Variant("gbuffer");
+    shader = library.Variant("shadow_mapping", ShaderDefines().Set("SHADOW_FILTER", m_shadowQuality));
+    simpleDepthShader = library.Variant("shadow_depth", ShaderDefines().Set("SKINNING", 1));
+    occluderDepthShader = library.Variant("camera_depth", ShaderDefines().Set("SKINNING", 1));
+    normalShader = library.Variant("normal_mapping", ShaderDefines().Set("NORMAL_MAPPING", m_normalMapping ? 1 : 0));
+    ourShader = library.Variant("anim_model", ShaderDefines().Set("SKINNING", 1));
+    staticDepthShader = library.Variant("shadow_depth", ShaderDefines().Set("SKINNING", 0));
+    staticOccluderDepthShader = library.Variant("camera_depth", ShaderDefines().Set("SKINNING", 0));
+    staticModelShader = library.Variant("anim_model", ShaderDefines().Set("SKINNING", 0));
+    crowdShader = library.Variant("anim_model", ShaderDefines().Set("SKINNING", 1).Set("BAKED_ANIMATION", 1));
+    crowdDepthShader = library.Variant("shadow_depth", ShaderDefines().Set("SKINNING", 1).Set("BAKED_ANIMATION", 1));
+    crowdPrepassShader = library.Variant("camera_depth", ShaderDefines().Set("SKINNING", 1).Set("BAKED_ANIMATION", 1));
+}
+
+// directional + spot light and the material constants of lighting.fs; the deferred resolve
+// programs take the same uniforms. the shader must be in use
+void SetSceneLights(const Shader& shader) {
+    // directional light
+    shader.setVec3("dirLight.direction", -0.2f, -1.0f, -0.3f);
+    shader.setVec3("dirLight.ambient", 0.2f, 0.2f, 0.2f);
+    shader.setVec3("dirLight.diffuse", 0.9f, 0.9f, 0.9f);
+    shader.setVec3("dirLight.specular", 0.7f, 0.7f, 0.7f);
+    // spotLight
+    shader.setVec3("spotLight.position", camera.Position);
+    shader.setVec3("spotLight.direction", camera.Front);
+    shader.setVec3("spotLight.ambient", 0.0f, 0.0f, 0.0f);
+    shader.setVec3("spotLight.diffuse", 0.3f, 0.3f, 0.3f);
+    shader.setVec3("spotLight.specular", 0.3f, 0.3f, 0.3f);
+    shader.setFloat("spotLight.constant", 1.0f);
+    shader.setFloat("spotLight.linear", 0.022f);
+    shader.setFloat("spotLight.quadratic", 0.0019f);
+    shader.setFloat("spotLight.cutOff", glm::cos(glm::radians(12.5f)));
+    shader.setFloat("spotLight.outerCutOff", glm::cos(glm::radians(15.0f)));
+
+    shader.setVec3("viewPos", camera.Position);
+
+    // material properties
+    shader.setFloat("material.shininess", m_materialShininess);
+}
+
+// objects shaded by lighting.fs go through the G-buffer in deferred mode
+bool IsDeferred(int node) {
+    return m_drawables[m_scene.UserData(node)].shader == &lightingShader;
+}
+
+// advances the benchmark by a frame; called at the start of Render so a step's
+// settings are in place for the whole frame
+void UpdateLightingBenchmark() {
+    LightingBenchmark& bench = m_benchmark;
+    if (!bench.running)
+        return;
+    if (bench.frame == 0) {
+        m_pointLightCount = BENCHMARK_LIGHT_COUNTS[bench.step / 2];
+        m_lightingMode = bench.step % 2;
+        UpdatePointLights();
+        bench.gpuSum = bench.cpuSum = 0.0;
+    }
+    else if (bench.frame > BENCHMARK_WARMUP_FRAMES) {
+        // results of the previous frame
+        bench.gpuSum += m_renderQueue.FrameMilliseconds();
+        bench.cpuSum += m_renderMilliseconds;
+    }
+    if (++bench.frame <= BENCHMARK_WARMUP_FRAMES + BENCHMARK_FRAMES)
+        return;
+
+    bench.gpuMilliseconds[bench.step / 2][bench.step % 2] = (float)(bench.gpuSum / BENCHMARK_FRAMES);
+    bench.cpuMilliseconds[bench.step / 2][bench.step % 2] = (float)(bench.cpuSum / BENCHMARK_FRAMES);
+    SPDLOG_INFO("benchmark: {} lights, {}: gpu {:.3f} ms, cpu {:.3f} ms", BENCHMARK_LIGHT_COUNTS[bench.step / 2],
+        bench.step % 2 == LIGHTING_FORWARD ? "forward" : "deferred",
+        bench.gpuMilliseconds[bench.step / 2][bench.step % 2], bench.cpuMilliseconds[bench.step / 2][bench.step % 2]);
+    bench.frame = 0;
+    if (++bench.step < BENCHMARK_STEPS * 2)
+        return;
+
+    bench.running = false;
+    bench.done = true;
+    m_pointLightCount = bench.savedLightCount;
+    m_lightingMode = bench.savedMode;
+    UpdatePointLights();
+}
+
+// picks the nearest scene object under the cursor (world boxes, not triangles)
+void PickObject(double x, double y) {
+    // same aspect as the main pass projection
+    glm::vec2 ndc(2.0f * (float)x / SCR_WIDTH - 1.0f, 1.0f - 2.0f * (float)y / SCR_HEIGHT);
+    glm::mat4 inverseViewProjection = glm::inverse(camera.GetViewProjectionMatrix((float)SCR_WIDTH / (float)SCR_HEIGHT));
+    glm::vec4 nearPoint = inverseViewProjection * glm::vec4(ndc, -1.0f, 1.0f);
+    glm::vec4 farPoint = inverseViewProjection * glm::vec4(ndc, 1.0f, 1.0f);
+    glm::vec3 origin = glm::vec3(nearPoint) / nearPoint.w;
+    glm::vec3 direction = glm::vec3(farPoint) / farPoint.w - origin;
+    float length = glm::length(direction);
+    m_pickedNode = m_scene.RayCast(origin, direction / length, length);
+    if (m_pickedNode >= 0)
+        SPDLOG_INFO("picked node {} ({})", m_pickedNode, m_drawableNames[m_scene.UserData(m_pickedNode)]);
+}
+
+// static arena mesh from position / normal / texcoord triangles (8 floats per vertex)
+Mesh MakeStaticMesh(const float* data, size_t vertexCount) {
+    std::vector<Vertex> vertices(vertexCount);
+    for (size_t i = 0; i < vertexCount; ++i) {
+        const float* v = data + i * 8;
+        vertices[i] = Vertex();
+        vertices[i].Position = glm::vec3(v[0], v[1], v[2]);
+        vertices[i].Normal = glm::vec3(v[3], v[4], v[5]);
+        vertices[i].TexCoords = glm::vec2(v[6], v[7]);
+    }
+    return MakeStaticMesh(std::move(vertices));
+}
+
+Mesh MakeStaticMesh(std::vector<Vertex>&& vertices) {
+    std::vector<unsigned int> indices(vertices.size());
+    for (size_t i = 0; i < indices.size(); ++i)
+        indices[i] = (unsigned int)i;
+    return Mesh(std::move(vertices), std::move(indices), std::vector<Texture>());
+}
+
+// 1x1 3D cube in NDC, 36 vertices of position / normal / texcoord
+const float* GetCubeVertices()
 {
-    // initialize (if necessary)
-    if (cubeVAO == 0)
-    {
-        float vertices[] = {
-            // back face
-            -1.0f, -1.0f, -1.0f,  0.0f,  0.0f, -1.0f, 0.0f, 0.0f, // bottom-left
-             1.0f,  1.0f, -1.0f,  0.0f,  0.0f, -1.0f, 1.0f, 1.0f, // top-right
-             1.0f, -1.0f, -1.0f,  0.0f,  0.0f, -1.0f, 1.0f, 0.0f, // bottom-right         
-             1.0f,  1.0f, -1.0f,  0.0f,  0.0f, -1.0f, 1.0f, 1.0f, // top-right
-            -1.0f, -1.0f, -1.0f,  0.0f,  0.0f, -1.0f, 0.0f, 0.0f, // bottom-left
-            -1.0f,  1.0f, -1.0f,  0.0f,  0.0f, -1.0f, 0.0f, 1.0f, // top-left
-            // front face
-            -1.0f, -1.0f,  1.0f,  0.0f,  0.0f,  1.0f, 0.0f, 0.0f, // bottom-left
-             1.0f, -1.0f,  1.0f,  0.0f,  0.0f,  1.0f, 1.0f, 0.0f, // bottom-right
-             1.0f,  1.0f,  1.0f,  0.0f,  0.0f,  1.0f, 1.0f, 1.0f, // top-right
-             1.0f,  1.0f,  1.0f,  0.0f,  0.0f,  1.0f, 1.0f, 1.0f, // top-right
-            -1.0f,  1.0f,  1.0f,  0.0f,  0.0f,  1.0f, 0.0f, 1.0f, // top-left
-            -1.0f, -1.0f,  1.0f,  0.0f,  0.0f,  1.0f, 0.0f, 0.0f, // bottom-left
-            // left face
-            -1.0f,  1.0f,  1.0f, -1.0f,  0.0f,  0.0f, 1.0f, 0.0f, // top-right
-            -1.0f,  1.0f, -1.0f, -1.0f,  0.0f,  0.0f, 1.0f, 1.0f, // top-left
-            -1.0f, -1.0f, -1.0f, -1.0f,  0.0f,  0.0f, 0.0f, 1.0f, // bottom-left
-            -1.0f, -1.0f, -1.0f, -1.0f,  0.0f,  0.0f, 0.0f, 1.0f, // bottom-left
-            -1.0f, -1.0f,  1.0f, -1.0f,  0.0f,  0.0f, 0.0f, 0.0f, // bottom-right
-            -1.0f,  1.0f,  1.0f, -1.0f,  0.0f,  0.0f, 1.0f, 0.0f, // top-right
-            // right face
-             1.0f,  1.0f,  1.0f,  1.0f,  0.0f,  0.0f, 1.0f, 0.0f, // top-left
-             1.0f, -1.0f, -1.0f,  1.0f,  0.0f,  0.0f, 0.0f, 1.0f, // bottom-right
-             1.0f,  1.0f, -1.0f,  1.0f,  0.0f,  0.0f, 1.0f, 1.0f, // top-right         
-             1.0f, -1.0f, -1.0f,  1.0f,  0.0f,  0.0f, 0.0f, 1.0f, // bottom-right
-             1.0f,  1.0f,  1.0f,  1.0f,  0.0f,  0.0f, 1.0f, 0.0f, // top-left
-             1.0f, -1.0f,  1.0f,  1.0f,  0.0f,  0.0f, 0.0f, 0.0f, // bottom-left     
-            // bottom face
-            -1.0f, -1.0f, -1.0f,  0.0f, -1.0f,  0.0f, 0.0f, 1.0f, // top-right
-             1.0f, -1.0f, -1.0f,  0.0f, -1.0f,  0.0f, 1.0f, 1.0f, // top-left
-             1.0f, -1.0f,  1.0f,  0.0f, -1.0f,  0.0f, 1.0f, 0.0f, // bottom-left
-             1.0f, -1.0f,  1.0f,  0.0f, -1.0f,  0.0f, 1.0f, 0.0f, // bottom-left
-            -1.0f, -1.0f,  1.0f,  0.0f, -1.0f,  0.0f, 0.0f, 0.0f, // bottom-right
-            -1.0f, -1.0f, -1.0f,  0.0f, -1.0f,  0.0f, 0.0f, 1.0f, // top-right
-            // top face
-            -1.0f,  1.0f, -1.0f,  0.0f,  1.0f,  0.0f, 0.0f, 1.0f, // top-left
-             1.0f,  1.0f , 1.0f,  0.0f,  1.0f,  0.0f, 1.0f, 0.0f, // bottom-right
-             1.0f,  1.0f, -1.0f,  0.0f,  1.0f,  0.0f, 1.0f, 1.0f, // top-right     
-             1.0f,  1.0f,  1.0f,  0.0f,  1.0f,  0.0f, 1.0f, 0.0f, // bottom-right
-            -1.0f,  1.0f, -1.0f,  0.0f,  1.0f,  0.0f, 0.0f, 1.0f, // top-left
-            -1.0f,  1.0f,  1.0f,  0.0f,  1.0f,  0.0f, 0.0f, 0.0f  // bottom-left        
-        };
-        glGenVertexArrays(1, &cubeVAO);
-        glGenBuffers(1, &cubeVBO);
-        // fill buffer
-        glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-        // link vertex attributes
-        glBindVertexArray(cubeVAO);
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-        glBindVertexArray(0);
-    }
-    // render Cube
-    glBindVertexArray(cubeVAO);
-    glDrawArrays(GL_TRIANGLES, 0, 36);
-    glBindVertexArray(0);
-}
-
-// renderQuad() renders a 1x1 XY quad in NDC
-// -----------------------------------------
-unsigned int quadVAO = 0;
-unsigned int quadVBO;
-void renderQuad()
+    static const float vertices[] = {
+        // back face
+        -1.0f, -1.0f, -1.0f,  0.0f,  0.0f, -1.0f, 0.0f, 0.0f, // bottom-left
+         1.0f,  1.0f, -1.0f,  0.0f,  0.0f, -1.0f, 1.0f, 1.0f, // top-right
+         1.0f, -1.0f, -1.0f,  0.0f,  0.0f, -1.0f, 1.0f, 0.0f, // bottom-right         
+         1.0f,  1.0f, -1.0f,  0.0f,  0.0f, -1.0f, 1.0f, 1.0f, // top-right
+        -1.0f, -1.0f, -1.0f,  0.0f,  0.0f, -1.0f, 0.0f, 0.0f, // bottom-left
+        -1.0f,  1.0f, -1.0f,  0.0f,  0.0f, -1.0f, 0.0f, 1.0f, // top-left
+        // front face
+        -1.0f, -1.0f,  1.0f,  0.0f,  0.0f,  1.0f, 0.0f, 0.0f, // bottom-left
+         1.0f, -1.0f,  1.0f,  0.0f,  0.0f,  1.0f, 1.0f, 0.0f, // bottom-right
+         1.0f,  1.0f,  1.0f,  0.0f,  0.0f,  1.0f, 1.0f, 1.0f, // top-right
+         1.0f,  1.0f,  1.0f,  0.0f,  0.0f,  1.0f, 1.0f, 1.0f, // top-right
+        -1.0f,  1.0f,  1.0f,  0.0f,  0.0f,  1.0f, 0.0f, 1.0f, // top-left
+        -1.0f, -1.0f,  1.0f,  0.0f,  0.0f,  1.0f, 0.0f, 0.0f, // bottom-left
+        // left face
+        -1.0f,  1.0f,  1.0f, -1.0f,  0.0f,  0.0f, 1.0f, 0.0f, // top-right
+        -1.0f,  1.0f, -1.0f, -1.0f,  0.0f,  0.0f, 1.0f, 1.0f, // top-left
+        -1.0f, -1.0f, -1.0f, -1.0f,  0.0f,  0.0f, 0.0f, 1.0f, // bottom-left
+        -1.0f, -1.0f, -1.0f, -1.0f,  0.0f,  0.0f, 0.0f, 1.0f, // bottom-left
+        -1.0f, -1.0f,  1.0f, -1.0f,  0.0f,  0.0f, 0.0f, 0.0f, // bottom-right
+        -1.0f,  1.0f,  1.0f, -1.0f,  0.0f,  0.0f, 1.0f, 0.0f, // top-right
+        // right face
+         1.0f,  1.0f,  1.0f,  1.0f,  0.0f,  0.0f, 1.0f, 0.0f, // top-left
+         1.0f, -1.0f, -1.0f,  1.0f,  0.0f,  0.0f, 0.0f, 1.0f, // bottom-right
+         1.0f,  1.0f, -1.0f,  1.0f,  0.0f,  0.0f, 1.0f, 1.0f, // top-right         
+         1.0f, -1.0f, -1.0f,  1.0f,  0.0f,  0.0f, 0.0f, 1.0f, // bottom-right
+         1.0f,  1.0f,  1.0f,  1.0f,  0.0f,  0.0f, 1.0f, 0.0f, // top-left
+         1.0f, -1.0f,  1.0f,  1.0f,  0.0f,  0.0f, 0.0f, 0.0f, // bottom-left     
+        // bottom face
+        -1.0f, -1.0f, -1.0f,  0.0f, -1.0f,  0.0f, 0.0f, 1.0f, // top-right
+         1.0f, -1.0f, -1.0f,  0.0f, -1.0f,  0.0f, 1.0f, 1.0f, // top-left
+         1.0f, -1.0f,  1.0f,  0.0f, -1.0f,  0.0f, 1.0f, 0.0f, // bottom-left
+         1.0f, -1.0f,  1.0f,  0.0f, -1.0f,  0.0f, 1.0f, 0.0f, // bottom-left
+        -1.0f, -1.0f,  1.0f,  0.0f, -1.0f,  0.0f, 0.0f, 0.0f, // bottom-right
+        -1.0f, -1.0f, -1.0f,  0.0f, -1.0f,  0.0f, 0.0f, 1.0f, // top-right
+        // top face
+        -1.0f,  1.0f, -1.0f,  0.0f,  1.0f,  0.0f, 0.0f, 1.0f, // top-left
+         1.0f,  1.0f , 1.0f,  0.0f,  1.0f,  0.0f, 1.0f, 0.0f, // bottom-right
+         1.0f,  1.0f, -1.0f,  0.0f,  1.0f,  0.0f, 1.0f, 1.0f, // top-right     
+         1.0f,  1.0f,  1.0f,  0.0f,  1.0f,  0.0f, 1.0f, 0.0f, // bottom-right
+        -1.0f,  1.0f, -1.0f,  0.0f,  1.0f,  0.0f, 0.0f, 1.0f, // top-left
+        -1.0f,  1.0f,  1.0f,  0.0f,  1.0f,  0.0f, 0.0f, 0.0f  // bottom-left        
+    };
+    return vertices;
+}
+
+// 1x1 XY quad (two triangles) with tangent space for normal mapping
+std::vector<Vertex> BuildBrickQuadVertices()
 {
-    if (quadVAO == 0)
-    {
-        // positions
-        glm::vec3 pos1(-1.0f,  1.0f, 0.0f);
-        glm::vec3 pos2(-1.0f, -1.0f, 0.0f);
-        glm::vec3 pos3( 1.0f, -1.0f, 0.0f);
-        glm::vec3 pos4( 1.0f,  1.0f, 0.0f);
-        // texture coordinates
-        glm::vec2 uv1(0.0f, 1.0f);
-        glm::vec2 uv2(0.0f, 0.0f);
-        glm::vec2 uv3(1.0f, 0.0f);  
-        glm::vec2 uv4(1.0f, 1.0f);
-        // normal vector
-        glm::vec3 nm(0.0f, 0.0f, 1.0f);
-
-        // calculate tangent/bitangent vectors of both triangles
-        glm::vec3 tangent1, bitangent1;
-        glm::vec3 tangent2, bitangent2;
-        // triangle 1
-        // ----------
-        glm::vec3 edge1 = pos2 - pos1;
-        glm::vec3 edge2 = pos3 - pos1;
-        glm::vec2 deltaUV1 = uv2 - uv1;
-        glm::vec2 deltaUV2 = uv3 - uv1;
-
-        float f = 1.0f / (deltaUV1.x * deltaUV2.y - deltaUV2.x * deltaUV1.y);
-
-        tangent1.x = f * (deltaUV2.y * edge1.x - deltaUV1.y * edge2.x);
-        tangent1.y = f * (deltaUV2.y * edge1.y - deltaUV1.y * edge2.y);
-        tangent1.z = f * (deltaUV2.y * edge1.z - deltaUV1.y * edge2.z);
-
-        bitangent1.x = f * (-deltaUV2.x * edge1.x + deltaUV1.x * edge2.x);
-        bitangent1.y = f * (-deltaUV2.x * edge1.y + deltaUV1.x * edge2.y);
-        bitangent1.z = f * (-deltaUV2.x * edge1.z + deltaUV1.x * edge2.z);
-
-        // triangle 2
-        // ----------
-        edge1 = pos3 - pos1;
-        edge2 = pos4 - pos1;
-        deltaUV1 = uv3 - uv1;
-        deltaUV2 = uv4 - uv1;
-
-        f = 1.0f / (deltaUV1.x * deltaUV2.y - deltaUV2.x * deltaUV1.y);
-
-        tangent2.x = f * (deltaUV2.y * edge1.x - deltaUV1.y * edge2.x);
-        tangent2.y = f * (deltaUV2.y * edge1.y - deltaUV1.y * edge2.y);
-        tangent2.z = f * (deltaUV2.y * edge1.z - deltaUV1.y * edge2.z);
-
-
-        bitangent2.x = f * (-deltaUV2.x * edge1.x + deltaUV1.x * edge2.x);
-        bitangent2.y = f * (-deltaUV2.x * edge1.y + deltaUV1.x * edge2.y);
-        bitangent2.z = f * (-deltaUV2.x * edge1.z + deltaUV1.x * edge2.z);
-
-
-        float quadVertices[] = {
-            // positions            // normal         // texcoords  // tangent                          // bitangent
-            pos1.x, pos1.y, pos1.z, nm.x, nm.y, nm.z, uv1.x, uv1.y, tangent1.x, tangent1.y, tangent1.z, bitangent1.x, bitangent1.y, bitangent1.z,
-            pos2.x, pos2.y, pos2.z, nm.x, nm.y, nm.z, uv2.x, uv2.y, tangent1.x, tangent1.y, tangent1.z, bitangent1.x, bitangent1.y, bitangent1.z,
-            pos3.x, pos3.y, pos3.z, nm.x, nm.y, nm.z, uv3.x, uv3.y, tangent1.x, tangent1.y, tangent1.z, bitangent1.x, bitangent1.y, bitangent1.z,
-
-            pos1.x, pos1.y, pos1.z, nm.x, nm.y, nm.z, uv1.x, uv1.y, tangent2.x, tangent2.y, tangent2.z, bitangent2.x, bitangent2.y, bitangent2.z,
-            pos3.x, pos3.y, pos3.z, nm.x, nm.y, nm.z, uv3.x, uv3.y, tangent2.x, tangent2.y, tangent2.z, bitangent2.x, bitangent2.y, bitangent2.z,
-            pos4.x, pos4.y, pos4.z, nm.x, nm.y, nm.z, uv4.x, uv4.y, tangent2.x, tangent2.y, tangent2.z, bitangent2.x, bitangent2.y, bitangent2.z
-        };
-        // configure plane VAO
-        glGenVertexArrays(1, &quadVAO);
-        glGenBuffers(1, &quadVBO);
-        glBindVertexArray(quadVAO);
-        glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), &quadVertices, GL_STATIC_DRAW);
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 14 * sizeof(float), (void*)0);
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 14 * sizeof(float), (void*)(3 * sizeof(float)));
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 14 * sizeof(float), (void*)(6 * sizeof(float)));
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, 14 * sizeof(float), (void*)(8 * sizeof(float)));
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, 14 * sizeof(float), (void*)(11 * sizeof(float)));
-    }
-    glBindVertexArray(quadVAO);
-    glDrawArrays(GL_TRIANGLES, 0, 6);
-    glBindVertexArray(0);
+    // positions
+    glm::vec3 pos1(-1.0f,  1.0f, 0.0f);
+    glm::vec3 pos2(-1.0f, -1.0f, 0.0f);
+    glm::vec3 pos3( 1.0f, -1.0f, 0.0f);
+    glm::vec3 pos4( 1.0f,  1.0f, 0.0f);
+    // texture coordinates
+    glm::vec2 uv1(0.0f, 1.0f);
+    glm::vec2 uv2(0.0f, 0.0f);
+    glm::vec2 uv3(1.0f, 0.0f);  
+    glm::vec2 uv4(1.0f, 1.0f);
+    // normal vector
+    glm::vec3 nm(0.0f, 0.0f, 1.0f);
+
+    // calculate tangent/bitangent vectors of both triangles
+    glm::vec3 tangent1, bitangent1;
+    glm::vec3 tangent2, bitangent2;
+    // triangle 1
+    // ----------
+    glm::vec3 edge1 = pos2 - pos1;
+    glm::vec3 edge2 = pos3 - pos1;
+    glm::vec2 deltaUV1 = uv2 - uv1;
+    glm::vec2 deltaUV2 = uv3 - uv1;
+
+    float f = 1.0f / (deltaUV1.x * deltaUV2.y - deltaUV2.x * deltaUV1.y);
+
+    tangent1.x = f * (deltaUV2.y * edge1.x - deltaUV1.y * edge2.x);
+    tangent1.y = f * (deltaUV2.y * edge1.y - deltaUV1.y * edge2.y);
+    tangent1.z = f * (deltaUV2.y * edge1.z - deltaUV1.y * edge2.z);
+
+    bitangent1.x = f * (-deltaUV2.x * edge1.x + deltaUV1.x * edge2.x);
+    bitangent1.y = f * (-deltaUV2.x * edge1.y + deltaUV1.x * edge2.y);
+    bitangent1.z = f * (-deltaUV2.x * edge1.z + deltaUV1.x * edge2.z);
+
+    // triangle 2
+    // ----------
+    edge1 = pos3 - pos1;
+    edge2 = pos4 - pos1;
+    deltaUV1 = uv3 - uv1;
+    deltaUV2 = uv4 - uv1;
+
+    f = 1.0f / (deltaUV1.x * deltaUV2.y - deltaUV2.x * deltaUV1.y);
+
+    tangent2.x = f * (deltaUV2.y * edge1.x - deltaUV1.y * edge2.x);
+    tangent2.y = f * (deltaUV2.y * edge1.y - deltaUV1.y * edge2.y);
+    tangent2.z = f * (deltaUV2.y * edge1.z - deltaUV1.y * edge2.z);
+
+
+    bitangent2.x = f * (-deltaUV2.x * edge1.x + deltaUV1.x * edge2.x);
+    bitangent2.y = f * (-deltaUV2.x * edge1.y + deltaUV1.x * edge2.y);
+    bitangent2.z = f * (-deltaUV2.x * edge1.z + deltaUV1.x * edge2.z);
+
+    const glm::vec3 positions[6] = { pos1, pos2, pos3, pos1, pos3, pos4 };
+    const glm::vec2 uvs[6] = { uv1, uv2, uv3, uv1, uv3, uv4 };
+    std::vector<Vertex> vertices(6);
+    for (int i = 0; i < 6; ++i) {
+        vertices[i] = Vertex();
+        vertices[i].Position = positions[i];
+        vertices[i].Normal = nm;
+        vertices[i].TexCoords = uvs[i];
+        vertices[i].Tangent = i < 3 ? tangent1 : tangent2;
+        vertices[i].Bitangent = i < 3 ? bitangent1 : bitangent2;
+    }
+    return vertices;
 }
 
 
@@ -761,7 +1587,7 @@ unsigned int loadTexture(const std::string& filepath)
         else if (nrComponents == 4)
             format = GL_RGBA;
 
-        glBindTexture(GL_TEXTURE_2D, textureID);
+        GLState::Get().BindTexture(GL_TEXTURE_2D, textureID);
         glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
         glGenerateMipmap(GL_TEXTURE_2D);
 
@@ -834,6 +1660,10 @@ void MouseMove(double x, double y) {
 }
 
 void MouseButton(int button, int action, double x, double y) {
+    if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS && !m_cameraControl) {
+        if (!ImGui::GetIO().WantCaptureMouse)
+            PickObject(x, y);
+    }
     if (button == GLFW_MOUSE_BUTTON_RIGHT) {
         if (action == GLFW_PRESS) {
         // 마우스 조작 시작 시점에 현재 마우스 커서 위치 저장
@@ -928,15 +1758,20 @@ int main(int argc, const char** argv) {
 
         ProcessInput(window);
         animator.UpdateAnimation(deltaTime);
+        m_crowdTime += deltaTime;
         glfwPollEvents();
 
         ImGui_ImplGlfw_NewFrame();
         ImGui::NewFrame();
 
         Render(); // 렌더링 - 점을 그림
+        m_glStateStats = GLState::Get().Stats();
+        GLState::Get().ResetStats();
 
         ImGui::Render();
         ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        // ImGui 백엔드가 program / VAO / texture / viewport 를 직접 바꾸므로 추적 상태를 초기화
+        GLState::Get().Invalidate();
 
         glfwSwapBuffers(window);
     }
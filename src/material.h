@@ -0,0 +1,168 @@
+#ifndef MATERIAL_H
+#define MATERIAL_H
+
+#include <glad/glad.h>
+
+#include <spdlog/spdlog.h>
+
+#include "shader_m.h"
+
+#include <string>
+#include <vector>
+
+struct Texture {
+    unsigned int id;
+    std::string type;
+    std::string path;
+};
+
+// Texture set of a mesh, resolved once instead of per draw.
+// The sampler uniform names ("material.texture_diffuse1", ...) are built when the material is
+// created. The first time it is bound with a program, the sampler locations are looked up and
+// assigned their texture units (sampler uniforms are program state, so this happens once).
+// The unit comes from the sampler name (SamplerUnit), never from the material, so every
+// material drawn with a program agrees on it and one material can't undo another's assignment.
+// After that, binding is a short loop over integers; units that already hold the texture
+// are skipped by GLState.
+class Material
+{
+public:
+    Material() : id(nextId()) {}
+
+    // material textures use units [0, kUnitCount); the units above hold the shadow map, light data ...
+    static const GLuint kUnitCount = 8;
+
+    // adds a texture sampled through the given uniform; the texture unit follows the name (SamplerUnit)
+    void AddTexture(const std::string& uniformName, GLuint texture)
+    {
+        slots.push_back({ uniformName, texture });
+        programs.clear();
+    }
+
+    // textures typed like Model's loader ("texture_diffuse", "texture_specular", ...)
+    // are numbered per type: texture_diffuse1, texture_diffuse2, texture_specular1 ...
+    void AddTextures(const std::vector<Texture>& textures)
+    {
+        unsigned int diffuseNr = 1;
+        unsigned int specularNr = 1;
+        unsigned int normalNr = 1;
+        unsigned int heightNr = 1;
+        for (size_t i = 0; i < textures.size(); i++)
+        {
+            const std::string& name = textures[i].type;
+            std::string number;
+            if (name == "texture_diffuse")
+                number = std::to_string(diffuseNr++);
+            else if (name == "texture_specular")
+                number = std::to_string(specularNr++);
+            else if (name == "texture_normal")
+                number = std::to_string(normalNr++);
+            else if (name == "texture_height")
+                number = std::to_string(heightNr++);
+            AddTexture(name + number, textures[i].id);
+        }
+    }
+
+    // expects the shader to be in use
+    void Bind(const Shader& shader) const
+    {
+        const std::vector<Binding>& bindings = resolve(shader);
+        for (size_t i = 0; i < bindings.size(); i++)
+        {
+            GLState::Get().BindTexture(bindings[i].unit, GL_TEXTURE_2D, bindings[i].texture);
+        }
+    }
+
+    // number of textures bound for the given program
+    size_t BindingCount(const Shader& shader) const { return resolve(shader).size(); }
+
+    // fixed texture unit of a sampler name: the first texture of each kind has its own unit,
+    // other names get the remaining units in order of first use, for the whole program run
+    static GLuint SamplerUnit(const std::string& uniform)
+    {
+        static const struct { const char* name; GLuint unit; } fixedUnits[] = {
+            { "texture_diffuse1", 0 }, { "diffuseTexture", 0 }, { "diffuseMap", 0 }, { "diffuse", 0 },
+            { "texture_specular1", 1 }, { "specular", 1 },
+            { "texture_normal1", 2 }, { "normalMap", 2 },
+            { "texture_height1", 3 },
+        };
+        const GLuint kFirstSharedUnit = 4;
+        for (const auto& entry : fixedUnits)
+        {
+            if (uniform == entry.name)
+                return entry.unit;
+        }
+        static std::vector<std::string> shared;
+        for (size_t i = 0; i < shared.size(); i++)
+        {
+            if (shared[i] == uniform)
+                return kFirstSharedUnit + (GLuint)i;
+        }
+        if (kFirstSharedUnit + shared.size() >= kUnitCount)
+        {
+            SPDLOG_ERROR("material: no texture unit left for sampler {}", uniform);
+            return kUnitCount - 1;
+        }
+        shared.push_back(uniform);
+        return kFirstSharedUnit + (GLuint)shared.size() - 1;
+    }
+
+    bool Empty() const { return slots.empty(); }
+    // small unique id, used in render queue sort keys
+    unsigned int Id() const { return id; }
+
+private:
+    struct Slot {
+        std::string uniform;
+        GLuint texture;
+    };
+
+    struct Binding {
+        GLint location;
+        GLuint unit;
+        GLuint texture;
+    };
+
+    struct ProgramBindings {
+        GLuint program;
+        std::vector<Binding> bindings;
+    };
+
+    unsigned int id;
+    std::vector<Slot> slots;
+    mutable std::vector<ProgramBindings> programs;
+
+    static unsigned int nextId()
+    {
+        static unsigned int counter = 0;
+        return ++counter;
+    }
+
+    const std::vector<Binding>& resolve(const Shader& shader) const
+    {
+        for (size_t i = 0; i < programs.size(); i++)
+        {
+            if (programs[i].program == shader.ID)
+                return programs[i].bindings;
+        }
+
+        ProgramBindings entry;
+        entry.program = shader.ID;
+        for (size_t i = 0; i < slots.size(); i++)
+        {
+            // model shaders use either "material.texture_diffuse1" or a bare "texture_diffuse1"
+            GLint location = glGetUniformLocation(shader.ID, ("material." + slots[i].uniform).c_str());
+            if (location < 0)
+                location = glGetUniformLocation(shader.ID, slots[i].uniform.c_str());
+            // textures the program doesn't sample are never bound
+            if (location < 0)
+                continue;
+            GLuint unit = SamplerUnit(slots[i].uniform);
+            glUniform1i(location, (GLint)unit);
+            entry.bindings.push_back({ location, unit, slots[i].texture });
+        }
+        programs.push_back(entry);
+        return programs.back().bindings;
+    }
+};
+#endif
@@ -4,16 +4,20 @@
 #include <glad/glad.h> // holds all OpenGL type declarations
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <spdlog/spdlog.h>
 
 #include "shader_m.h"
+#include "geometry_arena.h"
+#include "material.h"
+#include "bounds.h"
 
+#include <algorithm>
 #include <string>
+#include <utility>
 #include <vector>
 
 using namespace std;
 
-#define MAX_BONE_INFLUENCE 4
-
 struct Vertex {
     glm::vec3 Position;
     glm::vec3 Normal;
@@ -23,16 +27,19 @@ struct Vertex {
     glm::vec3 Tangent;
     // bitangent
     glm::vec3 Bitangent;
-	//bone indexes which will influence this vertex
-	int m_BoneIDs[MAX_BONE_INFLUENCE];
+	//bone indexes which will influence this vertex (-1: no bone, static meshes keep them all)
+	int m_BoneIDs[MAX_BONE_INFLUENCE] = { -1, -1, -1, -1 };
 	//weights from each bone
-	float m_Weights[MAX_BONE_INFLUENCE];
+	float m_Weights[MAX_BONE_INFLUENCE] = { 0.0f, 0.0f, 0.0f, 0.0f };
 };
 
-struct Texture {
-    unsigned int id;
-    string type;
-    string path;
+// one level of detail: a slice of the mesh's index range. every level indexes the same
+// vertices, so a level costs only its indices
+struct MeshLod {
+    GLsizei firstIndex = 0;     // in indices, from the start of the mesh's index range
+    GLsizei indexCount = 0;
+    GLsizei vertexCount = 0;    // distinct vertices the level references
+    float error = 0.0f;         // object space deviation from level 0
 };
 
 class Mesh {
@@ -41,90 +48,201 @@ public:
     vector<Vertex> vertices;
     vector<unsigned int> indices;
     vector<Texture> textures;
+    bool skinned;
+    // sampler locations / texture units resolved once, see material.h
+    Material material;
+    // slice of the shared geometry arena holding this mesh's streams and indices
+    GeometryRange range;
+    // object space bounds of the bind pose, computed before the CPU copy is released
+    AABB bounds;
+    BoundingSphere sphere;
+    // skinned meshes: bind pose bounds of the vertices each bone influences (index = bone id),
+    // used to build conservative per-clip bounds (Animation::ComputeMeshBounds)
+    vector<AABB> boneBounds;
+    // level 0 is the full mesh; index ranges of all levels follow each other in `indices`
+    vector<MeshLod> lods;
     /*  함수  */
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+    // geometry is moved in, written straight into the arena and (unless keepCpuData)
+    // released afterwards, so only the GPU copy stays alive
+    Mesh() : skinned(false) {} // default constructor - 전역 변수로 사용할 때
+    // lods describe the levels packed in indices; empty means a single level
+    Mesh(vector<Vertex>&& vertices, vector<unsigned int>&& indices, vector<Texture>&& textures, bool skinned = false, bool keepCpuData = false,
+        vector<MeshLod>&& lods = vector<MeshLod>())
+        : vertices(std::move(vertices)), indices(std::move(indices)), textures(std::move(textures)), skinned(skinned), lods(std::move(lods))
     {
-        this->vertices = vertices;
-        this->indices = indices;
-        this->textures = textures;
-
+        if (this->lods.empty())
+        {
+            MeshLod full;
+            full.indexCount = (GLsizei)this->indices.size();
+            full.vertexCount = (GLsizei)this->vertices.size();
+            this->lods.push_back(full);
+        }
+        material.AddTextures(this->textures);
+        computeBounds();
         setupMesh();
+
+        if (!keepCpuData)
+        {
+            vector<Vertex>().swap(this->vertices);
+            vector<unsigned int>().swap(this->indices);
+        }
+    }
+
+    // a Mesh owns its arena range: movable, not copyable
+    Mesh(const Mesh&) = delete;
+    Mesh& operator=(const Mesh&) = delete;
+
+    Mesh(Mesh&& other) noexcept
+        : vertices(std::move(other.vertices)), indices(std::move(other.indices)), textures(std::move(other.textures)),
+          skinned(other.skinned), material(std::move(other.material)), range(other.range),
+          bounds(other.bounds), sphere(other.sphere), boneBounds(std::move(other.boneBounds)), lods(std::move(other.lods))
+    {
+        other.range = GeometryRange();
     }
 
-    void Draw(Shader shader) 
+    Mesh& operator=(Mesh&& other) noexcept
     {
-        unsigned int diffuseNr = 1;
-        unsigned int specularNr = 1;
-        unsigned int normalNr = 1;
-        unsigned int heightNr = 1;
-        for(unsigned int i = 0; i < textures.size(); i++)
+        if (this != &other)
         {
-            glActiveTexture(GL_TEXTURE0 + i); // 바인딩하기 전에 적절한 텍스처 유닛 활성화
-            // 텍스처 넘버(diffuse_textureN 에서 N) 구하기
-            string number;
-            string name = textures[i].type;
-            if(name == "texture_diffuse")
-                number = std::to_string(diffuseNr++);
-            else if(name == "texture_specular")
-                number = std::to_string(specularNr++);
-            else if(name == "texture_normal")
-                number = std::to_string(normalNr++); // transfer unsigned int to string
-            else if(name == "texture_height")
-                number = std::to_string(heightNr++); // transfer unsigned int to string
-
-            shader.setFloat(("material." + name + number).c_str(), i);
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+            if (range.page >= 0)
+                GeometryArena::Get().Free(range);
+            vertices = std::move(other.vertices);
+            indices = std::move(other.indices);
+            textures = std::move(other.textures);
+            skinned = other.skinned;
+            material = std::move(other.material);
+            range = other.range;
+            bounds = other.bounds;
+            sphere = other.sphere;
+            boneBounds = std::move(other.boneBounds);
+            lods = std::move(other.lods);
+            other.range = GeometryRange();
         }
-        glActiveTexture(GL_TEXTURE0);
+        return *this;
+    }
+
+    // meshes released before exit (Shutdown) never touch the arena again, which may be gone by then
+    ~Mesh()
+    {
+        if (range.page >= 0)
+            GeometryArena::Get().Free(range);
+    }
 
-        // mesh 그리기
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
+    int LodCount() const { return (int)lods.size(); }
+
+    // streams in the arena: skinned meshes have the bone ids / weights stream
+    VertexFormat Format() const { return skinned ? VERTEX_FORMAT_SKINNED : VERTEX_FORMAT_STATIC; }
+
+    // byte offset of a level's indices in the arena page's index buffer
+    size_t LodIndexOffset(int lod) const
+    {
+        size_t indexSize = range.indexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+        return range.indexOffset + (size_t)lods[lod].firstIndex * indexSize;
     }
+
 private:
-    /*  렌더 데이터  */
-    unsigned int VAO, VBO, EBO;
+    void computeBounds()
+    {
+        for (size_t i = 0; i < vertices.size(); i++)
+            bounds.Expand(vertices[i].Position);
+        sphere = ComputeBoundingSphere(bounds, vertices.size(), [this](size_t i) { return vertices[i].Position; });
+
+        if (!skinned)
+            return;
+        for (size_t i = 0; i < vertices.size(); i++)
+        {
+            for (int j = 0; j < MAX_BONE_INFLUENCE; j++)
+            {
+                int id = vertices[i].m_BoneIDs[j];
+                if (id < 0 || vertices[i].m_Weights[j] <= 0.0f)
+                    continue;
+                if ((size_t)id >= boneBounds.size())
+                    boneBounds.resize(id + 1);
+                boneBounds[id].Expand(vertices[i].Position);
+            }
+        }
+    }
+
     /*  함수   */
     void setupMesh()
     {
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glGenBuffers(1, &EBO);
-  
-        glBindVertexArray(VAO);
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);  
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
-
-        // vertex positions
-        glEnableVertexAttribArray(0);	
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-        // vertex normals
-        glEnableVertexAttribArray(1);	
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-        // vertex texture coords
-        glEnableVertexAttribArray(2);	
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-
-        // vertex tangent
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
-        // vertex bitangent
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
-		// ids
-		glEnableVertexAttribArray(5);
-		glVertexAttribIPointer(5, 4, GL_INT, sizeof(Vertex), (void*)offsetof(Vertex, m_BoneIDs));
-
-		// weights
-		glEnableVertexAttribArray(6);
-		glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, m_Weights));
-        
-        glBindVertexArray(0);
-    }  
+        if (vertices.empty() || indices.empty())
+            return;
+
+        GeometryArena& arena = GeometryArena::Get();
+        VertexFormat format = Format();
+        size_t vertexCount = vertices.size();
+        // indices are relative to the base vertex, so 16 bit indices halve index memory
+        // and fetch bandwidth for every mesh with at most 65536 vertices
+        GLenum indexType = vertexCount <= 65536 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+        range = arena.Reserve(format, vertexCount, (GLsizei)indices.size(), indexType);
+        // the range's own draws use level 0; the other levels are addressed through lods
+        range.indexCount = lods[0].indexCount;
+
+        // de-interleave the imported vertices straight into the mapped streams.
+        // a stream that fails to map or comes back corrupted fails the whole mesh:
+        // its range is released and it draws nothing
+        glm::vec3* positions = (glm::vec3*)arena.Map(range, GEOMETRY_STREAM_POSITION);
+        if (!positions)
+            return failSetup("position");
+        for (size_t i = 0; i < vertexCount; i++)
+            positions[i] = vertices[i].Position;
+        if (!arena.Unmap())
+            return failSetup("position");
+
+        ShadeVertex* shading = (ShadeVertex*)arena.Map(range, GEOMETRY_STREAM_SHADE);
+        if (!shading)
+            return failSetup("shading");
+        for (size_t i = 0; i < vertexCount; i++)
+        {
+            shading[i].Normal = vertices[i].Normal;
+            shading[i].TexCoords = vertices[i].TexCoords;
+            shading[i].Tangent = vertices[i].Tangent;
+            shading[i].Bitangent = vertices[i].Bitangent;
+        }
+        if (!arena.Unmap())
+            return failSetup("shading");
+
+        if (skinned)
+        {
+            SkinVertex* skin = (SkinVertex*)arena.Map(range, GEOMETRY_STREAM_SKIN);
+            if (!skin)
+                return failSetup("skinning");
+            for (size_t i = 0; i < vertexCount; i++)
+            {
+                for (int j = 0; j < MAX_BONE_INFLUENCE; j++)
+                {
+                    skin[i].m_BoneIDs[j] = vertices[i].m_BoneIDs[j];
+                    skin[i].m_Weights[j] = vertices[i].m_Weights[j];
+                }
+            }
+            if (!arena.Unmap())
+                return failSetup("skinning");
+        }
+
+        void* mappedIndices = arena.Map(range, GEOMETRY_STREAM_INDEX);
+        if (!mappedIndices)
+            return failSetup("index");
+        if (indexType == GL_UNSIGNED_SHORT)
+        {
+            unsigned short* shortIndices = (unsigned short*)mappedIndices;
+            for (size_t i = 0; i < indices.size(); i++)
+                shortIndices[i] = (unsigned short)indices[i];
+        }
+        else
+        {
+            std::copy(indices.begin(), indices.end(), (unsigned int*)mappedIndices);
+        }
+        if (!arena.Unmap())
+            return failSetup("index");
+    }
+
+    void failSetup(const char* stream)
+    {
+        SPDLOG_ERROR("mesh: could not write the {} stream of {} vertices into the geometry arena", stream, vertices.size());
+        // Map leaves the stream bound even when it fails
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        GeometryArena::Get().Free(range);
+    }
 };
 #endif
\ No newline at end of file
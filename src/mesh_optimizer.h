@@ -0,0 +1,731 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <glm/glm.hpp>
+
+#include "mesh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <unordered_set>
+#include <vector>
+
+// post-import mesh optimization, in the spirit of meshoptimizer
+// 1. vertex cache : reorder triangles for post-transform cache locality (Forsyth)
+// 2. overdraw     : reorder cache-friendly clusters front-to-back-ish (outward facing first)
+// 3. vertex fetch : reorder vertices in first-use order of the index buffer
+// 4. simplify     : quadric error edge collapse for LOD chains
+struct VertexCacheStatistics
+{
+    unsigned int vertices_transformed = 0;
+    float acmr = 0.0f; // transformed vertices / triangle count   (best ~0.5, worst 3.0)
+    float atvr = 0.0f; // transformed vertices / referenced vertex (best 1.0)
+};
+
+class MeshOptimizer
+{
+public:
+    // simulates a FIFO post-transform cache of the given size
+    static VertexCacheStatistics AnalyzeVertexCache(const std::vector<unsigned int>& indices, size_t vertexCount, unsigned int cacheSize = 16)
+    {
+        VertexCacheStatistics result;
+        if (indices.empty())
+            return result;
+
+        std::vector<unsigned int> timestamps(vertexCount, 0);
+        std::vector<bool> referenced(vertexCount, false);
+        unsigned int timestamp = cacheSize + 1;
+        unsigned int uniqueVertices = 0;
+
+        for (size_t i = 0; i < indices.size(); i++)
+        {
+            unsigned int v = indices[i];
+            if (!referenced[v])
+            {
+                referenced[v] = true;
+                uniqueVertices++;
+            }
+            // vertex is in the cache if it was pushed less than cacheSize misses ago
+            if (timestamp - timestamps[v] > cacheSize)
+            {
+                timestamps[v] = timestamp++;
+                result.vertices_transformed++;
+            }
+        }
+
+        result.acmr = (float)result.vertices_transformed / (float)(indices.size() / 3);
+        result.atvr = uniqueVertices ? (float)result.vertices_transformed / (float)uniqueVertices : 0.0f;
+        return result;
+    }
+
+    // Tom Forsyth's linear-speed vertex cache optimization
+    static void OptimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount)
+    {
+        const int kCacheSize = 32;
+        size_t triangleCount = indices.size() / 3;
+        if (triangleCount == 0)
+            return;
+
+        // vertex -> triangle adjacency
+        std::vector<unsigned int> liveTriangles(vertexCount, 0);
+        for (size_t i = 0; i < indices.size(); i++)
+            liveTriangles[indices[i]]++;
+
+        std::vector<unsigned int> adjacencyOffset(vertexCount + 1, 0);
+        for (size_t v = 0; v < vertexCount; v++)
+            adjacencyOffset[v + 1] = adjacencyOffset[v] + liveTriangles[v];
+
+        std::vector<unsigned int> adjacency(indices.size());
+        std::vector<unsigned int> adjacencyFill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+        for (size_t t = 0; t < triangleCount; t++)
+            for (int k = 0; k < 3; k++)
+                adjacency[adjacencyFill[indices[t * 3 + k]]++] = (unsigned int)t;
+
+        std::vector<int> cachePosition(vertexCount, -1);
+        std::vector<float> vertexScore(vertexCount);
+        for (size_t v = 0; v < vertexCount; v++)
+            vertexScore[v] = forsythScore(-1, liveTriangles[v], kCacheSize);
+
+        std::vector<float> triangleScore(triangleCount);
+        std::vector<bool> emitted(triangleCount, false);
+        for (size_t t = 0; t < triangleCount; t++)
+            triangleScore[t] = vertexScore[indices[t * 3 + 0]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+
+        std::vector<unsigned int> cache, nextCache;
+        cache.reserve(kCacheSize + 3);
+        nextCache.reserve(kCacheSize + 3);
+
+        std::vector<unsigned int> result;
+        result.reserve(indices.size());
+
+        size_t scanCursor = 0;
+        long bestTriangle = -1;
+
+        for (size_t emittedCount = 0; emittedCount < triangleCount; emittedCount++)
+        {
+            if (bestTriangle < 0)
+            {
+                // cache miss on every candidate: fall back to the best remaining triangle
+                float bestScore = -1.0f;
+                while (scanCursor < triangleCount && emitted[scanCursor])
+                    scanCursor++;
+                for (size_t t = scanCursor; t < triangleCount; t++)
+                {
+                    if (!emitted[t] && triangleScore[t] > bestScore)
+                    {
+                        bestScore = triangleScore[t];
+                        bestTriangle = (long)t;
+                    }
+                }
+            }
+
+            unsigned int tri = (unsigned int)bestTriangle;
+            emitted[tri] = true;
+            const unsigned int a = indices[tri * 3 + 0], b = indices[tri * 3 + 1], c = indices[tri * 3 + 2];
+            result.push_back(a);
+            result.push_back(b);
+            result.push_back(c);
+
+            // remove the emitted triangle from the live adjacency of its vertices
+            const unsigned int triVertices[3] = { a, b, c };
+            for (int k = 0; k < 3; k++)
+            {
+                unsigned int v = triVertices[k];
+                unsigned int* begin = &adjacency[adjacencyOffset[v]];
+                unsigned int* end = begin + liveTriangles[v];
+                unsigned int* it = std::find(begin, end, tri);
+                std::swap(*it, *(end - 1));
+                liveTriangles[v]--;
+            }
+
+            // LRU cache update: emitted vertices move to the front
+            nextCache.assign(triVertices, triVertices + 3);
+            for (size_t i = 0; i < cache.size(); i++)
+            {
+                unsigned int v = cache[i];
+                if (v != a && v != b && v != c)
+                    nextCache.push_back(v);
+            }
+            for (size_t i = kCacheSize; i < nextCache.size(); i++)
+            {
+                cachePosition[nextCache[i]] = -1;
+                vertexScore[nextCache[i]] = forsythScore(-1, liveTriangles[nextCache[i]], kCacheSize);
+            }
+            if (nextCache.size() > (size_t)kCacheSize)
+                nextCache.resize(kCacheSize);
+            cache.swap(nextCache);
+
+            for (size_t i = 0; i < cache.size(); i++)
+            {
+                cachePosition[cache[i]] = (int)i;
+                vertexScore[cache[i]] = forsythScore((int)i, liveTriangles[cache[i]], kCacheSize);
+            }
+
+            // rescore the triangles touching the cache and pick the next one among them
+            bestTriangle = -1;
+            float bestScore = -1.0f;
+            for (size_t i = 0; i < cache.size(); i++)
+            {
+                unsigned int v = cache[i];
+                for (unsigned int j = 0; j < liveTriangles[v]; j++)
+                {
+                    unsigned int t = adjacency[adjacencyOffset[v] + j];
+                    float score = vertexScore[indices[t * 3 + 0]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+                    triangleScore[t] = score;
+                    if (score > bestScore)
+                    {
+                        bestScore = score;
+                        bestTriangle = (long)t;
+                    }
+                }
+            }
+        }
+
+        indices.swap(result);
+    }
+
+    // splits the (cache optimized) index buffer into clusters at cache flush points and
+    // sorts the clusters so that outward facing ones are drawn first.
+    // clusters are kept intact, so the vertex cache efficiency is mostly preserved.
+    static void OptimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<Vertex>& vertices, unsigned int cacheSize = 16)
+    {
+        size_t triangleCount = indices.size() / 3;
+        if (triangleCount < 2)
+            return;
+
+        // hard boundaries: triangles where all three vertices miss the cache
+        std::vector<size_t> clusterStart;
+        std::vector<unsigned int> timestamps(vertices.size(), 0);
+        unsigned int timestamp = cacheSize + 1;
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            int misses = 0;
+            for (int k = 0; k < 3; k++)
+            {
+                unsigned int v = indices[t * 3 + k];
+                if (timestamp - timestamps[v] > cacheSize)
+                {
+                    timestamps[v] = timestamp++;
+                    misses++;
+                }
+            }
+            if (t == 0 || misses == 3)
+                clusterStart.push_back(t);
+        }
+        clusterStart.push_back(triangleCount);
+        size_t clusterCount = clusterStart.size() - 1;
+        if (clusterCount < 2)
+            return;
+
+        // area weighted mesh centroid
+        glm::vec3 meshCentroid(0.0f);
+        float meshArea = 0.0f;
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            const glm::vec3& p0 = vertices[indices[t * 3 + 0]].Position;
+            const glm::vec3& p1 = vertices[indices[t * 3 + 1]].Position;
+            const glm::vec3& p2 = vertices[indices[t * 3 + 2]].Position;
+            float area = glm::length(glm::cross(p1 - p0, p2 - p0));
+            meshCentroid += (p0 + p1 + p2) * (area / 3.0f);
+            meshArea += area;
+        }
+        if (meshArea > 0.0f)
+            meshCentroid /= meshArea;
+
+        // sort key : how much the cluster faces away from the mesh center
+        std::vector<float> clusterKey(clusterCount);
+        for (size_t c = 0; c < clusterCount; c++)
+        {
+            glm::vec3 centroid(0.0f), normal(0.0f);
+            float area = 0.0f;
+            for (size_t t = clusterStart[c]; t < clusterStart[c + 1]; t++)
+            {
+                const glm::vec3& p0 = vertices[indices[t * 3 + 0]].Position;
+                const glm::vec3& p1 = vertices[indices[t * 3 + 1]].Position;
+                const glm::vec3& p2 = vertices[indices[t * 3 + 2]].Position;
+                glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+                float triArea = glm::length(n);
+                centroid += (p0 + p1 + p2) * (triArea / 3.0f);
+                normal += n;
+                area += triArea;
+            }
+            float normalLength = glm::length(normal);
+            if (area > 0.0f && normalLength > 0.0f)
+                clusterKey[c] = glm::dot(centroid / area - meshCentroid, normal / normalLength);
+            else
+                clusterKey[c] = 0.0f;
+        }
+
+        std::vector<size_t> order(clusterCount);
+        for (size_t c = 0; c < clusterCount; c++)
+            order[c] = c;
+        std::stable_sort(order.begin(), order.end(), [&](size_t lhs, size_t rhs) { return clusterKey[lhs] > clusterKey[rhs]; });
+
+        std::vector<unsigned int> result;
+        result.reserve(indices.size());
+        for (size_t i = 0; i < clusterCount; i++)
+        {
+            size_t c = order[i];
+            result.insert(result.end(), indices.begin() + clusterStart[c] * 3, indices.begin() + clusterStart[c + 1] * 3);
+        }
+        indices.swap(result);
+    }
+
+    // reorders vertices in the order the index buffer first references them
+    // (unreferenced vertices are dropped)
+    static void OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices)
+    {
+        const unsigned int kUnused = ~0u;
+        std::vector<unsigned int> remap(vertices.size(), kUnused);
+        std::vector<Vertex> result;
+        result.reserve(vertices.size());
+
+        for (size_t i = 0; i < indices.size(); i++)
+        {
+            unsigned int v = indices[i];
+            if (remap[v] == kUnused)
+            {
+                remap[v] = (unsigned int)result.size();
+                result.push_back(vertices[v]);
+            }
+            indices[i] = remap[v];
+        }
+        vertices.swap(result);
+    }
+
+    // Quadric error edge collapse (Garland / Heckbert) down to targetIndexCount indices.
+    // Vertices only collapse onto neighbouring vertices, so the result indexes the same vertex
+    // buffer and LOD levels can share it. Open borders only collapse along the border, UV / normal
+    // seams (vertices split at one position) only along the seam with both sides moving together,
+    // and vertices never collapse across a change of their dominant bone, so skinning seams stay.
+    // Collapses that would flip a triangle or cost more than maxError (object space distance) are
+    // skipped. resultError receives the largest error of the collapses made.
+    static std::vector<unsigned int> Simplify(const std::vector<unsigned int>& indices, const std::vector<Vertex>& vertices,
+        size_t targetIndexCount, float maxError, float* resultError = nullptr)
+    {
+        std::vector<unsigned int> result(indices);
+        float error = 0.0f;
+        size_t vertexCount = vertices.size();
+        targetIndexCount = targetIndexCount / 3 * 3;
+        if (result.size() <= targetIndexCount || vertexCount == 0)
+        {
+            if (resultError)
+                *resultError = 0.0f;
+            return result;
+        }
+
+        std::vector<unsigned int> wedge, canonical;
+        buildWedges(vertices, wedge, canonical);
+        std::vector<unsigned char> kind;
+        std::vector<unsigned int> openOut, openIn;
+        classifyVertices(result, wedge, canonical, kind, openOut, openIn);
+        // static meshes have no skinning seams: every vertex keeps bone -1, so the test never fails
+        std::vector<int> bone(vertexCount, -1);
+        if (hasBones(vertices))
+        {
+            for (size_t v = 0; v < vertexCount; v++)
+                bone[v] = dominantBone(vertices[v]);
+        }
+
+        // per position quadrics: triangle planes, plus planes through border / seam edges
+        std::vector<Quadric> quadrics(vertexCount);
+        for (size_t i = 0; i < result.size(); i += 3)
+        {
+            const unsigned int tri[3] = { result[i], result[i + 1], result[i + 2] };
+            glm::vec3 p0 = vertices[tri[0]].Position, p1 = vertices[tri[1]].Position, p2 = vertices[tri[2]].Position;
+            glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+            float area = glm::length(normal);
+            if (area <= 0.0f)
+                continue;
+            normal /= area;
+            for (int k = 0; k < 3; k++)
+                quadrics[canonical[tri[k]]].AddPlane(normal, -glm::dot(normal, p0), area);
+
+            for (int k = 0; k < 3; k++)
+            {
+                unsigned int a = tri[k], b = tri[(k + 1) % 3];
+                if (openOut[a] != b || (kind[a] == VERTEX_MANIFOLD && kind[b] == VERTEX_MANIFOLD))
+                    continue;
+                glm::vec3 edge = vertices[b].Position - vertices[a].Position;
+                float length = glm::length(edge);
+                if (length <= 0.0f)
+                    continue;
+                glm::vec3 edgeNormal = glm::normalize(glm::cross(edge, normal));
+                float weight = length * length * kBorderWeight;
+                quadrics[canonical[a]].AddPlane(edgeNormal, -glm::dot(edgeNormal, vertices[a].Position), weight);
+                quadrics[canonical[b]].AddPlane(edgeNormal, -glm::dot(edgeNormal, vertices[a].Position), weight);
+            }
+        }
+
+        std::vector<unsigned int> remap(vertexCount);
+        std::vector<unsigned char> touched(vertexCount);
+        std::vector<unsigned int> bestTarget(vertexCount);
+        std::vector<float> bestCost(vertexCount);
+        std::vector<unsigned int> candidates;
+        std::vector<unsigned int> adjacencyOffset, adjacency;
+        float maxCost = maxError * maxError;
+
+        while (result.size() > targetIndexCount)
+        {
+            // cheapest allowed collapse of every vertex
+            std::fill(bestTarget.begin(), bestTarget.end(), kInvalid);
+            for (size_t i = 0; i < result.size(); i += 3)
+            {
+                for (int k = 0; k < 3; k++)
+                {
+                    unsigned int a = result[i + k], b = result[i + (k + 1) % 3];
+                    for (int direction = 0; direction < 2; direction++)
+                    {
+                        unsigned int u = direction ? b : a, v = direction ? a : b;
+                        if (collapseTarget(u, v, kind, wedge, canonical, openOut, openIn, bone) == kInvalid)
+                            continue;
+                        float cost = quadrics[canonical[u]].Error(vertices[v].Position);
+                        if (bestTarget[u] == kInvalid || cost < bestCost[u])
+                        {
+                            bestTarget[u] = v;
+                            bestCost[u] = cost;
+                        }
+                    }
+                }
+            }
+            candidates.clear();
+            for (size_t v = 0; v < vertexCount; v++)
+            {
+                if (bestTarget[v] != kInvalid && bestCost[v] <= maxCost)
+                    candidates.push_back((unsigned int)v);
+            }
+            if (candidates.empty())
+                break;
+            std::sort(candidates.begin(), candidates.end(), [&](unsigned int lhs, unsigned int rhs) { return bestCost[lhs] < bestCost[rhs]; });
+
+            buildTriangleAdjacency(result, vertexCount, adjacencyOffset, adjacency);
+            for (size_t v = 0; v < vertexCount; v++)
+                remap[v] = (unsigned int)v;
+            std::fill(touched.begin(), touched.end(), 0);
+
+            // a collapse removes about two triangles; don't overshoot the target within a pass
+            size_t collapseLimit = (result.size() - targetIndexCount) / 6 + 1;
+            size_t collapses = 0;
+            for (unsigned int u : candidates)
+            {
+                unsigned int v = bestTarget[u];
+                unsigned int u2 = kInvalid, v2 = kInvalid;
+                if (kind[u] == VERTEX_SEAM)
+                {
+                    u2 = wedge[u];
+                    v2 = collapseTarget(u2, kInvalid, kind, wedge, canonical, openOut, openIn, bone, v);
+                    if (v2 == kInvalid)
+                        continue;
+                }
+                if (touched[u] || touched[v] || (u2 != kInvalid && (touched[u2] || touched[v2])))
+                    continue;
+                if (flips(u, v, vertices, result, remap, adjacencyOffset, adjacency)
+                    || (u2 != kInvalid && flips(u2, v2, vertices, result, remap, adjacencyOffset, adjacency)))
+                    continue;
+
+                remap[u] = v;
+                touched[u] = touched[v] = 1;
+                if (u2 != kInvalid)
+                {
+                    remap[u2] = v2;
+                    touched[u2] = touched[v2] = 1;
+                }
+                quadrics[canonical[v]].Add(quadrics[canonical[u]]);
+                error = std::max(error, bestCost[u]);
+                if (++collapses >= collapseLimit)
+                    break;
+            }
+            if (collapses == 0)
+                break;
+
+            // rewrite the triangles, dropping the ones that collapsed
+            size_t write = 0;
+            for (size_t i = 0; i < result.size(); i += 3)
+            {
+                unsigned int a = remap[result[i]], b = remap[result[i + 1]], c = remap[result[i + 2]];
+                if (canonical[a] == canonical[b] || canonical[b] == canonical[c] || canonical[c] == canonical[a])
+                    continue;
+                result[write++] = a;
+                result[write++] = b;
+                result[write++] = c;
+            }
+            result.resize(write);
+        }
+
+        if (resultError)
+            *resultError = std::sqrt(error);
+        return result;
+    }
+
+    // number of distinct vertices an index list references
+    static size_t CountReferencedVertices(const std::vector<unsigned int>& indices, size_t vertexCount)
+    {
+        std::vector<bool> referenced(vertexCount, false);
+        size_t count = 0;
+        for (unsigned int v : indices)
+        {
+            if (!referenced[v])
+            {
+                referenced[v] = true;
+                count++;
+            }
+        }
+        return count;
+    }
+
+private:
+    static constexpr unsigned int kInvalid = ~0u;
+    static constexpr float kBorderWeight = 10.0f;
+
+    enum VertexKind : unsigned char {
+        VERTEX_MANIFOLD = 0,    // interior, collapses anywhere
+        VERTEX_BORDER,          // on an open edge, collapses along it
+        VERTEX_SEAM,            // attribute split with one twin, collapses along the seam
+        VERTEX_LOCKED           // corners, non-manifold, 3+ way splits
+    };
+
+    // symmetric 4x4 error quadric of weighted planes; Error is the weighted mean squared distance
+    struct Quadric {
+        double a00 = 0, a11 = 0, a22 = 0, a01 = 0, a02 = 0, a12 = 0;
+        double b0 = 0, b1 = 0, b2 = 0, c = 0, w = 0;
+
+        void AddPlane(const glm::vec3& n, float d, float weight)
+        {
+            a00 += weight * n.x * n.x; a11 += weight * n.y * n.y; a22 += weight * n.z * n.z;
+            a01 += weight * n.x * n.y; a02 += weight * n.x * n.z; a12 += weight * n.y * n.z;
+            b0 += weight * n.x * d; b1 += weight * n.y * d; b2 += weight * n.z * d;
+            c += weight * d * d;
+            w += weight;
+        }
+
+        void Add(const Quadric& q)
+        {
+            a00 += q.a00; a11 += q.a11; a22 += q.a22; a01 += q.a01; a02 += q.a02; a12 += q.a12;
+            b0 += q.b0; b1 += q.b1; b2 += q.b2; c += q.c; w += q.w;
+        }
+
+        float Error(const glm::vec3& p) const
+        {
+            double x = p.x, y = p.y, z = p.z;
+            double r = a00 * x * x + a11 * y * y + a22 * z * z
+                + 2.0 * (a01 * x * y + a02 * x * z + a12 * y * z)
+                + 2.0 * (b0 * x + b1 * y + b2 * z) + c;
+            return w > 0.0 ? (float)(std::fabs(r) / w) : 0.0f;
+        }
+    };
+
+    static bool hasBones(const std::vector<Vertex>& vertices)
+    {
+        for (const Vertex& vertex : vertices)
+        {
+            for (int i = 0; i < MAX_BONE_INFLUENCE; i++)
+            {
+                if (vertex.m_BoneIDs[i] >= 0 && vertex.m_Weights[i] > 0.0f)
+                    return true;
+            }
+        }
+        return false;
+    }
+
+    static int dominantBone(const Vertex& vertex)
+    {
+        int bone = -1;
+        float weight = 0.0f;
+        for (int i = 0; i < MAX_BONE_INFLUENCE; i++)
+        {
+            if (vertex.m_BoneIDs[i] >= 0 && vertex.m_Weights[i] > weight)
+            {
+                bone = vertex.m_BoneIDs[i];
+                weight = vertex.m_Weights[i];
+            }
+        }
+        return bone;
+    }
+
+    // wedge: next vertex at the same position (a ring), canonical: lowest vertex at the position
+    static void buildWedges(const std::vector<Vertex>& vertices, std::vector<unsigned int>& wedge, std::vector<unsigned int>& canonical)
+    {
+        size_t vertexCount = vertices.size();
+        std::vector<unsigned int> order(vertexCount);
+        for (size_t v = 0; v < vertexCount; v++)
+            order[v] = (unsigned int)v;
+        auto less = [&](unsigned int lhs, unsigned int rhs) {
+            const glm::vec3& a = vertices[lhs].Position;
+            const glm::vec3& b = vertices[rhs].Position;
+            if (a.x != b.x) return a.x < b.x;
+            if (a.y != b.y) return a.y < b.y;
+            if (a.z != b.z) return a.z < b.z;
+            return lhs < rhs;
+        };
+        std::sort(order.begin(), order.end(), less);
+
+        wedge.resize(vertexCount);
+        canonical.resize(vertexCount);
+        size_t begin = 0;
+        while (begin < vertexCount)
+        {
+            size_t end = begin + 1;
+            while (end < vertexCount && vertices[order[end]].Position == vertices[order[begin]].Position)
+                end++;
+            for (size_t i = begin; i < end; i++)
+            {
+                wedge[order[i]] = order[i + 1 < end ? i + 1 : begin];
+                canonical[order[i]] = order[begin];
+            }
+            begin = end;
+        }
+    }
+
+    // open edges are directed edges without a reverse edge; openOut / openIn hold the other end
+    // of a vertex's single open edge (kInvalid: none, kInvalid - 1: several)
+    static void classifyVertices(const std::vector<unsigned int>& indices, const std::vector<unsigned int>& wedge,
+        const std::vector<unsigned int>& canonical, std::vector<unsigned char>& kind,
+        std::vector<unsigned int>& openOut, std::vector<unsigned int>& openIn)
+    {
+        size_t vertexCount = wedge.size();
+        std::unordered_set<uint64_t> edges;
+        edges.reserve(indices.size());
+        for (size_t i = 0; i < indices.size(); i += 3)
+            for (int k = 0; k < 3; k++)
+                edges.insert(((uint64_t)indices[i + k] << 32) | indices[i + (k + 1) % 3]);
+
+        const unsigned int kMany = kInvalid - 1;
+        openOut.assign(vertexCount, kInvalid);
+        openIn.assign(vertexCount, kInvalid);
+        for (size_t i = 0; i < indices.size(); i += 3)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                unsigned int a = indices[i + k], b = indices[i + (k + 1) % 3];
+                if (edges.count(((uint64_t)b << 32) | a))
+                    continue;
+                openOut[a] = openOut[a] == kInvalid ? b : kMany;
+                openIn[b] = openIn[b] == kInvalid ? a : kMany;
+            }
+        }
+
+        kind.assign(vertexCount, VERTEX_LOCKED);
+        for (size_t v = 0; v < vertexCount; v++)
+        {
+            bool open = openOut[v] != kInvalid || openIn[v] != kInvalid;
+            bool singleOpen = openOut[v] < kMany && openIn[v] < kMany;
+            if (wedge[v] == v)
+            {
+                if (!open)
+                    kind[v] = VERTEX_MANIFOLD;
+                else if (singleOpen)
+                    kind[v] = VERTEX_BORDER;
+                continue;
+            }
+            unsigned int twin = wedge[v];
+            if (wedge[twin] != v || !singleOpen || !(openOut[twin] < kMany && openIn[twin] < kMany))
+                continue;
+            // the other side of a seam runs along it in the opposite direction
+            if (canonical[openOut[v]] == canonical[openIn[twin]] && canonical[openIn[v]] == canonical[openOut[twin]])
+                kind[v] = VERTEX_SEAM;
+        }
+    }
+
+    // v if u may collapse onto it. with v == kInvalid, finds the seam neighbour of u at the
+    // position of matchPosition (the twin side of a seam collapse)
+    static unsigned int collapseTarget(unsigned int u, unsigned int v, const std::vector<unsigned char>& kind,
+        const std::vector<unsigned int>& wedge, const std::vector<unsigned int>& canonical,
+        const std::vector<unsigned int>& openOut, const std::vector<unsigned int>& openIn,
+        const std::vector<int>& bone, unsigned int matchPosition = kInvalid)
+    {
+        if (v == kInvalid)
+        {
+            if (kind[u] != VERTEX_SEAM)
+                return kInvalid;
+            if (canonical[openOut[u]] == canonical[matchPosition])
+                v = openOut[u];
+            else if (canonical[openIn[u]] == canonical[matchPosition])
+                v = openIn[u];
+            else
+                return kInvalid;
+        }
+        if (canonical[u] == canonical[v] || bone[u] != bone[v])
+            return kInvalid;
+        switch (kind[u])
+        {
+        case VERTEX_MANIFOLD:
+            return v;
+        case VERTEX_BORDER:
+            return v == openOut[u] || v == openIn[u] ? v : kInvalid;
+        case VERTEX_SEAM:
+        {
+            if (v != openOut[u] && v != openIn[u])
+                return kInvalid;
+            unsigned int twin = wedge[u];
+            unsigned int twinTarget = canonical[openOut[twin]] == canonical[v] ? openOut[twin] : openIn[twin];
+            return canonical[twinTarget] == canonical[v] && bone[twin] == bone[twinTarget] ? v : kInvalid;
+        }
+        default:
+            return kInvalid;
+        }
+    }
+
+    static void buildTriangleAdjacency(const std::vector<unsigned int>& indices, size_t vertexCount,
+        std::vector<unsigned int>& offset, std::vector<unsigned int>& adjacency)
+    {
+        offset.assign(vertexCount + 1, 0);
+        for (unsigned int v : indices)
+            offset[v + 1]++;
+        for (size_t v = 0; v < vertexCount; v++)
+            offset[v + 1] += offset[v];
+        adjacency.resize(indices.size());
+        std::vector<unsigned int> fill(offset.begin(), offset.end() - 1);
+        for (size_t i = 0; i < indices.size(); i++)
+            adjacency[fill[indices[i]]++] = (unsigned int)(i / 3);
+    }
+
+    // would moving u onto v turn any remaining triangle around u over
+    static bool flips(unsigned int u, unsigned int v, const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices,
+        const std::vector<unsigned int>& remap, const std::vector<unsigned int>& offset, const std::vector<unsigned int>& adjacency)
+    {
+        for (unsigned int i = offset[u]; i < offset[u + 1]; i++)
+        {
+            unsigned int t = adjacency[i];
+            unsigned int tri[3] = { remap[indices[t * 3]], remap[indices[t * 3 + 1]], remap[indices[t * 3 + 2]] };
+            if (tri[0] == v || tri[1] == v || tri[2] == v)
+                continue; // collapses away
+            glm::vec3 p[3], q[3];
+            for (int k = 0; k < 3; k++)
+            {
+                p[k] = vertices[tri[k]].Position;
+                q[k] = tri[k] == u ? vertices[v].Position : p[k];
+            }
+            glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+            if (glm::dot(before, before) == 0.0f)
+                continue; // already degenerate, dropped with this pass
+            glm::vec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+            if (glm::dot(before, after) <= 1e-2f * glm::length(before) * glm::length(after))
+                return true;
+        }
+        return false;
+    }
+
+    static float forsythScore(int cachePosition, unsigned int liveTriangles, int cacheSize)
+    {
+        const float kCacheDecayPower = 1.5f;
+        const float kLastTriScore = 0.75f;
+        const float kValenceBoostScale = 2.0f;
+        const float kValenceBoostPower = 0.5f;
+
+        if (liveTriangles == 0)
+            return -1.0f;
+
+        float score = 0.0f;
+        if (cachePosition >= 0)
+        {
+            if (cachePosition < 3)
+                score = kLastTriScore;
+            else
+                score = std::pow(1.0f - (float)(cachePosition - 3) / (float)(cacheSize - 3), kCacheDecayPower);
+        }
+        score += kValenceBoostScale * std::pow((float)liveTriangles, -kValenceBoostPower);
+        return score;
+    }
+};
+#endif
@@ -12,6 +12,7 @@
 #include <assimp/postprocess.h>
 
 #include "mesh.h"
+#include "mesh_optimizer.h"
 #include "shader_m.h"
 
 #include <string>
@@ -22,9 +23,26 @@
 #include <vector>
 #include "assimp_glm_helpers.h"
 #include "animdata.h"
+#include "common.h"
 
 using namespace std;
 
+// import time options for Model
+struct ModelLoadOptions
+{
+    // reorder indices / vertices for vertex cache, overdraw and vertex fetch (mesh_optimizer.h)
+    bool optimizeMeshes = true;
+    // keep Mesh::vertices / indices on the CPU after upload (picking, physics, CPU skinning)
+    bool keepCpuData = false;
+    // LOD chain built with MeshOptimizer::Simplify: up to lodLevels extra levels, each aiming at
+    // lodReduction of the previous level's triangles, with a total error of at most
+    // lodMaxError times the mesh's bounds diagonal
+    bool generateLods = true;
+    int lodLevels = 4;
+    float lodReduction = 0.5f;
+    float lodMaxError = 0.05f;
+};
+
 class Model 
 {
 public:
@@ -37,7 +55,7 @@ public:
 	Model() {} // default constructor
 
      // constructor, expects a filepath to a 3D model.
-    Model(const char* path, bool gamma = false) : gammaCorrection(gamma)
+    Model(const char* path, bool gamma = false, ModelLoadOptions options = ModelLoadOptions()) : gammaCorrection(gamma), loadOptions(options)
     {
         loadModel(path);
     }   
@@ -46,13 +64,6 @@ public:
     //    loadModel(path);
     //}
 
-    // draws the model, and thus all its meshes
-    void Draw(Shader &shader)
-    {
-        for(unsigned int i = 0; i < meshes.size(); i++)
-            meshes[i].Draw(shader);
-    }
-    
 	auto& GetBoneInfoMap() { return m_BoneInfoMap; }
 	int& GetBoneCount() { return m_BoneCounter; }
 	
@@ -61,6 +72,9 @@ private:
 
 	std::map<string, BoneInfo> m_BoneInfoMap;
 	int m_BoneCounter = 0;
+	ModelLoadOptions loadOptions;
+	// largest CPU side vertex + index staging of a single mesh during load
+	size_t m_PeakStagingBytes = 0;
 
     // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
     void loadModel(string const &path)
@@ -78,7 +92,20 @@ private:
         directory = path.substr(0, path.find_last_of('/'));
 
         // process ASSIMP's root node recursively
+        ProcessMemoryUsage memoryBefore = GetProcessMemoryUsage();
+        meshes.reserve(scene->mNumMeshes);
         processNode(scene->mRootNode, scene);
+        ProcessMemoryUsage memoryAfter = GetProcessMemoryUsage();
+
+        size_t retainedBytes = 0;
+        for (const Mesh& mesh : meshes)
+            retainedBytes += mesh.vertices.capacity() * sizeof(Vertex) + mesh.indices.capacity() * sizeof(unsigned int);
+        SPDLOG_INFO("model '{}': {} meshes, RSS {:.1f} -> {:.1f} MB (peak {:.1f} -> {:.1f} MB), "
+            "mesh staging peak {:.1f} KB, CPU geometry retained {:.1f} KB",
+            path, meshes.size(),
+            memoryBefore.current / 1048576.0, memoryAfter.current / 1048576.0,
+            memoryBefore.peak / 1048576.0, memoryAfter.peak / 1048576.0,
+            m_PeakStagingBytes / 1024.0, retainedBytes / 1024.0);
     }
 
     // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
@@ -90,7 +117,7 @@ private:
             // the node object only contains indices to index the actual objects in the scene. 
             // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
             aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
+            meshes.push_back(processMesh(mesh, scene)); // moved, never copied
         }
         // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
         for(unsigned int i = 0; i < node->mNumChildren; i++)
@@ -115,6 +142,11 @@ private:
 		vector<Vertex> vertices;
 		vector<unsigned int> indices;
 		vector<Texture> textures;
+		// only meshes with bones get a skinning stream
+		bool skinned = mesh->mNumBones > 0;
+
+		vertices.reserve(mesh->mNumVertices);
+		indices.reserve(mesh->mNumFaces * 3);
 
 		for (unsigned int i = 0; i < mesh->mNumVertices; i++)
 		{
@@ -152,9 +184,80 @@ private:
 		std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
 		textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
 
-		ExtractBoneWeightForVertices(vertices,mesh,scene);
+		if (skinned)
+			ExtractBoneWeightForVertices(vertices,mesh,scene);
+
+		if (loadOptions.optimizeMeshes)
+			OptimizeMesh(mesh->mName.C_Str(), vertices, indices);
+
+		vector<MeshLod> lods;
+		if (loadOptions.generateLods)
+			BuildLods(mesh->mName.C_Str(), vertices, indices, lods);
+
+		m_PeakStagingBytes = std::max(m_PeakStagingBytes,
+			vertices.capacity() * sizeof(Vertex) + indices.capacity() * sizeof(unsigned int));
+
+		return Mesh(std::move(vertices), std::move(indices), std::move(textures), skinned, loadOptions.keepCpuData, std::move(lods));
+	}
+
+	// appends the simplified levels to indices (each simplified from the previous one and
+	// cache optimized), stops when a level no longer gets meaningfully smaller
+	void BuildLods(const char* name, const vector<Vertex>& vertices, vector<unsigned int>& indices, vector<MeshLod>& lods)
+	{
+		MeshLod full;
+		full.indexCount = (GLsizei)indices.size();
+		full.vertexCount = (GLsizei)MeshOptimizer::CountReferencedVertices(indices, vertices.size());
+		lods.push_back(full);
+
+		AABB bounds;
+		for (const Vertex& vertex : vertices)
+			bounds.Expand(vertex.Position);
+		if (!bounds.Valid())
+			return;
+		float maxError = glm::length(bounds.max - bounds.min) * loadOptions.lodMaxError;
+
+		vector<unsigned int> previous(indices);
+		for (int level = 1; level <= loadOptions.lodLevels; level++)
+		{
+			// the level's own error budget is what the chain has left
+			float budget = maxError - lods.back().error;
+			if (budget <= 0.0f)
+				break;
+			size_t target = (size_t)(previous.size() * loadOptions.lodReduction);
+			float error = 0.0f;
+			vector<unsigned int> simplified = MeshOptimizer::Simplify(previous, vertices, target, budget, &error);
+			if (simplified.empty() || simplified.size() > previous.size() * 0.8f)
+				break;
+			MeshOptimizer::OptimizeVertexCache(simplified, vertices.size());
+
+			MeshLod lod;
+			lod.firstIndex = (GLsizei)indices.size();
+			lod.indexCount = (GLsizei)simplified.size();
+			lod.vertexCount = (GLsizei)MeshOptimizer::CountReferencedVertices(simplified, vertices.size());
+			lod.error = lods.back().error + error;
+			lods.push_back(lod);
+			indices.insert(indices.end(), simplified.begin(), simplified.end());
+			previous.swap(simplified);
+		}
+
+		std::string levels;
+		for (const MeshLod& lod : lods)
+			levels += fmt::format(" {}", lod.indexCount / 3);
+		SPDLOG_INFO("mesh '{}' LOD triangles:{} (error {:.4f})", name, levels, lods.back().error);
+	}
+
+	// vertex cache -> overdraw -> vertex fetch, reports ACMR/ATVR before and after
+	void OptimizeMesh(const char* name, vector<Vertex>& vertices, vector<unsigned int>& indices)
+	{
+		VertexCacheStatistics before = MeshOptimizer::AnalyzeVertexCache(indices, vertices.size());
+
+		MeshOptimizer::OptimizeVertexCache(indices, vertices.size());
+		MeshOptimizer::OptimizeOverdraw(indices, vertices);
+		MeshOptimizer::OptimizeVertexFetch(vertices, indices);
 
-		return Mesh(vertices, indices, textures);
+		VertexCacheStatistics after = MeshOptimizer::AnalyzeVertexCache(indices, vertices.size());
+		SPDLOG_INFO("mesh '{}' ({} tris): ACMR {:.3f} -> {:.3f}, ATVR {:.3f} -> {:.3f}",
+			name, indices.size() / 3, before.acmr, after.acmr, before.atvr, after.atvr);
 	}
 
 	void SetVertexBoneData(Vertex& vertex, int boneID, float weight)
@@ -228,7 +331,7 @@ private:
 			else if (nrComponents == 4)
 				format = GL_RGBA;
 
-			glBindTexture(GL_TEXTURE_2D, textureID);
+			GLState::Get().BindTexture(GL_TEXTURE_2D, textureID);
 			glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
 			glGenerateMipmap(GL_TEXTURE_2D);
 
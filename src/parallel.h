@@ -0,0 +1,124 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent worker threads for data parallel loops on the render thread.
+// ParallelFor hands out [begin, end) chunks through an atomic counter; the calling thread
+// works on chunks too and returns once every chunk is done. One loop runs at a time.
+class ThreadPool
+{
+public:
+    static ThreadPool& Get()
+    {
+        static ThreadPool instance;
+        return instance;
+    }
+
+    // worker threads + the calling thread
+    int ThreadCount() const { return (int)workers.size() + 1; }
+
+    // body(begin, end) over [0, count) in chunks of at least minChunk items
+    void ParallelFor(int count, int minChunk, const std::function<void(int, int)>& body)
+    {
+        if (count <= 0)
+            return;
+        int chunk = std::max(minChunk, (count + ThreadCount() * 4 - 1) / (ThreadCount() * 4));
+        if (workers.empty() || count <= chunk)
+        {
+            body(0, count);
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job = &body;
+            jobCount = count;
+            jobChunk = chunk;
+            nextItem.store(0);
+            busyWorkers = (int)workers.size();
+            generation++;
+        }
+        wake.notify_all();
+        runChunks();
+
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this]() { return busyWorkers == 0; });
+        job = nullptr;
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    const std::function<void(int, int)>* job = nullptr;
+    int jobCount = 0;
+    int jobChunk = 1;
+    std::atomic<int> nextItem { 0 };
+    int busyWorkers = 0;
+    unsigned int generation = 0;
+    bool quit = false;
+
+    ThreadPool()
+    {
+        // leave a core for the driver thread
+        int hardware = (int)std::thread::hardware_concurrency();
+        int count = std::min(std::max(hardware - 2, 0), 7);
+        for (int i = 0; i < count; i++)
+            workers.emplace_back([this]() { workerLoop(); });
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+        }
+        wake.notify_all();
+        for (std::thread& worker : workers)
+            worker.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void runChunks()
+    {
+        for (;;)
+        {
+            int begin = nextItem.fetch_add(jobChunk);
+            if (begin >= jobCount)
+                return;
+            (*job)(begin, std::min(begin + jobChunk, jobCount));
+        }
+    }
+
+    void workerLoop()
+    {
+        unsigned int seen = 0;
+        for (;;)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&]() { return quit || generation != seen; });
+                if (quit)
+                    return;
+                seen = generation;
+            }
+            runChunks();
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                busyWorkers--;
+            }
+            done.notify_one();
+        }
+    }
+};
+#endif
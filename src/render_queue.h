@@ -0,0 +1,487 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "shader_m.h"
+#include "material.h"
+#include "geometry_arena.h"
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// passes in submission order (top bits of the sort key)
+enum RenderPass {
+    RENDER_PASS_SHADOW_CACHE = 0, // static casters into the shadow cache, SHADOW_CACHE + cascade
+    RENDER_PASS_SHADOW_CACHE_LAST = RENDER_PASS_SHADOW_CACHE + 3,
+    RENDER_PASS_SHADOW,     // cascaded shadow map: dynamic casters, SHADOW + cascade
+    RENDER_PASS_SHADOW_LAST = RENDER_PASS_SHADOW + 3,
+    RENDER_PASS_OCCLUDER,   // depth only, feeds the Hi-Z occlusion test
+    RENDER_PASS_DEPTH_PREPASS, // depth only, lets the main pass shade each pixel once
+    RENDER_PASS_GBUFFER,    // deferred shading: material attributes, lit afterwards
+    RENDER_PASS_MAIN,
+    RENDER_PASS_COUNT
+};
+
+// one draw call with everything needed to issue it
+struct DrawPacket {
+    uint64_t key = 0;               // filled by RenderQueue::Add
+    RenderPass pass = RENDER_PASS_MAIN;
+    const Shader* shader = nullptr;
+    const Material* material = nullptr; // nullptr: the draw samples no textures
+    GLuint vao = 0;
+    GLenum mode = GL_TRIANGLES;
+    GLenum indexType = 0;           // 0: glDrawArrays
+    GLint first = 0;                // first vertex (arrays) / base vertex (elements)
+    GLsizei count = 0;
+    size_t indexOffset = 0;         // bytes
+    glm::mat4 model = glm::mat4(1.0f);
+    // drawn once per matrix when instanceCount > 0. only honoured for indexed arena geometry
+    // drawn with a program that has the "instanced" uniform (attribute 7 instance matrix)
+    const glm::mat4* instances = nullptr;
+    GLsizei instanceCount = 0;
+    float depth = 0.0f;             // view depth, sorted front to back inside a state bucket
+};
+
+struct RenderQueueStats {
+    int packets = 0;
+    int commands = 0;       // draws after merging packets of the same geometry
+    int draws = 0;          // draw calls issued to GL
+    int programBinds = 0;
+    int textureBinds = 0;
+    int vaoBinds = 0;
+    int passes = 0;
+};
+
+// layout fixed by GL (glMultiDrawElementsIndirect)
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+// Collects draw packets for a frame, sorts them by a 64 bit key
+//   | pass 4 | program 12 | material 16 | vao 12 | depth 20 |
+// with an LSD radix sort and submits them in key order, skipping program, material
+// and VAO binds that match the previous packet.
+// Consecutive indexed packets sharing pass, program, material and VAO (arena page, i.e. vertex
+// format) form a batch: their model matrices go to the shared instance stream and each batch is
+// one glMultiDrawElementsIndirect (GL 4.3), or a loop of instanced draws re-basing the instance
+// stream on GL 3.3. Adjacent packets of the same geometry merge into one command.
+// Per-frame uniforms (camera, lights, bones) are expected to be set on the programs before
+// Submit; the queue only sets "model" / "instanced". A frame may Submit more than once
+// (e.g. around the occlusion test); stats add up until the next BeginFrame.
+// Each pass can be timed on the GPU with GL_TIME_ELAPSED queries, the whole frame with
+// timestamps at BeginFrame / EndFrame; results are read a few frames later, when they are
+// available, so timing never stalls the pipeline.
+class RenderQueue
+{
+public:
+    // called when submission enters a pass: bind its framebuffer, viewport, shared textures
+    void SetPassSetup(RenderPass pass, std::function<void()> setup)
+    {
+        passSetup[pass] = setup;
+    }
+
+    void SetDepthRange(float farPlane)
+    {
+        depthScale = farPlane > 0.0f ? 1.0f / farPlane : 0.0f;
+    }
+
+    void Add(DrawPacket packet)
+    {
+        packet.key = makeKey(packet);
+        packets.push_back(packet);
+    }
+
+    void Submit()
+    {
+        stats.packets += (int)packets.size();
+        if (!capsChecked)
+        {
+            multiDrawSupported = GLAD_GL_VERSION_4_3 != 0;
+            useMultiDraw = multiDrawSupported;
+            capsChecked = true;
+        }
+        sortPackets();
+        buildBatches();
+
+        GeometryArena& arena = GeometryArena::Get();
+        if (!instanceData.empty())
+            arena.UploadInstances(instanceData.data(), instanceData.size());
+        bool multiDraw = useMultiDraw && !commands.empty();
+        if (multiDraw)
+        {
+            if (indirectBuffer == 0)
+                glGenBuffers(1, &indirectBuffer);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+            glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data(), GL_STREAM_DRAW);
+        }
+
+        int currentPass = -1;
+        GLuint currentProgram = 0;
+        const Material* currentMaterial = nullptr;
+        GLuint currentVAO = 0;
+        ProgramUniforms* uniforms = nullptr;
+
+        for (size_t b = 0; b < batches.size(); b++)
+        {
+            const Batch& batch = batches[b];
+            const DrawPacket& packet = packets[order[batch.begin]];
+
+            if ((int)packet.pass != currentPass)
+            {
+                if (timing)
+                    beginPassTimer(packet.pass);
+                currentPass = packet.pass;
+                if (passSetup[packet.pass])
+                    passSetup[packet.pass]();
+                stats.passes++;
+                // the setup may have touched any state
+                currentProgram = 0;
+                currentMaterial = nullptr;
+                currentVAO = 0;
+            }
+            if (packet.shader->ID != currentProgram)
+            {
+                packet.shader->use();
+                currentProgram = packet.shader->ID;
+                uniforms = &programUniforms(*packet.shader);
+                // sampler setup is per program, so the material has to be rebound too
+                currentMaterial = nullptr;
+                stats.programBinds++;
+            }
+            if (packet.material && packet.material != currentMaterial)
+            {
+                packet.material->Bind(*packet.shader);
+                currentMaterial = packet.material;
+                stats.textureBinds += packet.material->BindingCount(*packet.shader);
+            }
+            if (packet.vao != currentVAO)
+            {
+                GLState::Get().BindVertexArray(packet.vao);
+                currentVAO = packet.vao;
+                stats.vaoBinds++;
+            }
+            setInstanced(*uniforms, batch.commandCount > 0);
+
+            if (batch.commandCount > 0)
+            {
+                stats.commands += (int)batch.commandCount;
+                if (multiDraw)
+                {
+                    glMultiDrawElementsIndirect(packet.mode, packet.indexType,
+                        (void*)(batch.firstCommand * sizeof(DrawElementsIndirectCommand)), (GLsizei)batch.commandCount, 0);
+                    stats.draws++;
+                    continue;
+                }
+                size_t indexSize = packet.indexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+                for (size_t c = batch.firstCommand; c < batch.firstCommand + batch.commandCount; c++)
+                {
+                    const DrawElementsIndirectCommand& command = commands[c];
+                    arena.SetInstanceBase(command.baseInstance);
+                    glDrawElementsInstancedBaseVertex(packet.mode, command.count, packet.indexType,
+                        (void*)(command.firstIndex * indexSize), command.instanceCount, command.baseVertex);
+                    stats.draws++;
+                }
+                arena.SetInstanceBase(0);
+                continue;
+            }
+
+            // not batchable: arrays, or a program without instancing support
+            stats.commands++;
+            if (uniforms->model >= 0)
+                glUniformMatrix4fv(uniforms->model, 1, GL_FALSE, &packet.model[0][0]);
+            if (packet.indexType == 0)
+                glDrawArrays(packet.mode, packet.first, packet.count);
+            else
+                glDrawElementsBaseVertex(packet.mode, packet.count, packet.indexType,
+                    (void*)packet.indexOffset, packet.first);
+            stats.draws++;
+        }
+
+        if (multiDraw)
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        endPassTimer();
+        packets.clear();
+    }
+
+    // multi-draw indirect needs GL 4.3; turning it off uses the per-command loop
+    bool MultiDrawSupported() const { return multiDrawSupported; }
+    bool MultiDrawEnabled() const { return useMultiDraw; }
+    void SetMultiDraw(bool enable) { useMultiDraw = enable && multiDrawSupported; }
+
+    // counts since the last BeginFrame
+    const RenderQueueStats& Stats() const { return stats; }
+
+    // once per frame before the first Submit: resets the stats and collects finished timers
+    void BeginFrame()
+    {
+        stats = RenderQueueStats();
+        if (!timing)
+            return;
+        if (timerQueries[0][0] == 0)
+        {
+            glGenQueries(kTimerFrames * RENDER_PASS_COUNT, &timerQueries[0][0]);
+            glGenQueries(kTimerFrames * 2, &frameQueries[0][0]);
+        }
+        timerFrame = (timerFrame + 1) % kTimerFrames;
+        if (frameIssued[timerFrame])
+        {
+            GLuint available = 0;
+            glGetQueryObjectuiv(frameQueries[timerFrame][1], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (available)
+            {
+                GLuint64 begin = 0, end = 0;
+                glGetQueryObjectui64v(frameQueries[timerFrame][0], GL_QUERY_RESULT, &begin);
+                glGetQueryObjectui64v(frameQueries[timerFrame][1], GL_QUERY_RESULT, &end);
+                frameMilliseconds = (float)((end - begin) / 1.0e6);
+            }
+            frameIssued[timerFrame] = false;
+        }
+        glQueryCounter(frameQueries[timerFrame][0], GL_TIMESTAMP);
+        // the slot about to be reused holds the oldest frame's queries
+        for (int pass = 0; pass < RENDER_PASS_COUNT; pass++)
+        {
+            if (!timerIssued[timerFrame][pass])
+            {
+                passMilliseconds[pass] = 0.0f;
+                continue;
+            }
+            GLuint available = 0;
+            glGetQueryObjectuiv(timerQueries[timerFrame][pass], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (available)
+            {
+                GLuint64 nanoseconds = 0;
+                glGetQueryObjectui64v(timerQueries[timerFrame][pass], GL_QUERY_RESULT, &nanoseconds);
+                passMilliseconds[pass] = (float)(nanoseconds / 1.0e6);
+            }
+            timerIssued[timerFrame][pass] = false;
+        }
+    }
+
+    // after the frame's last draw
+    void EndFrame()
+    {
+        if (!timing || frameQueries[0][0] == 0)
+            return;
+        glQueryCounter(frameQueries[timerFrame][1], GL_TIMESTAMP);
+        frameIssued[timerFrame] = true;
+    }
+
+    void SetTiming(bool enable) { timing = enable; }
+    bool TimingEnabled() const { return timing; }
+    // GPU time of a pass, a few frames old; 0 when the pass drew nothing
+    float PassMilliseconds(RenderPass pass) const { return passMilliseconds[pass]; }
+    // GPU time between BeginFrame and EndFrame, a few frames old
+    float FrameMilliseconds() const { return frameMilliseconds; }
+
+private:
+    struct Batch {
+        size_t begin;           // range in order[]
+        size_t end;
+        size_t firstCommand;    // range in commands, empty when drawn packet by packet
+        size_t commandCount;
+    };
+
+    struct ProgramUniforms {
+        GLuint program;
+        GLint model;
+        GLint instanced;
+        int instancedValue;
+    };
+
+    std::vector<DrawPacket> packets;
+    std::vector<uint32_t> order, scratch;
+    std::vector<Batch> batches;
+    std::vector<DrawElementsIndirectCommand> commands;
+    std::vector<glm::mat4> instanceData;
+    GLuint indirectBuffer = 0;
+    bool capsChecked = false;
+    bool multiDrawSupported = false;
+    bool useMultiDraw = false;
+    std::vector<ProgramUniforms> uniformCache;
+    std::function<void()> passSetup[RENDER_PASS_COUNT];
+    float depthScale = 0.01f;
+    RenderQueueStats stats;
+
+    static const int kTimerFrames = 3;
+    bool timing = true;
+    GLuint timerQueries[kTimerFrames][RENDER_PASS_COUNT] = { { 0 } };
+    bool timerIssued[kTimerFrames][RENDER_PASS_COUNT] = { { false } };
+    int timerFrame = 0;
+    int activeTimer = -1;
+    float passMilliseconds[RENDER_PASS_COUNT] = { 0.0f };
+    GLuint frameQueries[kTimerFrames][2] = { { 0 } };
+    bool frameIssued[kTimerFrames] = { false };
+    float frameMilliseconds = 0.0f;
+
+    // time elapsed queries can't nest, the previous pass's timer ends here
+    void beginPassTimer(RenderPass pass)
+    {
+        endPassTimer();
+        if (timerQueries[0][0] == 0)
+            return;
+        glBeginQuery(GL_TIME_ELAPSED, timerQueries[timerFrame][pass]);
+        timerIssued[timerFrame][pass] = true;
+        activeTimer = pass;
+    }
+
+    void endPassTimer()
+    {
+        if (activeTimer < 0)
+            return;
+        glEndQuery(GL_TIME_ELAPSED);
+        activeTimer = -1;
+    }
+
+    uint64_t makeKey(const DrawPacket& packet) const
+    {
+        uint64_t depth = (uint64_t)(glm::clamp(packet.depth * depthScale, 0.0f, 1.0f) * 0xFFFFF);
+        uint64_t material = packet.material ? packet.material->Id() : 0;
+        return ((uint64_t)(packet.pass & 0xF) << 60)
+            | ((uint64_t)(packet.shader->ID & 0xFFF) << 48)
+            | ((material & 0xFFFF) << 32)
+            | ((uint64_t)(packet.vao & 0xFFF) << 20)
+            | (depth & 0xFFFFF);
+    }
+
+    // least significant byte first radix sort of packet indices, skipping bytes
+    // every key shares (typically most of them)
+    void sortPackets()
+    {
+        size_t count = packets.size();
+        order.resize(count);
+        scratch.resize(count);
+        for (size_t i = 0; i < count; i++)
+            order[i] = (uint32_t)i;
+
+        for (int shift = 0; shift < 64; shift += 8)
+        {
+            size_t histogram[256] = { 0 };
+            for (size_t i = 0; i < count; i++)
+                histogram[(packets[i].key >> shift) & 0xFF]++;
+            if (count == 0 || histogram[(packets[0].key >> shift) & 0xFF] == count)
+                continue;
+
+            size_t offset = 0;
+            for (int b = 0; b < 256; b++)
+            {
+                size_t n = histogram[b];
+                histogram[b] = offset;
+                offset += n;
+            }
+            for (size_t i = 0; i < count; i++)
+            {
+                uint32_t index = order[i];
+                scratch[histogram[(packets[index].key >> shift) & 0xFF]++] = index;
+            }
+            order.swap(scratch);
+        }
+    }
+
+    static bool sameBatch(const DrawPacket& a, const DrawPacket& b)
+    {
+        return a.pass == b.pass && a.shader->ID == b.shader->ID && a.material == b.material
+            && a.vao == b.vao && a.mode == b.mode && a.indexType == b.indexType;
+    }
+
+    // groups the sorted packets into batches and fills the frame's commands / instance matrices
+    void buildBatches()
+    {
+        batches.clear();
+        commands.clear();
+        instanceData.clear();
+
+        size_t count = order.size();
+        size_t i = 0;
+        while (i < count)
+        {
+            const DrawPacket& first = packets[order[i]];
+            Batch batch;
+            batch.begin = i;
+            batch.firstCommand = commands.size();
+            bool batchable = first.indexType != 0 && programUniforms(*first.shader).instanced >= 0;
+            if (!batchable)
+            {
+                i++;
+            }
+            else
+            {
+                do {
+                    appendCommand(packets[order[i]], batch.firstCommand);
+                    i++;
+                } while (i < count && sameBatch(first, packets[order[i]]));
+            }
+            batch.end = i;
+            batch.commandCount = commands.size() - batch.firstCommand;
+            batches.push_back(batch);
+        }
+    }
+
+    void appendCommand(const DrawPacket& packet, size_t batchFirstCommand)
+    {
+        GLuint baseInstance = (GLuint)instanceData.size();
+        GLuint instanceCount = 1;
+        if (packet.instanceCount > 0)
+        {
+            instanceData.insert(instanceData.end(), packet.instances, packet.instances + packet.instanceCount);
+            instanceCount = (GLuint)packet.instanceCount;
+        }
+        else
+        {
+            instanceData.push_back(packet.model);
+        }
+
+        size_t indexSize = packet.indexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+        DrawElementsIndirectCommand command;
+        command.count = (GLuint)packet.count;
+        command.instanceCount = instanceCount;
+        command.firstIndex = (GLuint)(packet.indexOffset / indexSize);
+        command.baseVertex = packet.first;
+        command.baseInstance = baseInstance;
+
+        // same geometry as the previous command: its instances are contiguous, extend it
+        if (commands.size() > batchFirstCommand)
+        {
+            DrawElementsIndirectCommand& last = commands.back();
+            if (last.firstIndex == command.firstIndex && last.count == command.count && last.baseVertex == command.baseVertex
+                && last.baseInstance + last.instanceCount == command.baseInstance)
+            {
+                last.instanceCount += command.instanceCount;
+                return;
+            }
+        }
+        commands.push_back(command);
+    }
+
+    void setInstanced(ProgramUniforms& uniforms, bool instanced)
+    {
+        if (uniforms.instanced >= 0 && uniforms.instancedValue != (int)instanced)
+        {
+            glUniform1i(uniforms.instanced, (int)instanced);
+            uniforms.instancedValue = (int)instanced;
+        }
+    }
+
+    ProgramUniforms& programUniforms(const Shader& shader)
+    {
+        for (size_t i = 0; i < uniformCache.size(); i++)
+        {
+            if (uniformCache[i].program == shader.ID)
+                return uniformCache[i];
+        }
+        ProgramUniforms entry;
+        entry.program = shader.ID;
+        entry.model = glGetUniformLocation(shader.ID, "model");
+        entry.instanced = glGetUniformLocation(shader.ID, "instanced");
+        entry.instancedValue = -1;
+        uniformCache.push_back(entry);
+        return uniformCache.back();
+    }
+};
+#endif
@@ -0,0 +1,223 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <glm/glm.hpp>
+
+#include "bounds.h"
+#include "frustum.h"
+#include "aabb_tree.h"
+
+#include <cstdint>
+#include <vector>
+
+// Flat transform hierarchy + dynamic AABB tree over the nodes' world bounds.
+// Nodes live in arrays ordered so that a parent always comes before its children, so
+// UpdateTransforms resolves the hierarchy (and dirty flag propagation) in one linear pass.
+// Nodes with valid local bounds get a leaf in the tree; group nodes (no bounds) only carry
+// transforms. The int user data is whatever the caller draws for the node.
+class Scene
+{
+public:
+    static const int kNoParent = -1;
+
+    struct UpdateStats {
+        int updated = 0;        // world transforms recomputed
+        int reinserted = 0;     // tree leaves that escaped their fat box
+    };
+
+    explicit Scene(float treeMargin = 0.1f) : tree(treeMargin) {}
+
+    int CreateNode(int parentNode, const glm::mat4& local, const AABB& localBounds = AABB(), int userData = -1)
+    {
+        int node = allocate(parentNode);
+        parent[node] = parentNode;
+        localTransform[node] = local;
+        worldTransform[node] = local;
+        this->localBounds[node] = localBounds;
+        worldBounds[node] = AABB();
+        proxy[node] = AABBTree::kNull;
+        this->userData[node] = userData;
+        alive[node] = 1;
+        dirty[node] = 1;
+        anyDirty = true;
+        nodeCount++;
+        return node;
+    }
+
+    // destroys the node and all of its descendants
+    void DestroyNode(int node)
+    {
+        release(node);
+        // descendants come after their parent
+        for (size_t i = node + 1; i < parent.size(); i++)
+        {
+            if (alive[i] && parent[i] != kNoParent && !alive[parent[i]])
+                release((int)i);
+        }
+    }
+
+    void SetLocalTransform(int node, const glm::mat4& local)
+    {
+        if (localTransform[node] == local)
+            return;
+        localTransform[node] = local;
+        dirty[node] = 1;
+        anyDirty = true;
+    }
+
+    void SetLocalBounds(int node, const AABB& bounds)
+    {
+        localBounds[node] = bounds;
+        dirty[node] = 1;
+        anyDirty = true;
+    }
+
+    bool Alive(int node) const { return alive[node] != 0; }
+    int Parent(int node) const { return parent[node]; }
+    int UserData(int node) const { return userData[node]; }
+    const glm::mat4& LocalTransform(int node) const { return localTransform[node]; }
+    const glm::mat4& World(int node) const { return worldTransform[node]; }
+    const AABB& WorldBounds(int node) const { return worldBounds[node]; }
+    // nodes with bounds (i.e. in the tree)
+    size_t ObjectCount() const { return tree.ProxyCount(); }
+    size_t NodeCount() const { return nodeCount; }
+    const AABBTree& Tree() const { return tree; }
+    // box around every object (slightly loose: the tree's fat boxes)
+    AABB Bounds() const { return tree.RootBounds(); }
+    const UpdateStats& LastUpdate() const { return stats; }
+
+    // recomputes world transforms / bounds of dirty nodes and their descendants, moves their leaves
+    void UpdateTransforms()
+    {
+        stats = UpdateStats();
+        if (!anyDirty)
+            return;
+        for (size_t i = 0; i < parent.size(); i++)
+        {
+            if (!alive[i])
+                continue;
+            int p = parent[i];
+            if (p != kNoParent && dirty[p])
+                dirty[i] = 1;
+            if (!dirty[i])
+                continue;
+
+            worldTransform[i] = p != kNoParent ? worldTransform[p] * localTransform[i] : localTransform[i];
+            stats.updated++;
+            if (!localBounds[i].Valid())
+                continue;
+            worldBounds[i] = localBounds[i].Transformed(worldTransform[i]);
+            if (proxy[i] == AABBTree::kNull)
+                proxy[i] = tree.CreateProxy(worldBounds[i], (int)i);
+            else if (tree.MoveProxy(proxy[i], worldBounds[i]))
+                stats.reinserted++;
+        }
+        std::fill(dirty.begin(), dirty.end(), 0);
+        anyDirty = false;
+    }
+
+    // callback(node) for every node whose bounds may intersect the frustum
+    template <typename Callback>
+    void QueryFrustum(const Frustum& frustum, Callback callback) const
+    {
+        tree.QueryFrustum(frustum, [&](int node) {
+            // the leaf box is fat; a tight test drops most of the false positives cheaply
+            if (frustum.TestAABB(worldBounds[node]))
+                callback(node);
+        });
+    }
+
+    // callback(node) for every node whose bounds touch the sphere
+    template <typename Callback>
+    void QuerySphere(const glm::vec3& center, float radius, Callback callback) const
+    {
+        tree.QuerySphere(center, radius, [&](int node) {
+            glm::vec3 d = glm::clamp(center, worldBounds[node].min, worldBounds[node].max) - center;
+            if (glm::dot(d, d) <= radius * radius)
+                callback(node);
+        });
+    }
+
+    // callback(node) for every node with bounds, in index order
+    template <typename Callback>
+    void ForEachObject(Callback callback) const
+    {
+        for (size_t i = 0; i < parent.size(); i++)
+        {
+            if (alive[i] && proxy[i] != AABBTree::kNull)
+                callback((int)i);
+        }
+    }
+
+    // nearest node whose world box the ray hits, -1 if none
+    int RayCast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, float* hitDistance = nullptr) const
+    {
+        int hit = -1;
+        glm::vec3 invDirection = 1.0f / direction;
+        tree.RayCast(origin, direction, maxDistance, [&](int node, float closest) {
+            float distance;
+            if (!AABBTree::RayBox(origin, invDirection, worldBounds[node], closest, distance))
+                return closest;
+            hit = node;
+            return distance;
+        });
+        if (hit >= 0 && hitDistance)
+            AABBTree::RayBox(origin, invDirection, worldBounds[hit], maxDistance, *hitDistance);
+        return hit;
+    }
+
+private:
+    std::vector<int> parent;
+    std::vector<glm::mat4> localTransform;
+    std::vector<glm::mat4> worldTransform;
+    std::vector<AABB> localBounds;
+    std::vector<AABB> worldBounds;
+    std::vector<int> proxy;
+    std::vector<int> userData;
+    std::vector<uint8_t> alive;
+    std::vector<uint8_t> dirty;
+    std::vector<int> freeSlots;
+    AABBTree tree;
+    UpdateStats stats;
+    size_t nodeCount = 0;
+    bool anyDirty = false;
+
+    // reuses a freed slot that still sorts after the parent, otherwise appends
+    int allocate(int parentNode)
+    {
+        for (size_t i = 0; i < freeSlots.size(); i++)
+        {
+            if (freeSlots[i] > parentNode)
+            {
+                int slot = freeSlots[i];
+                freeSlots[i] = freeSlots.back();
+                freeSlots.pop_back();
+                return slot;
+            }
+        }
+        parent.push_back(kNoParent);
+        localTransform.push_back(glm::mat4(1.0f));
+        worldTransform.push_back(glm::mat4(1.0f));
+        localBounds.push_back(AABB());
+        worldBounds.push_back(AABB());
+        proxy.push_back(AABBTree::kNull);
+        userData.push_back(-1);
+        alive.push_back(0);
+        dirty.push_back(0);
+        return (int)parent.size() - 1;
+    }
+
+    void release(int node)
+    {
+        if (!alive[node])
+            return;
+        if (proxy[node] != AABBTree::kNull)
+            tree.DestroyProxy(proxy[node]);
+        proxy[node] = AABBTree::kNull;
+        alive[node] = 0;
+        dirty[node] = 0;
+        freeSlots.push_back(node);
+        nodeCount--;
+    }
+};
+#endif
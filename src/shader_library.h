@@ -0,0 +1,139 @@
+#ifndef SHADER_LIBRARY_H
+#define SHADER_LIBRARY_H
+
+#include <glad/glad.h>
+#include <spdlog/spdlog.h>
+
+#include "shader_m.h"
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Feature switches of a program variant, compiled in as #defines so a variant has no runtime
+// branches for them. Kept sorted by name: equal sets give equal keys whatever the Set order.
+class ShaderDefines
+{
+public:
+    ShaderDefines& Set(const std::string& name, int value = 1)
+    {
+        auto it = std::lower_bound(defines.begin(), defines.end(), name,
+            [](const std::pair<std::string, int>& define, const std::string& key) { return define.first < key; });
+        if (it != defines.end() && it->first == name)
+            it->second = value;
+        else
+            defines.insert(it, std::make_pair(name, value));
+        return *this;
+    }
+
+    // cache key, e.g. "SHADOW_FILTER=1;SKINNING=0"
+    std::string Key() const
+    {
+        std::string key;
+        for (const auto& define : defines)
+            key += define.first + "=" + std::to_string(define.second) + ";";
+        return key;
+    }
+
+    // lines for Shader's defines argument
+    std::string Source() const
+    {
+        std::string source;
+        for (const auto& define : defines)
+            source += "#define " + define.first + " " + std::to_string(define.second) + "\n";
+        return source;
+    }
+
+private:
+    std::vector<std::pair<std::string, int>> defines;
+};
+
+// Compiled program variants, cached by program name + define set.
+// A program is a vertex / fragment source pair registered under a name, with a setup callback
+// for what every new variant needs once (sampler units). Two names may share sources when their
+// programs get different per-frame uniforms (e.g. the shadow and the camera depth programs).
+// Variants are compiled on first use and live until exit; the returned reference stays valid.
+class ShaderLibrary
+{
+public:
+    static ShaderLibrary& Get()
+    {
+        static ShaderLibrary instance;
+        return instance;
+    }
+
+    void Register(const std::string& program, const char* vertexPath, const char* fragmentPath,
+        std::function<void(const Shader&)> setup = nullptr)
+    {
+        Program& entry = programs[program];
+        entry.vertexPath = vertexPath;
+        entry.fragmentPath = fragmentPath;
+        entry.setup = setup;
+    }
+
+    const Shader& Variant(const std::string& program, const ShaderDefines& defines = ShaderDefines())
+    {
+        auto found = programs.find(program);
+        if (found == programs.end())
+        {
+            SPDLOG_ERROR("shader program '{}' is not registered", program);
+            static Shader none;
+            return none;
+        }
+        Program& entry = found->second;
+        std::string key = defines.Key();
+        auto variant = entry.variants.find(key);
+        if (variant != entry.variants.end())
+            return *variant->second;
+
+        auto start = std::chrono::steady_clock::now();
+        std::unique_ptr<Shader> shader(new Shader(entry.vertexPath.c_str(), entry.fragmentPath.c_str(), defines.Source()));
+        if (entry.setup)
+        {
+            shader->use();
+            entry.setup(*shader);
+        }
+        float milliseconds = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+        SPDLOG_INFO("compiled {} [{}] in {:.1f} ms", program, key, milliseconds);
+        return *(entry.variants[key] = std::move(shader));
+    }
+
+    // callback(shader) for every compiled variant of a program
+    template <typename Callback>
+    void ForEachVariant(const std::string& program, Callback callback) const
+    {
+        auto found = programs.find(program);
+        if (found == programs.end())
+            return;
+        for (const auto& variant : found->second.variants)
+            callback(*variant.second);
+    }
+
+    int VariantCount() const
+    {
+        int count = 0;
+        for (const auto& program : programs)
+            count += (int)program.second.variants.size();
+        return count;
+    }
+    int ProgramCount() const { return (int)programs.size(); }
+
+private:
+    struct Program {
+        std::string vertexPath;
+        std::string fragmentPath;
+        std::function<void(const Shader&)> setup;
+        std::map<std::string, std::unique_ptr<Shader>> variants;
+    };
+    std::map<std::string, Program> programs;
+
+    ShaderLibrary() {}
+    ShaderLibrary(const ShaderLibrary&) = delete;
+    ShaderLibrary& operator=(const ShaderLibrary&) = delete;
+};
+#endif
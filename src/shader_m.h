@@ -4,20 +4,27 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include "gl_state.h"
+
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <vector>
 
 class Shader
 {
 public:
-    unsigned int ID;
+    unsigned int ID = 0;
     // constructor generates the shader on the fly
     // ------------------------------------------------------------------------
     Shader() {} // default constructor - 전역 변수로 사용할 때
     
-    Shader(const char* vertexPath, const char* fragmentPath)
+    // defines: "#define NAME value" lines inserted after the #version line of both stages
+    // #include "file" lines are replaced by that file, looked up next to the including shader
+    // feedbackVaryings: vertex outputs captured by transform feedback, one buffer binding each
+    Shader(const char* vertexPath, const char* fragmentPath, const std::string& defines = std::string(),
+        const std::vector<const char*>& feedbackVaryings = std::vector<const char*>())
     {
         // 1. retrieve the vertex/fragment source code from filePath
         std::string vertexCode;
@@ -42,6 +49,10 @@ public:
             // convert stream into string
             vertexCode = vShaderStream.str();
             fragmentCode = fShaderStream.str();			
+            resolveIncludes(vertexCode, vertexPath);
+            resolveIncludes(fragmentCode, fragmentPath);
+            injectDefines(vertexCode, defines);
+            injectDefines(fragmentCode, defines);
         }
         catch (std::ifstream::failure& e)
         {
@@ -65,6 +76,8 @@ public:
         ID = glCreateProgram();
         glAttachShader(ID, vertex);
         glAttachShader(ID, fragment);
+        if (!feedbackVaryings.empty())
+            glTransformFeedbackVaryings(ID, (GLsizei)feedbackVaryings.size(), feedbackVaryings.data(), GL_SEPARATE_ATTRIBS);
         glLinkProgram(ID);
         checkCompileErrors(ID, "PROGRAM");
         // delete the shaders as they're linked into our program now and no longer necessary
@@ -76,7 +89,7 @@ public:
     // ------------------------------------------------------------------------
     void use() const
     { 
-        glUseProgram(ID); 
+        GLState::Get().UseProgram(ID);
     }
     // utility uniform functions
     // ------------------------------------------------------------------------
@@ -138,6 +151,50 @@ public:
     }
 
 private:
+    // #version must stay the first line, the defines go right after it
+    static void injectDefines(std::string& code, const std::string& defines)
+    {
+        if (defines.empty())
+            return;
+        size_t version = code.find("#version");
+        size_t lineEnd = version == std::string::npos ? std::string::npos : code.find('\n', version);
+        if (lineEnd == std::string::npos)
+            code.insert(0, defines + "\n");
+        else
+            code.insert(lineEnd + 1, defines + "\n");
+    }
+
+    // GLSL has no #include: shared snippets (skinning.glsl) are pasted in at load time.
+    // one level only, an included file can't include others
+    static void resolveIncludes(std::string& code, const std::string& shaderPath)
+    {
+        size_t slash = shaderPath.find_last_of("/\\");
+        std::string directory = slash == std::string::npos ? std::string() : shaderPath.substr(0, slash + 1);
+        size_t position = 0;
+        while ((position = code.find("#include", position)) != std::string::npos)
+        {
+            size_t lineEnd = code.find('\n', position);
+            size_t open = code.find('"', position);
+            size_t close = open == std::string::npos ? std::string::npos : code.find('"', open + 1);
+            if (close == std::string::npos || (lineEnd != std::string::npos && close > lineEnd))
+            {
+                std::cout << "ERROR::SHADER::BAD_INCLUDE in " << shaderPath << std::endl;
+                return;
+            }
+            std::string includePath = directory + code.substr(open + 1, close - open - 1);
+            std::ifstream includeFile(includePath);
+            std::stringstream included;
+            if (includeFile)
+                included << includeFile.rdbuf();
+            else
+                std::cout << "ERROR::SHADER::INCLUDE_NOT_FOUND: " << includePath << std::endl;
+            std::string text = included.str();
+            size_t end = lineEnd == std::string::npos ? code.size() : lineEnd;
+            code.replace(position, end - position, text);
+            position += text.size();
+        }
+    }
+
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
     void checkCompileErrors(GLuint shader, std::string type)
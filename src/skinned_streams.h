@@ -0,0 +1,104 @@
+#ifndef SKINNED_STREAMS_H
+#define SKINNED_STREAMS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "mesh.h"
+#include "geometry_arena.h"
+
+#include <vector>
+
+// Skinned positions / normals of a set of skinned meshes, rewritten every frame by whoever skins
+// them (CpuSkinning, SkinningCache). One buffer holds all positions, then all normals, meshes in
+// the order they were added; every mesh gets stream VAOs (GeometryArena::CreateStreamVAO) that
+// draw them as static geometry: base vertex 0, the SKINNING 0 program variants.
+class SkinnedStreams
+{
+public:
+    struct Entry {
+        const Mesh* mesh = nullptr;
+        size_t first = 0;       // first vertex in the streams
+        size_t count = 0;
+        GLuint vao = 0;
+        GLuint depthVAO = 0;
+    };
+
+    // false (and nothing added) for meshes that are not skinned arena meshes
+    bool Add(const Mesh& mesh)
+    {
+        if (!mesh.skinned || mesh.range.page < 0)
+            return false;
+        Entry entry;
+        entry.mesh = &mesh;
+        entry.first = vertexCount;
+        entry.count = (size_t)mesh.range.vertexCount;
+        vertexCount += entry.count;
+        entries.push_back(entry);
+        layoutChanged = true;
+        return true;
+    }
+
+    // starts a frame's contents: storage and VAOs follow the meshes added since the last frame,
+    // and the buffer is orphaned so its writes never wait on the previous frame's draws
+    void BeginFrame()
+    {
+        if (layoutChanged)
+            createStreams();
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        glBufferData(GL_ARRAY_BUFFER, 2 * vertexCount * sizeof(glm::vec3), NULL, GL_STREAM_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // stream VAO of an added mesh (valid after the first BeginFrame), 0 for other meshes
+    GLuint VAO(const Mesh& mesh, bool depthOnly) const
+    {
+        const Entry* entry = Find(mesh);
+        if (!entry)
+            return 0;
+        return depthOnly ? entry->depthVAO : entry->vao;
+    }
+
+    const Entry* Find(const Mesh& mesh) const
+    {
+        for (const Entry& entry : entries)
+        {
+            if (entry.mesh == &mesh)
+                return &entry;
+        }
+        return nullptr;
+    }
+
+    // byte offsets of a range of vertices in the buffer
+    size_t PositionOffset(size_t firstVertex) const { return firstVertex * sizeof(glm::vec3); }
+    size_t NormalOffset(size_t firstVertex) const { return (vertexCount + firstVertex) * sizeof(glm::vec3); }
+
+    const std::vector<Entry>& Entries() const { return entries; }
+    size_t VertexCount() const { return vertexCount; }
+    GLuint Buffer() const { return buffer; }
+
+private:
+    std::vector<Entry> entries;
+    size_t vertexCount = 0;
+    GLuint buffer = 0;
+    bool layoutChanged = false;
+
+    void createStreams()
+    {
+        if (buffer == 0)
+            glGenBuffers(1, &buffer);
+        GeometryArena& arena = GeometryArena::Get();
+        for (Entry& entry : entries)
+        {
+            if (entry.vao != 0)
+            {
+                glDeleteVertexArrays(1, &entry.vao);
+                glDeleteVertexArrays(1, &entry.depthVAO);
+            }
+            entry.vao = arena.CreateStreamVAO(entry.mesh->range, false, buffer, PositionOffset(entry.first), NormalOffset(entry.first));
+            entry.depthVAO = arena.CreateStreamVAO(entry.mesh->range, true, buffer, PositionOffset(entry.first), NormalOffset(entry.first));
+        }
+        layoutChanged = false;
+    }
+};
+#endif
@@ -0,0 +1,78 @@
+#ifndef SKINNING_CACHE_H
+#define SKINNING_CACHE_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "shader_m.h"
+#include "gl_state.h"
+#include "mesh.h"
+#include "geometry_arena.h"
+#include "skinned_streams.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// Skins animated meshes once per frame on the GPU, before the passes that draw them.
+// Every vertex is drawn as a point through skinning_feedback.vs with the rasterizer off, and
+// transform feedback writes the skinned position / normal into SkinnedStreams; the shadow
+// cascades, the depth prepass and the main pass then draw that as static geometry (SKINNING 0
+// variants), so the bone blend runs once per vertex instead of once per pass.
+// GL 3.3 transform feedback rather than a compute shader, which would need GL 4.3.
+class SkinningCache
+{
+public:
+    static const int kMaxBones = 100;   // MAX_BONES of skinning.glsl
+
+    void Init()
+    {
+        program = Shader("./shader/skinning_feedback.vs", "./shader/skinning_feedback.fs", std::string(),
+            { "skinnedPosition", "skinnedNormal" });
+    }
+
+    // false for meshes that are not skinned arena meshes
+    bool Add(const Mesh& mesh) { return streams.Add(mesh); }
+
+    // skins every added mesh with the bone palette (Animator::GetFinalBoneMatrices)
+    void Update(const std::vector<glm::mat4>& bones)
+    {
+        if (streams.VertexCount() == 0)
+            return;
+        streams.BeginFrame();
+        program.use();
+        int boneCount = std::min((int)bones.size(), kMaxBones);
+        glUniformMatrix4fv(glGetUniformLocation(program.ID, "finalBonesMatrices"), boneCount, GL_FALSE, &bones[0][0][0]);
+
+        GeometryArena& arena = GeometryArena::Get();
+        glEnable(GL_RASTERIZER_DISCARD);
+        for (const SkinnedStreams::Entry& entry : streams.Entries())
+        {
+            const GeometryRange& range = entry.mesh->range;
+            size_t bytes = entry.count * sizeof(glm::vec3);
+            glBindBufferRange(GL_TRANSFORM_FEEDBACK_BUFFER, 0, streams.Buffer(), streams.PositionOffset(entry.first), bytes);
+            glBindBufferRange(GL_TRANSFORM_FEEDBACK_BUFFER, 1, streams.Buffer(), streams.NormalOffset(entry.first), bytes);
+            // the page VAO has the position, normal and skinning streams
+            arena.Bind(range.page, false);
+            glBeginTransformFeedback(GL_POINTS);
+            glDrawArrays(GL_POINTS, range.baseVertex, range.vertexCount);
+            glEndTransformFeedback();
+        }
+        glDisable(GL_RASTERIZER_DISCARD);
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 1, 0);
+        skinnedVertices = (int)streams.VertexCount();
+    }
+
+    // stream VAO of an added mesh (valid after the first Update), 0 for other meshes
+    GLuint VAO(const Mesh& mesh, bool depthOnly) const { return streams.VAO(mesh, depthOnly); }
+
+    // vertices skinned by the last Update
+    int SkinnedVertices() const { return skinnedVertices; }
+
+private:
+    Shader program;
+    SkinnedStreams streams;
+    int skinnedVertices = 0;
+};
+#endif